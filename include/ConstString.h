@@ -37,11 +37,17 @@ class ConstString
 public:
     /// Constructor, which default to the null string. The string pointed to
     // must never be deleted/modified, hence the explicit constructor!
-    explicit ConstString(const gchar * string = 0) : mString(string) {}
+    explicit ConstString(const gchar * string = 0) : mString(string), mInterned(false) {}
+
+    /// Get the canonical ConstString of a text. All interned ConstStrings
+    // of the same text share one pointer, so comparing two of them is
+    // a pointer compare. The text is copied on first use & never freed.
+    static ConstString    intern(const gchar * string);
+    bool        isInterned() const      { return mInterned; }
 
     /// Assignment operator
     ConstString &    operator=(const ConstString & rhs)
-                                       { mString = rhs.mString; return *this; }
+            { mString = rhs.mString; mInterned = rhs.mInterned; return *this; }
 
     /// Compare operator, case sensitive
     bool        operator==(const gchar * rhs) const
@@ -49,7 +55,8 @@ public:
     /// Compare operator, case sensitive
     bool        operator==(const ConstString & rhs) const
                                         { return mString == rhs.mString ||
-                                         ::strcmp(c_str(), rhs.c_str()) == 0; }
+                                         (!(mInterned && rhs.mInterned) &&
+                                         ::strcmp(c_str(), rhs.c_str()) == 0); }
 
     /// Diff operator, case sensitive
     bool        operator!=(const gchar * rhs) const{ return !operator==(rhs); }
@@ -94,8 +101,16 @@ public:
 
 private:
     const gchar * mString;
+    bool          mInterned;
 };
 
+/// Built-in unit tests: UT_CHECK(test) logs & counts a failure if test is false
+#define UT_CHECK(t) ((t) || (failedUnitTest(#t, __FILE__, __LINE__, __FUNCTION__), false))
+
+void failedUnitTest(const gchar * test, const gchar * file, int line, const gchar * function);
+/// Failures counted by UT_CHECK so far, all unit tests together
+int unitTestFailureCount();
+
 /// Build an std::string using printf-style formatting
 std::string string_printf(const char *format, ...) G_GNUC_PRINTF(1, 2);
 
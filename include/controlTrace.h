@@ -0,0 +1,55 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _CONTROLTRACE_H_
+#define _CONTROLTRACE_H_
+
+#include <glib.h>
+
+/// Always-on trace of the control events: a fixed size in-memory ring of
+/// compact binary records, cheap enough to stay enabled in production,
+/// unlike LTTng. Dumped to cTraceDumpPath on SIGUSR1 or with the
+/// /state/dumpTrace luna method, then decoded with tools/audiod-trace-decode.py.
+/// Recording is safe from any thread, naming events is main thread only.
+
+#define cTraceDumpPath "/var/log/audiod-trace.bin"
+
+enum ETraceEvent
+{
+    eTrace_None = 0,
+    eTrace_Scenario,        // name: scenario
+    eTrace_ProgramSource,   // code: command, arg0: sink, arg1: value
+    eTrace_PulseStatus,     // code: Pulse message, arg0: sink, arg1: info
+    eTrace_LunaBegin,       // name: category/method
+    eTrace_LunaEnd,         // name: category/method, arg0: latency in us
+    eTrace_DtmfStart,       // code: tone, arg0: held
+    eTrace_DtmfStop,
+    eTrace_PlayLatency,     // name: sink, arg0: defer & arg1: start latencies in us
+    eTrace_StateEvent,      // code: EStateEvent, arg0 & arg1: its arguments, arg2: nesting
+    eTrace_VolumeRamp       // code: curve or 'x' when cancelled, arg0: sink, arg1: volume, arg2: duration in ms
+};
+
+/// Id for a name recorded with events, 0 once the name table is full
+guint16 traceName(const char * name);
+
+void traceEvent(ETraceEvent event, char code = 0, guint16 name = 0,
+                gint32 arg0 = 0, gint32 arg1 = 0, gint32 arg2 = 0);
+
+/// Write the ring & the name table to a file. Async-signal safe.
+/// Returns how many records were written, -1 on failure.
+int traceDump(const char * path);
+
+#endif // _CONTROLTRACE_H_
@@ -0,0 +1,53 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _LATENCYHISTOGRAM_H_
+#define _LATENCYHISTOGRAM_H_
+
+#include <glib.h>
+#include <pbnjson.hpp>
+
+/// Log-linear latency histogram: 4 linear buckets per power of 2 of us,
+/// so that percentiles are within 25%, in a fixed 512 bytes.
+/// Not thread safe.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() { reset(); }
+
+    void    record(gint64 us);
+    void    reset();
+
+    guint64 count() const           { return mCount; }
+    /// Upper bound of the bucket holding that percentile, in us
+    gint64  percentile(double percent) const;
+
+    /// count, mean, max, p50, p95 & p99 in ms, & optionally the non empty buckets
+    void    toJson(pbnjson::JValue & json, bool withBuckets = true) const;
+
+private:
+    static const int cBucketCount = 128;
+
+    static int      bucketIndex(gint64 us);
+    static gint64   bucketUpperBound(int index);
+
+    guint32 mBuckets[cBucketCount];
+    guint64 mCount;
+    gint64  mTotal;
+    gint64  mMax;
+};
+
+#endif // _LATENCYHISTOGRAM_H_
@@ -40,6 +40,13 @@ void setLogDestination(ELogDestination logDestination);
 /// Add log destination to the current ones
 void addLogDestination(ELogDestination logDestination);
 
+/// Rotate the private log file while running, when it reaches maxSize bytes or
+/// is older than maxAge seconds (0: no age limit). Archives are gzipped if asked,
+/// & the oldest ones removed once they take more than diskBudget bytes.
+/// Safe from any thread, applied at the next rotation.
+void setLogRotation(size_t maxSize, guint maxAge, size_t diskBudget, bool compress);
+void getLogRotation(size_t & maxSize, guint & maxAge, size_t & diskBudget, bool & compress);
+
 /// Set the log level. Everything higher than that & that level will be logged.
 void setLogLevel(GLogLevelFlags level);
 GLogLevelFlags getLogLevel(void);
@@ -49,6 +56,10 @@ void logFilter(const gchar *log_domain,
                const gchar *message,
                gpointer unused_data);
 
+/// Lines that couldn't be staged for the private log file because the
+/// background writer fell behind. Also reported in the log file itself.
+guint getDroppedLogLines();
+
 /// Set the process's name, used for settings & private log file names
 /// set the debug log level using the file /var/home/root/enable-<processname>-logging.
 // If the file is missing, use default non-debug log level
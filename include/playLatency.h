@@ -0,0 +1,35 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _PLAYLATENCY_H_
+#define _PLAYLATENCY_H_
+
+#include <glib.h>
+#include <pbnjson.hpp>
+
+/// "Request to sound" latency of system sounds & DTMF, per sink: from the
+/// luna request, through the defer to the Pulse thread, to the moment Pulse
+/// starts the sample or gets the first data of the stream.
+/// Times are monotonic, in us. Safe to use from any thread.
+
+/// traceSink: traceName() of the sink, got on the main thread
+void playLatencyRecord(const char * sink, guint16 traceSink,
+                       gint64 request, gint64 deferred, gint64 started);
+
+/// p50/p95/p99 & more of each stage, by sink
+void playLatencyToJson(pbnjson::JValue & reply, bool reset);
+
+#endif // _PLAYLATENCY_H_
@@ -0,0 +1,56 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _STARTUPPROFILE_H_
+#define _STARTUPPROFILE_H_
+
+#include <glib.h>
+#include <pbnjson.hpp>
+
+/// Startup timeline: phases timed with the monotonic clock, kept in a
+/// small in-memory ring & also traced with PMTRACE_BEFORE/AFTER when
+/// LTTng is enabled. Safe to use from any thread.
+
+/// Start a phase. Phases can be nested & may overlap.
+void startupPhaseBegin(const char * name);
+/// End the last phase started with that name
+void startupPhaseEnd(const char * name);
+/// Record an instant event, like a phase with no duration
+void startupMark(const char * name);
+
+/// Startup is over: phases started from now on aren't recorded,
+/// so that runtime events (e.g. Pulse reconnects) can't push the startup
+/// phases out of the ring. Running phases can still end.
+void startupProfileComplete();
+
+/// Add the recorded phases to a luna reply, times in ms since start
+void startupProfileToJson(pbnjson::JValue & reply);
+
+/// Times a phase for the duration of a scope
+class StartupPhase
+{
+public:
+    StartupPhase(const char * name) : mName(name) { startupPhaseBegin(name); }
+    ~StartupPhase() { startupPhaseEnd(mName); }
+
+private:
+    const char *    mName;
+
+    StartupPhase(const StartupPhase &);
+    StartupPhase & operator=(const StartupPhase &);
+};
+
+#endif // _STARTUPPROFILE_H_
@@ -23,17 +23,37 @@
 #include "AudioDevice.h"
 
 class LSMessageJsonParser;
+namespace pbnjson { class JValue; }
 
 typedef int (*InitFunction)(void);
 typedef int (*StartFunction)(GMainLoop *loop, LSHandle* handle);
 typedef void (*CancelSubscriptionCallback)(LSMessage * message, LSMessageJsonParser & msgParser);
 
+/// When an init or start hook runs in oneInitForAll
+enum EInitPriority
+{
+    eInitPriority_Critical = 0,   // on the path to first sound: first of its stage,
+                                  // but all init functions run before any start one
+    eInitPriority_Normal,         // in registration order, init, modules, controls, services
+    eInitPriority_Deferred        // from the main loop, once it is running
+};
+
 guint64 getCurrentTimeInMs ();
 
-void registerInitFunction (InitFunction function);
-void registerModuleFunction (StartFunction function);
-void registerControlFunction (StartFunction function);
-void registerServiceFunction (StartFunction function);
+/// Register hooks, optionally with a name, a priority
+/// & a comma separated list of the names of hooks that must run before
+void registerInitFunction (InitFunction function, const char * name = 0,
+                           EInitPriority priority = eInitPriority_Normal,
+                           const char * requirements = 0);
+void registerModuleFunction (StartFunction function, const char * name = 0,
+                             EInitPriority priority = eInitPriority_Normal,
+                             const char * requirements = 0);
+void registerControlFunction (StartFunction function, const char * name = 0,
+                              EInitPriority priority = eInitPriority_Normal,
+                              const char * requirements = 0);
+void registerServiceFunction (StartFunction function, const char * name = 0,
+                              EInitPriority priority = eInitPriority_Normal,
+                              const char * requirements = 0);
 void registerCancelSubscriptionCallback (CancelSubscriptionCallback function);
 void registerCancelSubscription(LSHandle *handle);
 void oneInitForAll(GMainLoop *loop, LSHandle *handle);
@@ -41,32 +61,69 @@ void oneFreeForAll();
 bool ServiceRegisterCategory(const char *category, LSMethod *methods,
         LSSignal *signal, void *category_user_data);
 
+/// When the luna request being handled was received, or now outside of one. Main thread only.
+gint64 lunaRequestStartTime();
+/// Count an error for the luna request being handled: its reply reports a failure
+void lunaRequestFailed();
+/// Calls, errors & latency histogram of each luna method called since the last reset
+void lunaMetricsToJson(pbnjson::JValue & reply, bool reset);
+
 #define INIT_FUNC(func)                                     \
 static void __attribute__ ((constructor))                   \
 ModuleInitializer##func(void)                               \
 {                                                           \
-    registerInitFunction(func);                             \
+    registerInitFunction(func, #func);                      \
 }
 
 #define MODULE_START_FUNC(func)                             \
 static void __attribute__ ((constructor))                   \
 ModuleInitializer##func(void)                               \
 {                                                           \
-    registerModuleFunction(func);                           \
+    registerModuleFunction(func, #func);                    \
 }
 
 #define CONTROL_START_FUNC(func)                            \
 static void __attribute__ ((constructor))                   \
 ModuleInitializer##func(void)                               \
 {                                                           \
-    registerControlFunction(func);                          \
+    registerControlFunction(func, #func);                   \
 }
 
 #define SERVICE_START_FUNC(func)                            \
 static void __attribute__ ((constructor))                   \
 ModuleInitializer##func(void)                               \
 {                                                           \
-    registerServiceFunction(func);                          \
+    registerServiceFunction(func, #func);                   \
+}
+
+/// Same as above, with a priority & the hooks required, ex:
+// MODULE_START_FUNC_DEPS (FooInit, eInitPriority_Deferred, "StateInit,MediaInterfaceInit")
+#define INIT_FUNC_DEPS(func, priority, requirements)                \
+static void __attribute__ ((constructor))                           \
+ModuleInitializer##func(void)                                       \
+{                                                                   \
+    registerInitFunction(func, #func, priority, requirements);      \
+}
+
+#define MODULE_START_FUNC_DEPS(func, priority, requirements)        \
+static void __attribute__ ((constructor))                           \
+ModuleInitializer##func(void)                                       \
+{                                                                   \
+    registerModuleFunction(func, #func, priority, requirements);    \
+}
+
+#define CONTROL_START_FUNC_DEPS(func, priority, requirements)       \
+static void __attribute__ ((constructor))                           \
+ModuleInitializer##func(void)                                       \
+{                                                                   \
+    registerControlFunction(func, #func, priority, requirements);   \
+}
+
+#define SERVICE_START_FUNC_DEPS(func, priority, requirements)       \
+static void __attribute__ ((constructor))                           \
+ModuleInitializer##func(void)                                       \
+{                                                                   \
+    registerServiceFunction(func, #func, priority, requirements);   \
 }
 
 #endif //_UTILS_H_
@@ -14,12 +14,14 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <string>
+
 #include "AudiodCallbacks.h"
 #include "genericScenarioModule.h"
 #include "scenario.h"
 #include "state.h"
-
-#include <algorithm>
+#include "stateTransition.h"
+#include "log.h"
 
 AudiodCallbacks gAudiodCallbacks;
 
@@ -33,17 +35,45 @@ void AudiodCallbacks::onAudioMixerConnected()
 
 void AudiodCallbacks::onSinkChanged(EVirtualSink sink, EControlEvent event,ESinkType sinkType)
 {
-    g_debug ("onSinkChanged: sink(%d) Control Event(%d) Sink Type %d", sink, event,(int)sinkType);
-    CallbackVector &    callbacks =  mSinkCallbackModules[sink];
+    if (!VERIFY(sink >= 0 && sink < eumiCount) ||
+        !VERIFY(sinkType >= 0 && sinkType < cSinkTypeCount))
+        return;
+
+    CallbackVector &    callbacks = mDispatch[sinkType][sink];
+    g_debug ("onSinkChanged: sink(%d) Control Event(%d) Sink Type %d: %u module(s)",
+                             sink, event, (int)sinkType, (unsigned) callbacks.size());
     for (CallbackVector::iterator iter = callbacks.begin();
           iter != callbacks.end(); ++iter)
     {
-         g_message ("Firing onSinkChanged for module: (%s)",
-                                            (*iter)->getCategory());
         (*iter)->onSinkChanged(sink, event, sinkType);
     }
 }
 
+void AudiodCallbacks::onActiveSinksChanged(const VirtualSinkSet & before,
+                                           const VirtualSinkSet & after,
+                                           ESinkType sinkType)
+{
+    g_debug ("onActiveSinksChanged: %#x -> %#x Sink Type %d",
+                             before.getMask(), after.getMask(), (int)sinkType);
+
+    // modules still see each sink, but the mixer is programmed once
+    StateTransition transition(eStateEvent_Sinks, before.getMask(), after.getMask());
+
+    // closings first, so that openings see the final set of sinks
+    for (int i = eVirtualSink_First; i <= eVirtualSink_Last; i++)
+    {
+        EVirtualSink sink = EVirtualSink(i);
+        if (before.contain(sink) && !after.contain(sink))
+            onSinkChanged(sink, eControlEvent_LastStreamClosed, sinkType);
+    }
+    for (int i = eVirtualSink_First; i <= eVirtualSink_Last; i++)
+    {
+        EVirtualSink sink = EVirtualSink(i);
+        if (!before.contain(sink) && after.contain(sink))
+            onSinkChanged(sink, eControlEvent_FirstStreamOpened, sinkType);
+    }
+}
+
 void AudiodCallbacks::onInputStreamActiveChanged(bool active)
 {
     gState.setActiveInputStream(active);
@@ -51,10 +81,11 @@ void AudiodCallbacks::onInputStreamActiveChanged(bool active)
 
 void AudiodCallbacks::registerModuleCallback (GenericScenarioModule * module,
                                               EVirtualSink sink,
-                                              bool notifyFirst)
+                                              bool notifyFirst,
+                                              int sinkTypes)
 {
-    g_debug("entering function %s : SINK = %d notifyFirst = %d ", __FUNCTION__, 
-                                                            sink, notifyFirst);
+    g_debug("entering function %s : SINK = %d notifyFirst = %d sinkTypes = %#x",
+                                       __FUNCTION__, sink, notifyFirst, sinkTypes);
     int first = sink;
     int last = sink;
 
@@ -68,30 +99,112 @@ void AudiodCallbacks::registerModuleCallback (GenericScenarioModule * module,
         first = eumiFirst;
         last = eumiLast;
     }
+    if (!VERIFY(first >= 0 && last < eumiCount))
+        return;
+
+    Registration registration;
+    registration.mModule = module;
+    registration.mSinkTypes = sinkTypes;
     for (int i = first ; i <= last ; i++)
+        registration.mSinks.set(i);
+
+    if (notifyFirst)
+        mRegistrations.insert(mRegistrations.begin(), registration);
+    else
+        mRegistrations.push_back(registration);
+
+    compile();
+}
+
+void AudiodCallbacks::unregisterModuleCallback (GenericScenarioModule * module)
+{
+    for (RegistrationVector::iterator iter = mRegistrations.begin();
+                                      iter != mRegistrations.end(); )
     {
-        if (notifyFirst)
-        {
-            mSinkCallbackModules[i].insert(mSinkCallbackModules[i].begin(), module);
-        }
+        if (iter->mModule == module)
+            iter = mRegistrations.erase(iter);
         else
-        {
-            mSinkCallbackModules[i].push_back(module);
-        }
+            ++iter;
     }
+
+    compile();
 }
 
-void AudiodCallbacks::unregisterModuleCallback (GenericScenarioModule * module)
+void AudiodCallbacks::compile()
 {
-    for (int i = eVirtualSink_First ; i <= eVirtualSink_Last ; i++)
+    for (int type = 0; type < cSinkTypeCount; ++type)
     {
-        CallbackVector &    callbacks =  mSinkCallbackModules[i];
-        // 'remove' moves the selected elements
-        // at the end and they need to be erased...
-        callbacks.erase(std::remove(callbacks.begin(),
-                                    callbacks.end(), module),
-                                    callbacks.end());
+        for (int sink = 0; sink < eumiCount; ++sink)
+        {
+            CallbackVector &    callbacks = mDispatch[type][sink];
+            callbacks.clear();
+            for (RegistrationVector::const_iterator iter = mRegistrations.begin();
+                                              iter != mRegistrations.end(); ++iter)
+            {
+                if ((iter->mSinkTypes & (1 << type)) && iter->mSinks.test(sink))
+                    callbacks.push_back(iter->mModule);
+            }
+        }
     }
 }
 
+/// Module logging its id for each sink event it is sent, for the unit test
+class RecordingScenarioModule : public GenericScenarioModule
+{
+public:
+    RecordingScenarioModule(std::string & log, char id) :
+        GenericScenarioModule(ConstString("unittest")), mLog(log), mId(id) {}
+
+    void onSinkChanged(EVirtualSink sink, EControlEvent event, ESinkType sinkType)
+        { mLog += mId; }
 
+protected:
+    void _updateHardwareSettings(bool muteMediaSink) {}
+
+private:
+    std::string &   mLog;
+    char            mId;
+};
+
+bool AudiodCallbacks::UnitTest()
+{
+    int failures = unitTestFailureCount();
+
+    std::string log;
+    RecordingScenarioModule a(log, 'a'), b(log, 'b'), c(log, 'c'), d(log, 'd');
+    AudiodCallbacks callbacks;
+    callbacks.registerModuleCallback(&a, emedia);
+    callbacks.registerModuleCallback(&b, eVirtualSink_All, true);
+    callbacks.registerModuleCallback(&c, eumiAll, false, eSinkTypeMask_Umi);
+    callbacks.registerModuleCallback(&d, enotifications, false, eSinkTypeMask_All);
+
+    // notifyFirst modules first, then in registration order
+    callbacks.onSinkChanged(emedia, eControlEvent_FirstStreamOpened, ePulseAudio);
+    UT_CHECK(log == "ba");
+    log.clear();
+    callbacks.onSinkChanged(enotifications, eControlEvent_LastStreamClosed, ePulseAudio);
+    UT_CHECK(log == "bd");
+
+    // only to the modules registered for that sink type
+    log.clear();
+    callbacks.onSinkChanged(enotifications, eControlEvent_FirstStreamOpened, eUmi);
+    UT_CHECK(log == "d");
+    log.clear();
+    callbacks.onSinkChanged(EVirtualSink(eumiFirst), eControlEvent_FirstStreamOpened, eUmi);
+    UT_CHECK(log == "c");
+    log.clear();
+    callbacks.onSinkChanged(EVirtualSink(eumiFirst), eControlEvent_FirstStreamOpened,
+                            ePulseAudio);
+    UT_CHECK(log.empty());
+
+    // unregistering recompiles the table
+    callbacks.unregisterModuleCallback(&b);
+    UT_CHECK(callbacks.mDispatch[ePulseAudio][emedia].size() == 1 &&
+             callbacks.mDispatch[ePulseAudio][emedia][0] == &a);
+    log.clear();
+    callbacks.onSinkChanged(emedia, eControlEvent_LastStreamClosed, ePulseAudio);
+    callbacks.onSinkChanged(enotifications, eControlEvent_LastStreamClosed, ePulseAudio);
+    UT_CHECK(log == "ad");
+
+    return unitTestFailureCount() == failures;
+}
@@ -17,6 +17,7 @@
 #ifndef AUDIODCALLBACKS_H_
 #define AUDIODCALLBACKS_H_
 
+#include <bitset>
 #include <vector>
 
 #include "AudioMixer.h"
@@ -24,25 +25,58 @@
 
 class ScenarioModule;
 
+/// Sink types a module wants onSinkChanged() for, one bit per ESinkType
+enum ESinkTypeMask
+{
+    eSinkTypeMask_PulseAudio = 1 << ePulseAudio,
+    eSinkTypeMask_Umi = 1 << eUmi,
+    eSinkTypeMask_All = eSinkTypeMask_PulseAudio | eSinkTypeMask_Umi
+};
+
 class AudiodCallbacks : public AudiodCallbacksInterface
 {
 public:
     /// Methods called by HW/SW implementation layers
     virtual void        onAudioMixerConnected();
     virtual void        onSinkChanged(EVirtualSink sink, EControlEvent event,ESinkType sinkType);
+    virtual void        onActiveSinksChanged(const VirtualSinkSet & before,
+                                             const VirtualSinkSet & after,
+                                             ESinkType sinkType);
     virtual void        onInputStreamActiveChanged(bool active);
 
     // Modules can register to be notified via onSinkChanged()
-    // that a sink was opened or closed.
+    // that a sink was opened or closed. Only events of the given sink types
+    // are delivered. notifyFirst modules are called before the others.
     void                registerModuleCallback(GenericScenarioModule * module,
                                                EVirtualSink sink,
-                                                bool notifyFirst = false);
+                                               bool notifyFirst = false,
+                                               int sinkTypes = eSinkTypeMask_PulseAudio);
     void                unregisterModuleCallback(GenericScenarioModule * module);
 
+    /// Built-in unit test of the dispatch table: Returns true on success.
+    static bool         UnitTest();
+
 private:
     typedef std::vector<GenericScenarioModule *> CallbackVector;
+    typedef std::bitset<eumiCount> SinkInterest;
+
+    struct Registration
+    {
+        GenericScenarioModule * mModule;
+        SinkInterest            mSinks;
+        int                     mSinkTypes;
+    };
+    typedef std::vector<Registration> RegistrationVector;
+
+    /// Rebuild the dispatch table from the registrations
+    void                compile();
+
+    static const int    cSinkTypeCount = eUmi + 1;
 
-    CallbackVector        mSinkCallbackModules[eumiCount];
+    RegistrationVector    mRegistrations;    // in notification order
+    /// Modules to call, by sink type & sink. Registrations are rare,
+    /// sink events are not: the table is only rebuilt on (un)registration.
+    CallbackVector        mDispatch[cSinkTypeCount][eumiCount];
 };
 
 
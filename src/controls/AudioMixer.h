@@ -97,6 +97,13 @@ public:
                                    mask(sink5))) != 0; }
 
 
+    /// does the set contain any sink of that other set?
+    bool    containAnyOf(const VirtualSinkSet & sinks) const
+                { return (mSet & sinks.mSet) != 0; }
+
+    /// one bit per sink, for logs & traces
+    int     getMask() const            { return mSet; }
+
     bool    operator==(const VirtualSinkSet & rhs) const { return mSet == rhs.mSet; }
     bool    operator!=(const VirtualSinkSet & rhs) const { return mSet != rhs.mSet; }
 
@@ -118,6 +125,14 @@ inline bool isNeverMutedSink(EVirtualSink sink)
     return sink == eDTMF || sink == efeedback || sink == eeffects || sink == ecallertone;
 }
 
+/// Shape of a volume ramp, between two volumes in percent
+enum ERampCurve
+{
+    eRampCurve_Linear,      // even steps in percent
+    eRampCurve_dBLinear,    // even steps in dB, as mapped by Pulse's volume tables
+    eRampCurve_SCurve       // dB-linear, easing in & out
+};
+
 enum EControlEvent
 {
     eControlEvent_None                    = 0,
@@ -137,6 +152,8 @@ enum ESinkType
     eUmi
 };
 
+class GenericScenario;
+
 /// Interface to notify audiod that AudioMixier events happened
 class AudiodCallbacksInterface
 {
@@ -148,6 +165,12 @@ public:
     /// An audio sink was opened or closed: adjust volumes as necessary
     virtual void        onSinkChanged(EVirtualSink sink, EControlEvent event,ESinkType p_eSinkType) = 0;
 
+    /// A burst of sink openings & closings: the active sinks went from
+    /// before to after. Sinks opened & closed within the burst aren't reported.
+    virtual void        onActiveSinksChanged(const VirtualSinkSet & before,
+                                             const VirtualSinkSet & after,
+                                             ESinkType p_eSinkType) = 0;
+
     /// Notification that a first input stream was opened,
     // or that the last input stream was closed
     virtual void        onInputStreamActiveChanged(bool active) = 0;
@@ -198,12 +221,23 @@ public:
     /// Same as program volume, but ramped.
     virtual bool            rampVolume(EVirtualSink sink, int endVolume) = 0;
 
+    /// Ramp the volume of a sink over duration ms, following a curve.
+    /// A ramp in flight is retargeted from where it is. Programming another
+    /// volume for the sink cancels its ramp.
+    virtual bool            rampVolume(EVirtualSink sink, int endVolume,
+                                       int duration, ERampCurve curve) = 0;
+    virtual void            cancelRamp(EVirtualSink sink) = 0;
+
     /// Program destination of a sink
     virtual bool            programDestination(EVirtualSink sink,
                                                EPhysicalSink destination) = 0;
     /// Program destination of a source
     virtual bool            programDestination(EVirtualSource source,
                                                EPhysicalSource destination) = 0;
+    /// Program destinations of all sinks & sources at once, only sending
+    /// what changed. Negative destinations are left as they are.
+    virtual bool            programDestinations(const int * sinkDestinations,
+                                                const int * sourceDestinations) = 0;
 
     /// Program a filter
     virtual bool            programFilter(int filterTable) = 0;
@@ -262,7 +296,7 @@ public:
     virtual void setNREC(bool value) = 0;
     virtual bool programLoadBluetooth (const char *address, const char *profile) = 0;
     virtual bool programUnloadBluetooth (const char *profile) = 0;
-    virtual bool setRouting(const ConstString & scenario) = 0;
+    virtual bool setRouting(const GenericScenario & scenario) = 0;
     virtual bool phoneEvent(EPhoneEvent event, int parameter) = 0;
     virtual bool programCallVoiceOrMICVolume (char cmd, int volume) = 0;
     virtual bool getBTVolumeSupport() = 0;
@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <audiodTracer.h>
 #include "main.h"
+#include "soundCatalog.h"
 
 //to simulate ringtone change the macro to 1
 #define TEST_RINGTONE_VIA_AUDIOD 0
@@ -51,8 +52,7 @@ _playAlert(LSHandle *lshandle, LSMessage *message, void *ctx)
         return true;
 
     const gchar * answer = STANDARD_JSON_SUCCESS;
-    char *filename = NULL;
-    FILE *fp = NULL;
+    std::string name;
     int sound;
     if (!msg.get("index", sound))
         sound = 0;
@@ -60,25 +60,14 @@ _playAlert(LSHandle *lshandle, LSMessage *message, void *ctx)
         answer = INVALID_PARAMETER_ERROR(index, integer);
         goto Error;
     }
-    filename = (char *)malloc( strlen(SYSTEMSOUNDS_PATH)+
-                                            strlen ("alert_")+
-                                            sizeof (sound) +
-                                            strlen("-ondemand.pcm")+ 1);
-    sprintf(filename, SYSTEMSOUNDS_PATH "/alert_%i-ondemand.pcm",sound);
-    g_message ("complete file name to playback = %s\n", filename);
-
-    fp = fopen(filename, "r");
-    free(filename);
-    filename= NULL;
-    if (!fp)
+    name = string_printf("alert_%i", sound);
+    if (!gSoundCatalog.find(name.c_str()))
     {
-        g_message ("%s : index not found reason %s",__FUNCTION__,strerror(errno));
+        g_message ("%s : index %i not found", __FUNCTION__, sound);
         answer = INVALID_PARAMETER_ERROR(index, integer);
     }
     else
     {
-        fclose (fp);
-        fp = NULL;
         /*Add Ref message callback will unref message when generateAlertSound
         is done*/
         LSMessageRef(message);
@@ -87,8 +76,7 @@ _playAlert(LSHandle *lshandle, LSMessage *message, void *ctx)
         without the pixie changes, hence gAudioMixer is used to invoke playback
         through software APIs
         */
-        gAudioMixer.playSystemSound (string_printf("alert_%i", sound).c_str(),
-                                     eeffects);
+        gAudioMixer.playSystemSound (name.c_str(), eeffects);
 
     }
 
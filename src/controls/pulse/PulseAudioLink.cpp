@@ -18,6 +18,10 @@
 #include "PulseAudioLink.h"
 #include "AudioDevice.h"
 #include "utils.h"
+#include "startupProfile.h"
+#include "soundCatalog.h"
+#include "controlTrace.h"
+#include "playLatency.h"
 #include <math.h>
 #include <unistd.h>
 #include <audiodTracer.h>
@@ -36,7 +40,42 @@ struct ssound_t {
 
 static void initializeDtmf();
 
-PulseAudioLink::PulseAudioLink() : mContext(0), mMainLoop(0), mPulseAudioReady(false)
+/// Warm streams: small buffers, as they only play generated audio
+static const pa_sample_spec cWarmSampleSpec = { PA_SAMPLE_S16LE, 44100, 1 };
+static const pa_usec_t cWarmStreamLatency = 20 * PA_USEC_PER_MSEC;
+
+enum EWarmStreamState
+{
+    eWarmStream_Connecting,
+    eWarmStream_Idle,           // connected & corked
+    eWarmStream_Busy,           // playing a data provider
+    eWarmStream_Failed
+};
+
+/// Backoff before replacing a failed warm stream, in ms
+static const int cMinWarmRetryDelay = 100;
+static const int cMaxWarmRetryDelay = 10000;
+
+struct PulseWarmStream
+{
+    PulseAudioLink *            mLink;
+    const char *                mSinkName;
+    pa_stream *                 mStream;        // NULL until (re)connected
+    EWarmStreamState            mState;
+    PulseAudioDataProvider *    mProvider;
+    int                         mRetryDelay;
+    pa_time_event *             mRetry;         // replacement scheduled
+};
+
+/// Backoff between libpulse connection attempts, in ms
+static const int cMinRetryDelay = 50;
+static const int cMaxRetryDelay = 5000;
+
+PulseAudioLink::PulseAudioLink() : mContext(0), mMainLoop(0), mPulseAudioReady(FALSE),
+                                   mThreadRunning(false), mQuitThread(FALSE),
+                                   mConnectionId(0),
+                                   mConnecting(FALSE),
+                                   mRetryDelay(cMinRetryDelay), mNextAttempt(0)
 {
     initializeDtmf();
 }
@@ -46,14 +85,21 @@ void PulseAudioLink::pulseAudioStateChanged(pa_context_state_t state)
     switch (state)
     {
     case PA_CONTEXT_FAILED:
-        mPulseAudioReady = false;
+        g_atomic_int_set(&mPulseAudioReady, FALSE);
+        g_atomic_int_set(&mConnecting, FALSE);
         pa_mainloop_get_api(mMainLoop)->quit(pa_mainloop_get_api(mMainLoop), -1);
         break;
     case PA_CONTEXT_READY:
-        mPulseAudioReady = true;
+        g_message("Connected to Pulse for system sounds");
+        createWarmStreams();
+        startupMark("pulse context ready");
+        g_atomic_int_set(&mRetryDelay, cMinRetryDelay);
+        g_atomic_int_set(&mConnecting, FALSE);
+        g_atomic_int_set(&mPulseAudioReady, TRUE);
         break;
     case PA_CONTEXT_TERMINATED:
-        mPulseAudioReady = false;
+        g_atomic_int_set(&mPulseAudioReady, FALSE);
+        g_atomic_int_set(&mConnecting, FALSE);
     default:
         break;
     }
@@ -61,28 +107,24 @@ void PulseAudioLink::pulseAudioStateChanged(pa_context_state_t state)
 
 void PulseAudioLink::killPulseConnection()
 {
+    if (mThreadRunning)
+    {
+        // pa_mainloop_quit isn't thread safe, pa_mainloop_wakeup is
+        g_atomic_int_set(&mQuitThread, TRUE);
+        pa_mainloop_wakeup(mMainLoop);
+        pthread_join(mThread, NULL);
+        mThreadRunning = false;
+    }
+    releaseWarmStreams();
     if (mContext)
         pa_context_unref(mContext);
     if (mMainLoop)
         pa_mainloop_free(mMainLoop);
     mMainLoop = 0;
     mContext = 0;
-    mPulseAudioReady = false;
-    mLoadedSounds.clear();
-}
-
-bool PulseAudioLink::iteratePulse(int block)
-{
-    int processed, ret;
-
-    while ((processed = pa_mainloop_iterate(mMainLoop, block, &ret)) > 0)
-        ;
-    if (processed < 0 && ret < 0)
-    {
-        killPulseConnection();
-        return false;
-    }
-    return true;
+    g_atomic_int_set(&mPulseAudioReady, FALSE);
+    g_atomic_int_set(&mConnecting, FALSE);
+    gSoundCatalog.clearPreloaded();
 }
 
 static void pulseAudioCallback(pa_context * c, void * user)
@@ -112,11 +154,24 @@ struct PlaySampleDeferData {
     char samplename[kSampleNameMaxSize];
     const char* sink;
     pa_context* pacontext;
+    guint16 traceSink;
+    gint64 requestTime;
+    gint64 deferredTime;
 };
 
+static void PlaySampleDoneCB(pa_context * c, int success, void * userdata)
+{
+    PlaySampleDeferData* data  = (PlaySampleDeferData*)userdata;
+    if (success)
+        playLatencyRecord(data->sink, data->traceSink, data->requestTime,
+                          data->deferredTime, g_get_monotonic_time());
+    free(data);
+}
+
 static void PlaySampleDeferCB(pa_mainloop_api *a, pa_defer_event *e, void *userdata)
 {
     PlaySampleDeferData* data  = (PlaySampleDeferData*)userdata;
+    data->deferredTime = g_get_monotonic_time();
 
     // prepare HW for playing audio. Will unmute Pixie in particular...
     gAudioDevice.prepareForPlayback();
@@ -135,12 +190,11 @@ static void PlaySampleDeferCB(pa_mainloop_api *a, pa_defer_event *e, void *userd
                                                data->samplename,
                                                data->sink,
                                                PA_VOLUME_NORM,
-                                               NULL, NULL);
+                                               PlaySampleDoneCB, data);
     if (op)
-    {
         pa_operation_unref(op);
-    }
-    free(data);
+    else
+        free(data);
     a->defer_free(e);
 }
 
@@ -158,6 +212,9 @@ bool PulseAudioLink::play(const char * samplename, const char * sink)
     strncpy(data->samplename, samplename, sizeof(data->samplename)-1);
     data->sink = sink;
     data->pacontext = mContext;
+    data->traceSink = traceName(sink);
+    data->requestTime = lunaRequestStartTime();
+    data->deferredTime = 0;
     pa_mainloop_get_api(mMainLoop)->defer_new(pa_mainloop_get_api(mMainLoop),
                                               &PlaySampleDeferCB, data);
     return true;
@@ -168,6 +225,10 @@ PulseAudioDataProvider::PulseAudioDataProvider()
 ,mVolume(PA_VOLUME_NORM)
 ,mStreamName("AudiodStream")
 ,mAudioEffect(0)
+,mProbeSink(0)
+,mProbeTraceSink(0)
+,mRequestTime(0)
+,mDeferredTime(0)
 {
     mSampleSpec.format = PA_SAMPLE_S16LE;
     mSampleSpec.rate = 44100;
@@ -178,6 +239,23 @@ PulseAudioDataProvider::~PulseAudioDataProvider()
 {
 }
 
+void PulseAudioDataProvider::probePlay(const char * sink)
+{
+    mProbeSink = sink;
+    mProbeTraceSink = traceName(sink);
+    mRequestTime = lunaRequestStartTime();
+    mDeferredTime = 0;
+}
+
+void PulseAudioDataProvider::probeStarted()
+{
+    if (mRequestTime == 0)
+        return;
+    playLatencyRecord(mProbeSink, mProbeTraceSink, mRequestTime, mDeferredTime,
+                                                         g_get_monotonic_time());
+    mRequestTime = 0;
+}
+
 void PulseAudioLink::stream_drain_complete(pa_stream*stream,
                                              int success,
                                              void *userdata)
@@ -204,6 +282,7 @@ void PulseAudioLink::data_stream_write_callback(pa_stream *s,
     PulseAudioDataProvider* data = (PulseAudioDataProvider*) userdata;
     int status = data->getStatus();
     if (status<=AUDIO_STATUS_STOPPING) {
+        data->probeStarted();
         if (!data->stream_write_callback(s, length)) {
             data->setStatus(AUDIO_STATUS_STOPPED);
             pa_operation_unref(pa_stream_drain(s, stream_drain_complete, data));
@@ -216,8 +295,217 @@ struct PlayAudioDataProviderDeferData {
     PulseAudioDataProvider* dataProvider;
     const char* sinkname;
     pa_context* pacontext;
+    PulseAudioLink* link;
 };
 
+static void warm_stream_state_cb(pa_stream * s, void * userdata)
+{
+    PulseWarmStream * warm = (PulseWarmStream *) userdata;
+
+    switch (pa_stream_get_state(s))
+    {
+    case PA_STREAM_READY:
+        if (warm->mState == eWarmStream_Connecting)
+            warm->mState = eWarmStream_Idle;
+        warm->mRetryDelay = cMinWarmRetryDelay;
+        break;
+    case PA_STREAM_FAILED:
+    case PA_STREAM_TERMINATED:
+        g_warning("warm stream in '%s' lost: %s", warm->mSinkName,
+                  pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+        warm->mState = eWarmStream_Failed;
+        if (warm->mProvider) {
+            PulseAudioDataProvider * data = warm->mProvider;
+            warm->mProvider = NULL;
+            data->disconnected();
+        }
+        // don't fall back to cold streams for good: replace it, later
+        warm->mLink->scheduleWarmStream(warm);
+        break;
+    default:
+        break;
+    }
+}
+
+static void warm_stream_drain_cb(pa_stream * s, int success, void * userdata)
+{
+    PulseWarmStream * warm = (PulseWarmStream *) userdata;
+
+    // back in the pool, ready for the next sound
+    pa_operation * op = pa_stream_cork(s, 1, NULL, NULL);
+    if (op)
+        pa_operation_unref(op);
+    if (warm->mState == eWarmStream_Busy)
+        warm->mState = eWarmStream_Idle;
+
+    PulseAudioDataProvider * data = warm->mProvider;
+    warm->mProvider = NULL;
+    if (data)
+        data->disconnected();
+}
+
+static void warm_stream_write_cb(pa_stream * s, size_t length, void * userdata)
+{
+    PMTRACE_FUNCTION;
+    PulseWarmStream * warm = (PulseWarmStream *) userdata;
+    PulseAudioDataProvider * data = warm->mProvider;
+    if (!data)
+        return;
+
+    data->probeStarted();
+    if (data->getStatus() > AUDIO_STATUS_STOPPING || !data->stream_write_callback(s, length)) {
+        data->setStatus(AUDIO_STATUS_STOPPED);
+        pa_stream_set_write_callback(s, NULL, NULL);
+        pa_operation * op = pa_stream_drain(s, warm_stream_drain_cb, warm);
+        if (op)
+            pa_operation_unref(op);
+        else
+            warm_stream_drain_cb(s, 0, warm);
+    }
+}
+
+static void warm_stream_retry_cb(pa_mainloop_api * api, pa_time_event * e,
+                                 const struct timeval * tv, void * userdata)
+{
+    PulseWarmStream * warm = (PulseWarmStream *) userdata;
+    api->time_free(e);
+    warm->mRetry = NULL;
+    warm->mLink->connectWarmStream(warm);
+}
+
+void PulseAudioLink::createWarmStreams()
+{
+    for (EVirtualSink sink = eVirtualSink_First;
+         sink <= eVirtualSink_Last;
+         sink = EVirtualSink(sink + 1))
+    {
+        if (!isNeverMutedSink(sink))    // the low latency sinks
+            continue;
+
+        PulseWarmStream * warm = new PulseWarmStream();
+        warm->mLink = this;
+        warm->mSinkName = virtualSinkName(sink, false);
+        warm->mStream = NULL;
+        warm->mState = eWarmStream_Failed;
+        warm->mProvider = NULL;
+        warm->mRetryDelay = cMinWarmRetryDelay;
+        warm->mRetry = NULL;
+        mWarmStreams.push_back(warm);
+        connectWarmStream(warm);
+    }
+}
+
+void PulseAudioLink::connectWarmStream(PulseWarmStream * warm)
+{
+    if (warm->mStream) {
+        // a failed stream can't be reconnected: drop it for a new one
+        pa_stream_set_state_callback(warm->mStream, NULL, NULL);
+        pa_stream_set_write_callback(warm->mStream, NULL, NULL);
+        pa_stream_unref(warm->mStream);
+        warm->mStream = NULL;
+    }
+
+    if (pa_context_get_state(mContext) != PA_CONTEXT_READY) {
+        scheduleWarmStream(warm);
+        return;
+    }
+
+    pa_buffer_attr attr;
+    attr.maxlength = (uint32_t) -1;
+    attr.tlength = pa_usec_to_bytes(cWarmStreamLatency, &cWarmSampleSpec);
+    attr.prebuf = pa_usec_to_bytes(cWarmStreamLatency / 4, &cWarmSampleSpec);
+    attr.minreq = attr.prebuf;
+    attr.fragsize = (uint32_t) -1;
+
+    warm->mState = eWarmStream_Connecting;
+    warm->mStream = pa_stream_new(mContext, "AudiodWarmStream", &cWarmSampleSpec, NULL);
+    if (!VERIFY(warm->mStream)) {
+        warm->mState = eWarmStream_Failed;
+        scheduleWarmStream(warm);
+        return;
+    }
+    pa_stream_set_state_callback(warm->mStream, warm_stream_state_cb, warm);
+    if (pa_stream_connect_playback(warm->mStream, warm->mSinkName, &attr,
+                                   (pa_stream_flags_t) (PA_STREAM_START_CORKED |
+                                                        PA_STREAM_ADJUST_LATENCY),
+                                   NULL, NULL) < 0) {
+        g_warning("%s: can't connect a warm stream to '%s'", __FUNCTION__,
+                                                           warm->mSinkName);
+        warm->mState = eWarmStream_Failed;
+        scheduleWarmStream(warm);
+    }
+}
+
+void PulseAudioLink::scheduleWarmStream(PulseWarmStream * warm)
+{
+    if (warm->mRetry)
+        return;
+
+    int delay = nextBackoffDelay(warm->mRetryDelay, cMaxWarmRetryDelay);
+    struct timeval tv;
+    pa_timeval_add(pa_gettimeofday(&tv), (pa_usec_t) delay * PA_USEC_PER_MSEC);
+    pa_mainloop_api * api = pa_mainloop_get_api(mMainLoop);
+    warm->mRetry = api->time_new(api, &tv, warm_stream_retry_cb, warm);
+}
+
+void PulseAudioLink::releaseWarmStreams()
+{
+    for (size_t i = 0; i < mWarmStreams.size(); ++i) {
+        PulseWarmStream * warm = mWarmStreams[i];
+        if (warm->mRetry) {
+            pa_mainloop_api * api = pa_mainloop_get_api(mMainLoop);
+            api->time_free(warm->mRetry);
+        }
+        if (warm->mStream) {
+            pa_stream_set_state_callback(warm->mStream, NULL, NULL);
+            pa_stream_set_write_callback(warm->mStream, NULL, NULL);
+            if (PA_STREAM_IS_GOOD(pa_stream_get_state(warm->mStream)))
+                pa_stream_disconnect(warm->mStream);
+            pa_stream_unref(warm->mStream);
+        }
+        if (warm->mProvider)
+            warm->mProvider->disconnected();
+        delete warm;
+    }
+    mWarmStreams.clear();
+}
+
+bool PulseAudioLink::playWarm(PulseAudioDataProvider* data, const char* sinkname)
+{
+    PMTRACE_FUNCTION;
+    if (!pa_sample_spec_equal(data->getSampleSpec(), &cWarmSampleSpec))
+        return false;
+
+    for (size_t i = 0; i < mWarmStreams.size(); ++i) {
+        PulseWarmStream * warm = mWarmStreams[i];
+        if (warm->mState != eWarmStream_Idle || strcmp(warm->mSinkName, sinkname) != 0)
+            continue;
+
+        warm->mState = eWarmStream_Busy;
+        warm->mProvider = data;
+
+        pa_cvolume cv;
+        pa_cvolume_set(&cv, cWarmSampleSpec.channels, data->getVolume());
+        pa_operation * op = pa_context_set_sink_input_volume(pa_stream_get_context(warm->mStream),
+                                                      pa_stream_get_index(warm->mStream),
+                                                      &cv, NULL, NULL);
+        if (op)
+            pa_operation_unref(op);
+
+        // start playing & fill the buffer right away
+        pa_stream_set_write_callback(warm->mStream, warm_stream_write_cb, warm);
+        op = pa_stream_cork(warm->mStream, 0, NULL, NULL);
+        if (op)
+            pa_operation_unref(op);
+        size_t writable = pa_stream_writable_size(warm->mStream);
+        if (writable > 0 && writable != (size_t) -1)
+            warm_stream_write_cb(warm->mStream, writable, warm);
+        return true;
+    }
+
+    return false;
+}
+
 void PulseAudioLink::PlayAudioDataProviderDeferCB(pa_mainloop_api *a,
                                                   pa_defer_event *e,
                                                    void *userdata)
@@ -225,6 +513,13 @@ void PulseAudioLink::PlayAudioDataProviderDeferCB(pa_mainloop_api *a,
     PMTRACE_FUNCTION;
     struct PlayAudioDataProviderDeferData* datacb =
                               (struct PlayAudioDataProviderDeferData*)userdata;
+    datacb->dataProvider->probeDeferred();
+    if (datacb->link->playWarm(datacb->dataProvider, datacb->sinkname)) {
+        free(datacb);
+        a->defer_free(e);
+        return;
+    }
+
     pa_stream* stream = pa_stream_new(datacb->pacontext,
                                       datacb->dataProvider->getStreamName(),
                                       datacb->dataProvider->getSampleSpec(),
@@ -259,12 +554,14 @@ bool PulseAudioLink::play(PulseAudioDataProvider* data, const char* sinkname)
         return false;
 
     data->ref();
+    data->probePlay(sinkname);
     struct PlayAudioDataProviderDeferData* dataCB =
                            (struct PlayAudioDataProviderDeferData*)malloc
                                (sizeof(struct PlayAudioDataProviderDeferData));
     dataCB->dataProvider = data;
     dataCB->sinkname = sinkname;
     dataCB->pacontext = mContext;
+    dataCB->link = this;
     pa_mainloop_get_api(mMainLoop)->defer_new(pa_mainloop_get_api(mMainLoop),
                         &PlayAudioDataProviderDeferCB,
                         dataCB);
@@ -275,7 +572,19 @@ bool PulseAudioLink::play(PulseAudioDataProvider* data, const char* sinkname)
 bool PulseAudioLink::connectToPulse()
 {
     PMTRACE_FUNCTION;
+    // still connecting, or too soon after a failed attempt
+    guint64 now = getCurrentTimeInMs();
+    if (g_atomic_int_get(&mConnecting) || now < mNextAttempt)
+        return false;
+
+    StartupPhase    phase("PulseAudioLink::connectToPulse");
     killPulseConnection();
+    // the Pulse thread is gone: nothing else touches the delay until the next one runs
+    int retryDelay = g_atomic_int_get(&mRetryDelay);
+    mNextAttempt = now + nextBackoffDelay(retryDelay, cMaxRetryDelay);
+    g_atomic_int_set(&mRetryDelay, retryDelay);
+    ++mConnectionId;
+
     mMainLoop = pa_mainloop_new();
     mContext = pa_context_new(pa_mainloop_get_api(mMainLoop), "AudioD");
     pa_context_set_state_callback(mContext, pulseAudioCallback, (void*) this);
@@ -284,21 +593,31 @@ bool PulseAudioLink::connectToPulse()
         killPulseConnection();
         return false;
     }
-    ///iterate until we receive mod->paReady, or an error connecting
-    while (iteratePulse(0))
+
+    // the context becomes ready in the Pulse thread, see pulseAudioStateChanged()
+    g_atomic_int_set(&mConnecting, TRUE);
+    g_atomic_int_set(&mQuitThread, FALSE);
+    if (pthread_create(&mThread, NULL, &pathread_func, this) != 0)
     {
-        if (mPulseAudioReady)
-        {
-            g_message("Connected to Pulse for system sounds");
-            if (pthread_create(&mThread, NULL, &pathread_func, this)==0) {
-                pthread_detach(mThread);
-                return true;
-            } else {
-                mPulseAudioReady = false;
-            }
-        }
+        g_warning("%s: can't create the Pulse thread", __FUNCTION__);
+        killPulseConnection();
+        return false;
     }
-    return false;
+    mThreadRunning = true;
+
+    return isConnected();
+}
+
+void PulseAudioLink::reconnect()
+{
+    if (isConnected())
+        return;
+
+    if (g_atomic_int_get(&mConnecting))
+        killPulseConnection();    // probably still trying the previous server
+    g_atomic_int_set(&mRetryDelay, cMinRetryDelay);
+    mNextAttempt = 0;
+    connectToPulse();
 }
 
 class PreloadDeferCBData : public RefObj {
@@ -409,26 +728,22 @@ void PulseAudioLink::preload(const char * samplename)
 {
     // is the sound file loaded?
     PMTRACE_FUNCTION;
-    if (strlen(samplename) >= kSampleNameMaxSize ||
-                              mLoadedSounds.find(samplename) != mLoadedSounds.end())
+    if (strlen(samplename) >= kSampleNameMaxSize || gSoundCatalog.isPreloaded(samplename))
         return;
 
-    std::string path = SYSTEMSOUNDS_PATH;
-    path += samplename;
-    path += "-ondemand.pcm";
-    struct stat fileStat;
-    if (stat(path.c_str(), &fileStat) == 0)
+    size_t length;
+    if (gSoundCatalog.find(samplename, &length))
     {
-        // can we talk to Pulse to load it?
-        if (!VERIFY(checkConnection()))
+        // can we talk to Pulse to load it? If not yet, try again next time
+        if (!checkConnection())
             return;
 
-        FILE* f = fopen(path.c_str(), "r");
+        FILE* f = fopen(gSoundCatalog.path(samplename).c_str(), "r");
         if (VERIFY(f)) {
             PreloadDeferCBData* data = new PreloadDeferCBData();
             data->snd.file = f;
             strcpy(data->snd.samplename, samplename);
-            data->snd.length = fileStat.st_size;
+            data->snd.length = length;
             data->snd.tot_written = 0;
             data->snd.spec.format = PA_SAMPLE_S16LE;
             data->snd.spec.rate = 44100;
@@ -461,15 +776,19 @@ void PulseAudioLink::preload(const char * samplename)
 
     }
 
-    // success or failure, no need to try again
-    mLoadedSounds.insert(samplename);
+    // success or failure, no need to try again until the file or Pulse change
+    gSoundCatalog.setPreloaded(samplename, true);
 }
 
 void* PulseAudioLink::pathread_func(void* p) {
     PulseAudioLink* link = (PulseAudioLink*)p;
-    int ret;
-    if (pa_mainloop_run(link->mMainLoop, &ret) < 0) {
-        g_warning("pa_mainloop_run() failed");
+    int ret = 0;
+    // like pa_mainloop_run, but killPulseConnection can stop it from the main thread
+    while (!g_atomic_int_get(&link->mQuitThread)) {
+        if (pa_mainloop_iterate(link->mMainLoop, 1, &ret) < 0) {
+            g_warning("pa_mainloop_iterate() failed");
+            break;
+        }
     }
     g_debug("pathread_func() exit %d", ret);
     return (void*)ret;
@@ -547,134 +866,145 @@ static void initializeDtmf() {
 
 }
 
-PulseDtmfGenerator::PulseDtmfGenerator(Dtmf tone, int milliseconds)
-:PulseAudioDataProvider(),mDtmf(tone),mWritePos(0)
-,mAccumulatedSamples(0),mPlaySamples(0)
+static int dtmfFromChar(char c) {
+    if ('0'<=c && c<='9') return Dtmf_0 + (c - '0');
+    if (c=='*') return Dtmf_Asterisk;
+    if (c=='#') return Dtmf_Pound;
+    return -1;
+}
+
+/// Most tones queued ahead: beyond, requests are dropped rather than delayed
+static const size_t cMaxQueuedDtmf = 32;
+
+PulseDtmfSequence::PulseDtmfSequence(int toneMs, int gapMs, int lingerMs)
+:PulseAudioDataProvider(),mIndex(0),mPos(0)
+,mToneSamples(DTMF_SAMPLE_RATE / 1000 * toneMs)
+,mGapSamples(DTMF_SAMPLE_RATE / 1000 * gapMs)
+,mLingerSamples(DTMF_SAMPLE_RATE / 1000 * lingerMs)
+,mIdleSamples(0),mToneEnd(mToneSamples),mHold(false),mHolding(false)
 {
-    if (milliseconds>0) mPlaySamples = DTMF_SAMPLE_RATE / 1000 * milliseconds;
-    setAudioEffect(AUDIO_EFFECT_FADE_OUT | AUDIO_EFFECT_FADE_IN);
+    setStreamName("AudiodDtmf");
 }
 
-PulseDtmfGenerator::~PulseDtmfGenerator(){}
+PulseDtmfSequence::~PulseDtmfSequence(){}
 
-// stream_write_callback() is invoked from single thread, safe to make it global
-static gint16 fadebuffer[DTMF_FADE_SAMPLES];
+bool PulseDtmfSequence::append(const char * tones)
+{
+    lock();
+    bool open = (mStatus == AUDIO_STATUS_NORMAL);
+    if (open) {
+        // forget the tones already played
+        mTones.erase(0, mIndex);
+        mIndex = 0;
+        for (const char * c = tones; *c; ++c) {
+            int tone = dtmfFromChar(*c);
+            if (tone >= 0 && mTones.size() - mIndex < cMaxQueuedDtmf)
+                mTones += (char) tone;
+        }
+        mIdleSamples = 0;
+    }
+    unlock();
+    return open;
+}
 
-bool PulseDtmfGenerator::stream_write_callback(pa_stream *stream, size_t length)
+bool PulseDtmfSequence::hold(char c)
+{
+    int tone = dtmfFromChar(c);
+    lock();
+    bool open = (mStatus == AUDIO_STATUS_NORMAL);
+    bool alreadyHeld = mHold && mIndex + 1 == mTones.size() && mTones[mIndex] == tone;
+    if (open && tone >= 0 && !alreadyHeld) {
+        // a long press supersedes what's queued, but the tone playing
+        mTones.erase(0, mIndex);
+        mIndex = 0;
+        if (mIndex + 1 < mTones.size())
+            mTones.resize(mIndex + 1);
+        mTones += (char) tone;
+        mHold = true;
+        mIdleSamples = 0;
+    }
+    unlock();
+    return open;
+}
+
+void PulseDtmfSequence::release()
+{
+    lock();
+    mHold = false;
+    unlock();
+}
+
+bool PulseDtmfSequence::stream_write_callback(pa_stream *stream, size_t length)
 {
     PMTRACE_FUNCTION;
-    bool isStopping;
-    pthread_mutex_lock(&mutex);
+    int samples = length/DTMF_SAMPLE_BYTES_PER_FRAME;
+    gint16 * buffer = (gint16 *) pa_xmalloc(samples*DTMF_SAMPLE_BYTES_PER_FRAME);
+    int written = 0;
+    bool more = true;
+
+    lock();
     if (mStatus==AUDIO_STATUS_STOPPING) {
-        isStopping = true;
-    } else if (mStatus==AUDIO_STATUS_NORMAL) {
-        isStopping = false;
-    } else {
-        g_warning("stream_write_callback IllegalStatus %d", mStatus);
-        pthread_mutex_unlock(&mutex);
-        return false;
+        // finish the tone playing & close
+        mHold = false;
+        if (mIndex + 1 < mTones.size())
+            mTones.resize(mIndex + 1);
+        mLingerSamples = 0;
     }
-    gint16* b = dtmf_buffer[mDtmf];
-    int samples = length/DTMF_SAMPLE_BYTES_PER_FRAME;
-    while (samples>0) {
-        int samplesToPlay;
-        if (mWritePos+samples>=DTMF_SAMPLE) samplesToPlay = DTMF_SAMPLE-mWritePos;
-        else samplesToPlay = samples;
-        if (mPlaySamples>0 && mAccumulatedSamples+samplesToPlay>=mPlaySamples) {
-            samplesToPlay = mPlaySamples-mAccumulatedSamples;
+    while (written < samples) {
+        if (mIndex >= mTones.size()) {
+            // nothing to play: silence, until it's time to close the stream
+            int count = MIN(samples - written, mLingerSamples - mIdleSamples);
+            if (count <= 0) {
+                more = false;
+                break;
+            }
+            memset(buffer + written, 0, count*DTMF_SAMPLE_BYTES_PER_FRAME);
+            written += count;
+            mIdleSamples += count;
+            continue;
         }
 
-        if (samplesToPlay>0) {
-            int fadeInSamples = 0;
-            int normalSamples = samplesToPlay;
-            int fadeOutSamples = 0;
-            if ((mAudioEffect | AUDIO_EFFECT_FADE_IN)) {
-                if (mAccumulatedSamples < DTMF_FADE_SAMPLES) {
-                    fadeInSamples = DTMF_FADE_SAMPLES - mAccumulatedSamples;
-                    if (fadeInSamples>samplesToPlay) fadeInSamples = samplesToPlay;
-                    normalSamples = samplesToPlay - fadeInSamples;
-                    gint16 * originalbuffer = b+mWritePos;
-                    for (int i=0; i<fadeInSamples; i++) {
-                        fadebuffer[i] = originalbuffer[i] *
-                                        (mAccumulatedSamples+i) /
-                                         DTMF_FADE_SAMPLES;
-                    }
-                }
-            }
-            if (fadeInSamples>0) pa_stream_write(stream,
-                                                 fadebuffer,
-                                                 fadeInSamples*DTMF_SAMPLE_BYTES_PER_FRAME,
-                                                 NULL,
-                                                 0,
-                                                 PA_SEEK_RELATIVE );
-
-
-            if (normalSamples>0 && (mAudioEffect | AUDIO_EFFECT_FADE_OUT)) {
-                if ((mPlaySamples>0 && mAccumulatedSamples + samplesToPlay >
-                                       mPlaySamples - DTMF_FADE_SAMPLES) ) {
-                    normalSamples = mPlaySamples -
-                                    DTMF_FADE_SAMPLES -
-                                    mAccumulatedSamples -
-                                    fadeInSamples; // could be <0
-                    fadeOutSamples = normalSamples>=0?
-                                     (samplesToPlay - normalSamples - fadeInSamples) :
-                                     (samplesToPlay-fadeInSamples);
-                    gint16 * originalbuffer = b+mWritePos+fadeInSamples + normalSamples;
-                    if (normalSamples>0) {
-                        for (int i=0; i<fadeOutSamples; i++) {
-                            fadebuffer[i] = originalbuffer[i] *
-                                            (DTMF_FADE_SAMPLES-i) /
-                                             DTMF_FADE_SAMPLES;
-                        }
-                    } else {
-                        for (int i=0; i<fadeOutSamples; i++) {
-                            fadebuffer[i] = originalbuffer[i] *
-                                            (DTMF_FADE_SAMPLES-i-normalSamples) /
-                                            DTMF_FADE_SAMPLES;
-                        }
-                        normalSamples = 0;
-                    }
-                } else if (isStopping && samples - samplesToPlay < DTMF_FADE_SAMPLES) {
-                    fadeOutSamples = samplesToPlay - (samples-DTMF_FADE_SAMPLES); // >0
-                    if (fadeOutSamples > normalSamples) fadeOutSamples = normalSamples;
-                    normalSamples = normalSamples - fadeOutSamples;
-                    gint16 * originalbuffer = b+mWritePos+fadeInSamples + normalSamples;
-                    for (int i=0; i<fadeOutSamples; i++) {
-                        fadebuffer[i] = originalbuffer[i] *
-                                        (samples - samplesToPlay + fadeOutSamples - i) /
-                                         DTMF_FADE_SAMPLES;
-                    }
-                }
-            }
-            if (normalSamples>0) {
-                pa_stream_write(stream,
-                                b+mWritePos+fadeInSamples,
-                                normalSamples*DTMF_SAMPLE_BYTES_PER_FRAME,
-                                NULL,
-                                0,
-                                PA_SEEK_RELATIVE );
-            }
-            if (fadeOutSamples>0) {
-                pa_stream_write(stream,
-                                fadebuffer,
-                                fadeOutSamples*DTMF_SAMPLE_BYTES_PER_FRAME,
-                                NULL,
-                                0,
-                                PA_SEEK_RELATIVE );
+        bool held = mHold && mIndex + 1 == mTones.size();
+        if (mHolding && !held) {
+            // released: fade out now, after the fade in if still in it
+            mToneEnd = MAX(mPos, DTMF_FADE_SAMPLES) + DTMF_FADE_SAMPLES;
+        }
+        mHolding = held;
+
+        if (held || mPos < mToneEnd) {
+            const gint16 * tone = dtmf_buffer[(int) mTones[mIndex]];
+            int count = held ? samples - written : MIN(samples - written, mToneEnd - mPos);
+            for (int i = 0; i < count; ++i, ++mPos) {
+                int sample = tone[mPos % DTMF_SAMPLE];
+                if (mPos < DTMF_FADE_SAMPLES)
+                    sample = sample * mPos / DTMF_FADE_SAMPLES;
+                if (!held && mToneEnd - mPos < DTMF_FADE_SAMPLES)
+                    sample = sample * (mToneEnd - mPos) / DTMF_FADE_SAMPLES;
+                buffer[written++] = (gint16) sample;
             }
-
-            mWritePos += samplesToPlay;
-            if (mWritePos==DTMF_SAMPLE) mWritePos=0;
-            mAccumulatedSamples+=samplesToPlay;
-            samples -= samplesToPlay;
+        } else if (mPos < mToneEnd + mGapSamples) {
+            int count = MIN(samples - written, mToneEnd + mGapSamples - mPos);
+            memset(buffer + written, 0, count*DTMF_SAMPLE_BYTES_PER_FRAME);
+            written += count;
+            mPos += count;
         } else {
-            isStopping = true;
-            break;
+            // next tone
+            ++mIndex;
+            mPos = 0;
+            mToneEnd = mToneSamples;
+            mHolding = false;
         }
     }
-    pthread_mutex_unlock(&mutex);
-    if (isStopping) {
-        return false;
-    } else return true;
-
+    // nothing can be appended anymore
+    if (!more)
+        mStatus = AUDIO_STATUS_STOPPED;
+    unlock();
+
+    if (written > 0)
+        pa_stream_write(stream, buffer, written*DTMF_SAMPLE_BYTES_PER_FRAME,
+                        pa_xfree, 0, PA_SEEK_RELATIVE);
+    else
+        pa_xfree(buffer);
+
+    return more;
 }
@@ -17,9 +17,11 @@
 #ifndef PULSEAUDIOLINK_H_
 #define PULSEAUDIOLINK_H_
 
+#include <glib.h>
 #include <pulse/pulseaudio.h>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "AudioMixer.h"
 #define AUDIO_EFFECT_FADE_OUT  1
@@ -30,6 +32,15 @@
 #define AUDIO_STATUS_STOPPED  3
 #define AUDIO_STATUS_DISCONNECTED 4
 
+/// Jittered exponential backoff: returns a wait between half & all of the
+/// current delay, then doubles that delay, up to maxDelay (never wrapping)
+static inline int nextBackoffDelay(int & delay, int maxDelay)
+{
+    int wait = delay / 2 + g_random_int_range(0, delay / 2 + 1);
+    delay = MIN(delay * 2, maxDelay);
+    return wait;
+}
+
 class RefObj {
 public:
     RefObj():refCount(1){
@@ -103,6 +114,12 @@ public:
     // The callback is only called when AUDIO_STATUS_NORMAL or AUDIO_STATUS_STOPPING
     // return false when no more data then STATUS is set to AUDIO_STATUS_STOPPED
     virtual bool stream_write_callback(pa_stream *s, size_t length)=0;
+
+    /// Request to sound latency probe: set when played, on the main thread,
+    /// recorded once with the first data written, on the Pulse thread
+    void probePlay(const char * sink);
+    void probeDeferred() { mDeferredTime = g_get_monotonic_time(); }
+    void probeStarted();
 protected:
     virtual ~PulseAudioDataProvider();
     int mStatus;
@@ -110,8 +127,14 @@ protected:
     pa_volume_t mVolume;
     const char* mStreamName;
     int mAudioEffect;
+    const char* mProbeSink;
+    guint16 mProbeTraceSink;
+    gint64 mRequestTime;    // 0 once recorded
+    gint64 mDeferredTime;
 };
 
+struct PulseWarmStream;
+
 /*
  * PulseAudioLink handles a connection with Pulse using Pulse official APIs
  * The only purpose of this class is to allow playing a system sound file
@@ -122,9 +145,16 @@ class PulseAudioLink {
 public:
     PulseAudioLink();
 
-    /// Connection status & management
-    bool    isConnected() const    { return mPulseAudioReady; }
+    /// Connection status & management.
+    /// Connecting never blocks: checkConnection() starts a connection in
+    /// the background if needed, & returns true only once it's ready.
+    bool    isConnected() const    { return g_atomic_int_get(&mPulseAudioReady) != 0; }
     bool    checkConnection()    { return isConnected()|| connectToPulse(); }
+    /// Changes with each new connection, streams of older ones are gone
+    unsigned int connectionId() const { return mConnectionId; }
+
+    /// Pulse is known to be up: (re)connect now, skipping any backoff
+    void    reconnect();
 
     /// API to playback a system sound. Prefer the version using a EVirtualSink
     bool    play(const char *snd, EVirtualSink sink);
@@ -138,10 +168,24 @@ public:
     /// These should really be private, but they're needed for global callbacks...
     void    pulseAudioStateChanged(pa_context_state_t state);
 
+    /// Start a data provider in a warm stream of that sink, if one is free.
+    /// Pulse thread only.
+    bool    playWarm(PulseAudioDataProvider* data, const char* sink);
+
+    /// (Re)connect a warm stream, replacing its failed pa_stream if any.
+    /// Pulse thread only.
+    void    connectWarmStream(PulseWarmStream * warm);
+    /// Replace a failed warm stream after a backoff. Pulse thread only.
+    void    scheduleWarmStream(PulseWarmStream * warm);
+
 protected:
     bool     connectToPulse();
     void    killPulseConnection();
-    bool    iteratePulse(int block);
+
+    /// Pool of streams kept connected & corked on low latency sinks,
+    /// so that generated sounds start without a stream setup
+    void    createWarmStreams();
+    void    releaseWarmStreams();
 
     static void* pathread_func(void*);
     static void stream_drain_complete(pa_stream*stream, int success, void *userdata) ;
@@ -153,10 +197,20 @@ protected:
 private:
     pa_context *            mContext;
     pa_mainloop *            mMainLoop;
-    bool                    mPulseAudioReady;
-    std::set<std::string>    mLoadedSounds;
+    // written by the Pulse thread, read by the main thread: g_atomic_int_* only
+    gint                    mPulseAudioReady;
+
+    std::vector<PulseWarmStream *> mWarmStreams;   // Pulse thread only
 
     pthread_t mThread;
+    bool                    mThreadRunning;
+    gint                    mQuitThread;        // g_atomic_int_* only
+    unsigned int            mConnectionId;
+
+    // background connection state, with backoff after failures
+    gint                    mConnecting;        // g_atomic_int_* only
+    gint                    mRetryDelay;        // g_atomic_int_* only
+    guint64                    mNextAttempt;       // main thread only
 };
 
 enum Dtmf {
@@ -175,17 +229,34 @@ enum Dtmf {
     Dtmf_ArrayCount
 };
 
-class PulseDtmfGenerator : public PulseAudioDataProvider {
+/// Plays a string of DTMF tones in a single stream, with a fixed cadence:
+/// each tone for toneMs, followed by gapMs of silence. More tones can be
+/// appended while it plays, & the last one can be held until released,
+/// for long presses. After lingerMs with nothing to play, the stream closes.
+class PulseDtmfSequence : public PulseAudioDataProvider {
 public:
-    PulseDtmfGenerator(Dtmf tone, int milliseconds=0);
-    Dtmf getTone(){ return (Dtmf)mDtmf; };
+    PulseDtmfSequence(int toneMs, int gapMs, int lingerMs);
+
+    /// Queue tones. Returns false once the stream is closing
+    bool append(const char * tones);
+    /// Queue a tone played until release(), unless it's already held
+    bool hold(char tone);
+    /// End the held tone, if any
+    void release();
+
     virtual bool stream_write_callback(pa_stream *s, size_t length);
 protected:
-    virtual ~PulseDtmfGenerator();
-    int mDtmf;
-    int mWritePos;
-    int mAccumulatedSamples;
-    int mPlaySamples;
+    virtual ~PulseDtmfSequence();
+    std::string mTones;         // Dtmf values
+    size_t mIndex;              // tone playing
+    int mPos;                   // samples played of that tone & its gap
+    int mToneSamples;
+    int mGapSamples;
+    int mLingerSamples;
+    int mIdleSamples;
+    int mToneEnd;               // where the tone playing fades out
+    bool mHold;                 // the last tone is held
+    bool mHolding;              // the tone playing was held
 };
 
 #endif /* PULSEAUDIOLINK_H_ */
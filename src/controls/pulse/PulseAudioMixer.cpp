@@ -17,7 +17,13 @@
 
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <cerrno>
+#include <ctime>
+#include <algorithm>
+#include <vector>
 
 #include <pulse/module-palm-policy-tables.h>
 
@@ -29,8 +35,12 @@
 #include "main.h"
 #include "media.h"
 #include "phone.h"
+#include "startupProfile.h"
+#include "controlTrace.h"
 #include <audiodTracer.h>
 #define SHORT_DTMF_LENGTH  200
+#define DTMF_GAP_LENGTH    100    // silence between the tones of a sequence
+#define DTMF_LINGER_LENGTH 500    // keep the stream open that long for more tones
 #define phone_MaxVolume 70
 #define phone_MinVolume 0
 #define FILENAME "/dev/snd/pcmC"
@@ -40,7 +50,9 @@
 
 PulseAudioMixer gPulseAudioMixer;
 
+#ifndef AUDIOD_SIMULATOR   // the simulator records commands instead
 AudioMixer & gAudioMixer = gPulseAudioMixer;
+#endif
 
 const char * controlEventName(EControlEvent event)
 {
@@ -67,20 +79,52 @@ const char * virtualSinkName(EVirtualSink sink, bool prettyName)
     return name;
 }
 
+/// Sorted index of sink or source names, with & without their leading
+/// character, so that names are found without scanning the maps
+struct NameIndexEntry
+{
+    const char *    mName;
+    int             mId;
+};
+
+static bool _nameIndexLess(const NameIndexEntry & a, const NameIndexEntry & b)
+{
+    return strcmp(a.mName, b.mName) < 0;
+}
+
+static void _addNameIndexEntries(std::vector<NameIndexEntry> & index,
+                                 const char * name, int id)
+{
+    NameIndexEntry entry = { name, id };
+    index.push_back(entry);
+    entry.mName = name + 1;
+    index.push_back(entry);
+}
+
+static int _findInNameIndex(const std::vector<NameIndexEntry> & index, const char * name,
+                                                                 int notFound)
+{
+    NameIndexEntry key = { name, notFound };
+    std::vector<NameIndexEntry>::const_iterator iter =
+                    std::lower_bound(index.begin(), index.end(), key, _nameIndexLess);
+    if (iter != index.end() && strcmp(iter->mName, name) == 0)
+        return iter->mId;
+    return notFound;
+}
+
 EVirtualSink getSinkByName(const char * name)
 {
-    EVirtualSink sink = eVirtualSink_None;
-    for (int i = eVirtualSink_First; i <= eVirtualSink_Last; i++)
+    static std::vector<NameIndexEntry> sIndex;
+    if (sIndex.empty())
     {
-        if (0 == strcmp(name, systemdependantvirtualsinkmap[i].virtualsinkname) ||
-             0 == strcmp(name, systemdependantvirtualsinkmap[i].virtualsinkname + 1))
-        {
-            sink = (EVirtualSink) systemdependantvirtualsinkmap[i].virtualsinkidentifier;
-            break;
-        }
+        for (int i = eVirtualSink_First; i <= eVirtualSink_Last; i++)
+            _addNameIndexEntries(sIndex, systemdependantvirtualsinkmap[i].virtualsinkname,
+                                 systemdependantvirtualsinkmap[i].virtualsinkidentifier);
+        // stable: on duplicate names, the first sink wins, like a linear scan
+        std::stable_sort(sIndex.begin(), sIndex.end(), _nameIndexLess);
     }
 
-    return sink;
+    return (EVirtualSink) _findInNameIndex(sIndex, name, eVirtualSink_None);
 }
 
 const char * virtualSourceName(EVirtualSource source, bool prettyName)
@@ -98,28 +142,137 @@ const char * virtualSourceName(EVirtualSource source, bool prettyName)
 
 EVirtualSource getSourceByName(const char * name)
 {
-    EVirtualSource source = eVirtualSource_None;
+    static std::vector<NameIndexEntry> sIndex;
+    if (sIndex.empty())
+    {
+        for (int i = eVirtualSource_First; i <= eVirtualSource_Last; i++)
+            _addNameIndexEntries(sIndex, systemdependantvirtualsourcemap[i].virtualsourcename,
+                                 systemdependantvirtualsourcemap[i].virtualsourceidentifier);
+        std::stable_sort(sIndex.begin(), sIndex.end(), _nameIndexLess);
+    }
+
+    return (EVirtualSource) _findInNameIndex(sIndex, name, eVirtualSource_None);
+}
+
+#ifdef AUDIOD_SIMULATOR    // audiod-sim -b only: not shipped in audiod
+
+/// The linear scans the name indexes replaced, kept as a reference
+static EVirtualSink _scanSinkByName(const char * name)
+{
+    for (int i = eVirtualSink_First; i <= eVirtualSink_Last; i++)
+    {
+        if (0 == strcmp(name, systemdependantvirtualsinkmap[i].virtualsinkname) ||
+             0 == strcmp(name, systemdependantvirtualsinkmap[i].virtualsinkname + 1))
+            return (EVirtualSink) systemdependantvirtualsinkmap[i].virtualsinkidentifier;
+    }
+    return eVirtualSink_None;
+}
+
+static EVirtualSource _scanSourceByName(const char * name)
+{
     for (int i = eVirtualSource_First; i <= eVirtualSource_Last; i++)
     {
         if (0 == strcmp(name, systemdependantvirtualsourcemap[i].virtualsourcename) ||
             0 == strcmp(name, systemdependantvirtualsourcemap[i].virtualsourcename + 1))
-        {
-            source = (EVirtualSource) systemdependantvirtualsourcemap[i].virtualsourceidentifier;
-            break;
-        }
+            return (EVirtualSource) systemdependantvirtualsourcemap[i].virtualsourceidentifier;
     }
+    return eVirtualSource_None;
+}
 
-    return source;
+/// Real time in ns: GLib's clock is virtual in the simulator
+static gint64 _benchmarkTime()
+{
+    struct timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return gint64(now.tv_sec) * 1000000000LL + now.tv_nsec;
 }
 
+bool PulseAudioMixer::BenchmarkNameLookups(int rounds)
+{
+    int failures = unitTestFailureCount();
+    std::vector<const char *> sinkNames, sourceNames;
+    for (int i = eVirtualSink_First; i <= eVirtualSink_Last; i++)
+    {
+        sinkNames.push_back(systemdependantvirtualsinkmap[i].virtualsinkname);
+        sinkNames.push_back(systemdependantvirtualsinkmap[i].virtualsinkname + 1);
+    }
+    for (int i = eVirtualSource_First; i <= eVirtualSource_Last; i++)
+    {
+        sourceNames.push_back(systemdependantvirtualsourcemap[i].virtualsourcename);
+        sourceNames.push_back(systemdependantvirtualsourcemap[i].virtualsourcename + 1);
+    }
+    // misses cost a full scan
+    sinkNames.push_back("nosuchsink");
+    sourceNames.push_back("nosuchsource");
+
+    for (size_t n = 0; n < sinkNames.size(); ++n)
+        if (!UT_CHECK(getSinkByName(sinkNames[n]) == _scanSinkByName(sinkNames[n])))
+            g_critical("%s: sink '%s'", __FUNCTION__, sinkNames[n]);
+    for (size_t n = 0; n < sourceNames.size(); ++n)
+        if (!UT_CHECK(getSourceByName(sourceNames[n]) == _scanSourceByName(sourceNames[n])))
+            g_critical("%s: source '%s'", __FUNCTION__, sourceNames[n]);
+
+    // the sums keep the compiler from dropping the lookups
+    long scanSum = 0, indexSum = 0;
+    gint64 start = _benchmarkTime();
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (size_t n = 0; n < sinkNames.size(); ++n)
+            scanSum += _scanSinkByName(sinkNames[n]);
+        for (size_t n = 0; n < sourceNames.size(); ++n)
+            scanSum += _scanSourceByName(sourceNames[n]);
+    }
+    gint64 scanTime = _benchmarkTime() - start;
+
+    start = _benchmarkTime();
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (size_t n = 0; n < sinkNames.size(); ++n)
+            indexSum += getSinkByName(sinkNames[n]);
+        for (size_t n = 0; n < sourceNames.size(); ++n)
+            indexSum += getSourceByName(sourceNames[n]);
+    }
+    gint64 indexTime = _benchmarkTime() - start;
+    UT_CHECK(scanSum == indexSum);
+
+    double lookups = double(rounds) * (sinkNames.size() + sourceNames.size());
+    printf("name lookups: %zu sink & %zu source names, %d rounds\n"
+           "  linear scan:  %8.1f ns/lookup\n"
+           "  sorted index: %8.1f ns/lookup\n",
+           sinkNames.size(), sourceNames.size(), rounds,
+           scanTime / lookups, indexTime / lookups);
+
+    return unitTestFailureCount() == failures;
+}
+
+#endif // AUDIOD_SIMULATOR
+
 const int cMinTimeout = 50;
 const int cMaxTimeout = 5000;
 
+// How long sink events may be held back (ms) to be reported as one burst.
+// 0: only within a main loop iteration, negative: reported one by one.
+// Off by default: a stream opened & closed within the delay is never
+// reported, while the alert, notification, system, ringtone, timer & alarm
+// modules vibrate or beep on every first stream opened, & the media module
+// starts playback on it. Only enable it where short sounds don't matter.
+#ifndef SINK_EVENTS_COALESCING_DELAY
+#define SINK_EVENTS_COALESCING_DELAY -1
+#endif
+const int cSinkEventsCoalescingDelay = SINK_EVENTS_COALESCING_DELAY;
+
 PulseAudioMixer::PulseAudioMixer() : mChannel(0),
                                      mTimeout(cMinTimeout),
                                      mSourceID(-1),
                                      mConnectAttempt(0),
                                      mCurrentDtmf(NULL),
+                                     mCurrentDtmfSink(NULL),
+                                     mCurrentDtmfConnection(0),
+                                     mSinkEventsPending(false),
+                                     mSinkEventsUrgent(false),
+                                     mSinkEventsSourceID(0),
+                                     mActiveRamps(0),
+                                     mRampSourceID(0),
                                      mPulseFilterEnabled(true),
                                      mPulseStateFilter(0),
                                      mPulseStateLatency(0),
@@ -140,6 +293,7 @@ PulseAudioMixer::PulseAudioMixer() : mChannel(0),
         mPulseStateVolumeHeadset[i] = -1;
         mPulseStateRoute[i] = -1;
         mPulseStateActiveStreamCount[i] = 0;
+        mRamps[i].mStart = 0;
     }
     for (int i = eVirtualSource_First; i <= eVirtualSource_Last; i++)
     {
@@ -176,17 +330,12 @@ static int _add_dB (int current, int dB_diff)
 }
 
 /*
- * current is the current volume from 0 to 100
+ * percent is the current volume from 0 to 100, in table
  * dB_diff is the amount in dB added to the current volume
  * returns the desired volume from 0 to 100
  */
-int PulseAudioMixer::adjustVolume(int percent, int dB_diff)
+static int _searchAdjustedVolume(const int * table, int percent, int dB_diff)
 {
-    if (!VERIFY(percent >= 0 && percent <= 100))
-        return percent;
-
-    int tableIndex = gAudioDevice.getHeadsetState() != eHeadsetState_None ? 1 : 0;
-    int * table = _mapPercentToPulseVolume[tableIndex];
     int pulse_volume = table[percent];
     pulse_volume = _add_dB(pulse_volume, dB_diff);
 
@@ -236,11 +385,240 @@ int PulseAudioMixer::adjustVolume(int percent, int dB_diff)
     if (result == 0 && percent > 1)
         result = 1;
 
+    return result;
+}
+
+/// dB adjustments precomputed, enough for all cumulated duckings
+static const int cAdjustMinDB = -40;
+static const int cAdjustMaxDB = 0;
+static const int cAdjustDBCount = cAdjustMaxDB - cAdjustMinDB + 1;
+
+/// Results of _searchAdjustedVolume, for the speaker & headset tables.
+/// Built on first use, as the tables come from Pulse's policy module.
+static gint8 sAdjustedVolume[2][cAdjustDBCount][101];
+static bool sAdjustedVolumeReady[2] = { false, false };
+
+static void _buildAdjustedVolumes(int tableIndex)
+{
+    const int * table = _mapPercentToPulseVolume[tableIndex];
+    for (int dB = cAdjustMinDB; dB <= cAdjustMaxDB; ++dB)
+        for (int percent = 0; percent <= 100; ++percent)
+            sAdjustedVolume[tableIndex][dB - cAdjustMinDB][percent] =
+                                (gint8) _searchAdjustedVolume(table, percent, dB);
+    sAdjustedVolumeReady[tableIndex] = true;
+}
+
+/*
+ * current is the current volume from 0 to 100
+ * dB_diff is the amount in dB added to the current volume
+ * returns the desired volume from 0 to 100
+ */
+int PulseAudioMixer::adjustVolume(int percent, int dB_diff)
+{
+    if (!VERIFY(percent >= 0 && percent <= 100))
+        return percent;
+
+    int tableIndex = gAudioDevice.getHeadsetState() != eHeadsetState_None ? 1 : 0;
+    int result;
+    if (dB_diff >= cAdjustMinDB && dB_diff <= cAdjustMaxDB)
+    {
+        if (!sAdjustedVolumeReady[tableIndex])
+            _buildAdjustedVolumes(tableIndex);
+        result = sAdjustedVolume[tableIndex][dB_diff - cAdjustMinDB][percent];
+    }
+    else
+    {
+        result = _searchAdjustedVolume(_mapPercentToPulseVolume[tableIndex],
+                                                              percent, dB_diff);
+    }
+
     g_debug("adjust dB Volume: %dp %+d dB = %dp (%+dp)", \
                                  percent, dB_diff, result, result - percent);
     return result;
 }
 
+static void appendPulseCommand (std::string & batch, char cmd, int sink,
+                                int value, int headset);
+static char _rampCurveCode(ERampCurve curve);
+
+/// All there is to read on a socket, without waiting
+static std::string
+_readAvailable (int sockfd)
+{
+    std::string data;
+    char buffer[1024];
+    ssize_t bytes;
+    while ((bytes = recv(sockfd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+        data.append(buffer, bytes);
+    return data;
+}
+
+bool PulseAudioMixer::UnitTest()
+{
+    int failures = unitTestFailureCount();
+
+    // _add_dB moves by 655.35 per dB, rounded down: values computed by hand
+    UT_CHECK(_add_dB(65535, -10) == 58981);
+    UT_CHECK(_add_dB(40000, -10) == 33446);
+    UT_CHECK(_add_dB(1000, -2) == 0);
+    UT_CHECK(_add_dB(0, -5) == 0);
+    UT_CHECK(_add_dB(65535, 3) == 65535);
+    UT_CHECK(_add_dB(12345, 0) == 12345);
+
+    // the search, on a linear table t[p] = 655 * p: results computed by hand
+    int linear[101];
+    for (int percent = 0; percent <= 100; ++percent)
+        linear[percent] = 655 * percent;
+    UT_CHECK(_searchAdjustedVolume(linear, 50, 0) == 50);
+    UT_CHECK(_searchAdjustedVolume(linear, 50, -10) == 39);   // 26196: 25545..26200
+    UT_CHECK(_searchAdjustedVolume(linear, 80, -6) == 73);    // 48467: 47815..48470
+    UT_CHECK(_searchAdjustedVolume(linear, 100, -40) == 59);  // 39286: 38645..39300
+    UT_CHECK(_searchAdjustedVolume(linear, 10, -20) == 1);    // silent, but minimal 1%
+    UT_CHECK(_searchAdjustedVolume(linear, 1, -20) == 0);
+    UT_CHECK(_searchAdjustedVolume(linear, 0, -3) == 0);
+
+    // adjustVolume, for both real tables, checked against the tables themselves
+    EHeadsetState headset = gAudioDevice.getHeadsetState();
+    for (int tableIndex = 0; tableIndex < 2; ++tableIndex)
+    {
+        gAudioDevice.setHeadsetState(tableIndex ? eHeadsetState_Headset : eHeadsetState_None);
+        const int * table = _mapPercentToPulseVolume[tableIndex];
+        for (int dB = cAdjustMinDB; dB <= cAdjustMaxDB; ++dB)
+        {
+            for (int percent = 0; percent <= 100; ++percent)
+            {
+                int result = gPulseAudioMixer.adjustVolume(percent, dB);
+                int target = _add_dB(table[percent], dB);
+                bool ok = UT_CHECK(result >= 0 && result <= 100);
+                // never rounded in the wrong direction...
+                ok = UT_CHECK(dB < 0 ? result <= percent : result >= percent) && ok;
+                // not moved at all by 0 dB, where the table has distinct steps
+                if (dB == 0 && (percent == 0 || table[percent - 1] < table[percent]) &&
+                               (percent == 100 || table[percent + 1] > table[percent]))
+                    ok = UT_CHECK(result == percent) && ok;
+                // ...but never ducked to silence
+                ok = UT_CHECK(percent <= 1 || result >= 1) && ok;
+                // the loudest step no louder than asked, unless forced to 1%
+                if (dB < 0 && result < percent && !(result == 1 && table[1] > target))
+                    ok = UT_CHECK(table[result] <= target && table[result + 1] > target) && ok;
+                if (!ok)
+                    g_critical("%s: table %i, %ip %+i dB = %ip", __FUNCTION__,
+                               tableIndex, percent, dB, result);
+            }
+        }
+    }
+
+    // ramps start where they are, end where they go & never turn back, on
+    // both tables. In dB, a percent stands for its Pulse volume, shared by
+    // a few neighbors where a table is flat.
+    static const ERampCurve cCurves[] = { eRampCurve_Linear, eRampCurve_dBLinear,
+                                          eRampCurve_SCurve };
+    static const int cEnds[][2] = { { 0, 100 }, { 100, 0 }, { 20, 80 }, { 90, 30 }, { 1, 2 } };
+    VolumeRamp ramp;
+    ramp.mStart = G_USEC_PER_SEC;
+    ramp.mDuration = 250;
+    gint64 end = ramp.mStart + ramp.mDuration * 1000;
+    for (int tableIndex = 0; tableIndex < 2; ++tableIndex)
+    {
+        gAudioDevice.setHeadsetState(tableIndex ? eHeadsetState_Headset : eHeadsetState_None);
+        const int * table = _mapPercentToPulseVolume[tableIndex];
+        for (size_t curve = 0; curve < G_N_ELEMENTS(cCurves); ++curve)
+        {
+            for (size_t ends = 0; ends < G_N_ELEMENTS(cEnds); ++ends)
+            {
+                ramp.mCurve = cCurves[curve];
+                ramp.mFrom = cEnds[ends][0];
+                ramp.mTo = cEnds[ends][1];
+                int low = MIN(ramp.mFrom, ramp.mTo);
+                int high = MAX(ramp.mFrom, ramp.mTo);
+                int first = gPulseAudioMixer.rampVolumeAt(ramp, ramp.mStart);
+                bool ok = UT_CHECK(table[first] == table[ramp.mFrom]);
+                ok = UT_CHECK(gPulseAudioMixer.rampVolumeAt(ramp, end) == ramp.mTo) && ok;
+                ok = UT_CHECK(gPulseAudioMixer.rampVolumeAt(ramp, end + 1000) == ramp.mTo) && ok;
+                int previous = first;
+                for (gint64 now = ramp.mStart; now <= end; now += 5000)
+                {
+                    int volume = gPulseAudioMixer.rampVolumeAt(ramp, now);
+                    ok = UT_CHECK(volume >= low && volume <= high) && ok;
+                    ok = UT_CHECK(ramp.mTo > ramp.mFrom ? volume >= previous :
+                                                          volume <= previous) && ok;
+                    previous = volume;
+                }
+                if (!ok)
+                    g_critical("%s: table %i, curve %c, ramp %i -> %i", __FUNCTION__,
+                               tableIndex, _rampCurveCode(ramp.mCurve), ramp.mFrom, ramp.mTo);
+            }
+        }
+
+        // linear in percents, halfway at half time; the S-curve lags behind
+        // the dB ramp it shapes early, catches up halfway & leads late
+        ramp.mFrom = 0;
+        ramp.mTo = 100;
+        gint64 half = ramp.mStart + ramp.mDuration * 500;
+        ramp.mCurve = eRampCurve_Linear;
+        UT_CHECK(gPulseAudioMixer.rampVolumeAt(ramp, half) == 50);
+        ramp.mCurve = eRampCurve_dBLinear;
+        int dBEarly = gPulseAudioMixer.rampVolumeAt(ramp, ramp.mStart + 50000);
+        int dBHalf = gPulseAudioMixer.rampVolumeAt(ramp, half);
+        int dBLate = gPulseAudioMixer.rampVolumeAt(ramp, end - 50000);
+        ramp.mCurve = eRampCurve_SCurve;
+        UT_CHECK(gPulseAudioMixer.rampVolumeAt(ramp, ramp.mStart + 50000) <= dBEarly);
+        UT_CHECK(gPulseAudioMixer.rampVolumeAt(ramp, half) == dBHalf);
+        UT_CHECK(gPulseAudioMixer.rampVolumeAt(ramp, end - 50000) >= dBLate);
+    }
+    gAudioDevice.setHeadsetState(headset);
+
+    // programDestinations sends the routes that changed, in one batch, &
+    // commits those sent: routes held back by a full socket go with the next
+    int sockets[2];
+    if (UT_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0))
+    {
+        PulseAudioMixer mixer;
+        mixer.mChannel = g_io_channel_unix_new(sockets[0]);
+        int sinks[eVirtualSink_Count];
+        int sources[eVirtualSource_Count];
+        std::string expected;
+        for (int sink = eVirtualSink_First; sink <= eVirtualSink_Last; ++sink)
+        {
+            sinks[sink] = 0;
+            appendPulseCommand(expected, 'd', sink, 0, headset);
+        }
+        for (int source = eVirtualSource_First; source <= eVirtualSource_Last; ++source)
+        {
+            sources[source] = 1;
+            appendPulseCommand(expected, 'e', source, 1, headset);
+        }
+        UT_CHECK(mixer.programDestinations(sinks, sources));
+        UT_CHECK(_readAvailable(sockets[1]) == expected);
+
+        // nothing changed, or nothing asked
+        UT_CHECK(mixer.programDestinations(sinks, sources));
+        sinks[eVirtualSink_Last] = -1;
+        UT_CHECK(mixer.programDestinations(sinks, sources));
+        UT_CHECK(_readAvailable(sockets[1]).empty());
+
+        // one change, while Pulse doesn't read
+        while (send(sockets[0], "", 1, MSG_DONTWAIT) == 1)
+            ;
+        sinks[eVirtualSink_First] = 2;
+        UT_CHECK(!mixer.programDestinations(sinks, sources));
+        UT_CHECK(mixer.mPulseStateRoute[eVirtualSink_First] == 0);
+        _readAvailable(sockets[1]);
+        expected.clear();
+        appendPulseCommand(expected, 'd', eVirtualSink_First, 2, headset);
+        UT_CHECK(mixer.programDestinations(sinks, sources));
+        UT_CHECK(mixer.mPulseStateRoute[eVirtualSink_First] == 2);
+        UT_CHECK(_readAvailable(sockets[1]) == expected);
+
+        g_io_channel_unref(mixer.mChannel);
+        mixer.mChannel = 0;
+        close(sockets[0]);
+        close(sockets[1]);
+    }
+
+    return unitTestFailureCount() == failures;
+}
+
 bool
 PulseAudioMixer::suspendAll()
 {
@@ -359,22 +737,76 @@ PulseAudioMixer::programSource (char cmd, int sink, int value)
         }
 
         g_debug ("%s: sending message '%s' %s", __FUNCTION__, buffer, sinkName);
-        int sockfd = g_io_channel_unix_get_fd (mChannel);
-        ssize_t bytes = send(sockfd, buffer, SIZE_MESG_TO_PULSE, MSG_DONTWAIT);
-        if (bytes != SIZE_MESG_TO_PULSE)
+        traceEvent(eTrace_ProgramSource, cmd, 0, sink, value);
+        if (sendToPulse(buffer, SIZE_MESG_TO_PULSE) == 0)
         {
-            if (bytes >= 0)
-                g_warning("programSource: only %u bytes sent to Pulse out of %d (%s).", \
-                                   bytes, SIZE_MESG_TO_PULSE, strerror(errno));
-            else
-                g_warning("programSource: send to Pulse failed: %s", strerror(errno));
+            // forget a route Pulse doesn't have, so that it is sent again
+            if (cmd == 'd')
+                mPulseStateRoute[sink] = -1;
+            else if (cmd == 'e')
+                mPulseStateSourceRoute[sink] = -1;
         }
     }
 
     return true;
 }
 
+/// How long a message cut by a full socket may take to finish, in ms
+static const int cFinishMessageTimeout = 100;
+
+/// Pulse reads fixed size messages from a stream socket,
+/// so several of them can go out in a single send.
+/// A full socket stops the batch between two messages, but a message
+/// started is finished, or Pulse would read all that follows misaligned.
+size_t
+PulseAudioMixer::sendToPulse (const char * data, size_t size)
+{
+    int sockfd = g_io_channel_unix_get_fd (mChannel);
+    size_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t bytes = send(sockfd, data + sent, size - sent, MSG_DONTWAIT);
+        if (bytes > 0)
+        {
+            sent += bytes;
+            continue;
+        }
+        if (bytes < 0 && errno == EINTR)
+            continue;
+
+        bool cut = (sent % SIZE_MESG_TO_PULSE) != 0;
+        if (cut && bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            struct pollfd writable = { sockfd, POLLOUT, 0 };
+            if (poll(&writable, 1, cFinishMessageTimeout) > 0)
+                continue;
+        }
+        if (cut)
+            g_critical("%s: message cut after %u bytes: %s", __FUNCTION__,
+                       (unsigned) (sent % SIZE_MESG_TO_PULSE), strerror(errno));
+        else
+            g_warning("%s: %u of %u messages sent to Pulse: %s", __FUNCTION__,
+                      (unsigned) (sent / SIZE_MESG_TO_PULSE),
+                      (unsigned) (size / SIZE_MESG_TO_PULSE), strerror(errno));
+        break;
+    }
+    return sent / SIZE_MESG_TO_PULSE;
+}
+
 bool PulseAudioMixer::programVolume (EVirtualSink sink, int volume, bool ramp)
+{
+    if (IsValidVirtualSink(sink) && mRamps[sink].mStart)
+    {
+        // the same target is programmed again & again while ramping
+        if (mRamps[sink].mTo == volume)
+            return true;
+        cancelRamp(sink);
+    }
+
+    return setVolume(sink, volume, ramp);
+}
+
+bool PulseAudioMixer::setVolume (EVirtualSink sink, int volume, bool ramp)
 {
     if (volume && !isNeverMutedSink(sink) &&
         mPulseStateActiveStreamCount[sink] <= 0)
@@ -386,6 +818,131 @@ bool PulseAudioMixer::programVolume (EVirtualSink sink, int volume, bool ramp)
     return programSource ( (ramp ? 'r' : 'v'), sink, volume);
 }
 
+/// Ramps are stepped that often at most, in ms
+static const int cRampStepInterval = 20;
+
+static gboolean
+_rampStep(gpointer data)
+{
+    return gPulseAudioMixer._rampStep();
+}
+
+static char
+_rampCurveCode(ERampCurve curve)
+{
+    switch (curve)
+    {
+    case eRampCurve_Linear:     return 'l';
+    case eRampCurve_dBLinear:   return 'd';
+    case eRampCurve_SCurve:     return 's';
+    }
+    return '?';
+}
+
+int PulseAudioMixer::rampVolumeAt (const VolumeRamp & ramp, gint64 now)
+{
+    gint64 elapsed = now - ramp.mStart;
+    if (elapsed >= (gint64) ramp.mDuration * 1000)
+        return ramp.mTo;
+
+    double x = elapsed > 0 ? elapsed / (ramp.mDuration * 1000.) : 0.;
+    if (ramp.mCurve == eRampCurve_Linear)
+        return ramp.mFrom + (int) ((ramp.mTo - ramp.mFrom) * x + (ramp.mTo > ramp.mFrom ? .5 : -.5));
+
+    if (ramp.mCurve == eRampCurve_SCurve)
+        x = x * x * (3. - 2. * x);
+
+    // Pulse's tables map percents to its volumes, which are linear in dB
+    int tableIndex = gAudioDevice.getHeadsetState() != eHeadsetState_None ? 1 : 0;
+    const int * table = _mapPercentToPulseVolume[tableIndex];
+    double target = table[ramp.mFrom] + (table[ramp.mTo] - table[ramp.mFrom]) * x;
+    int percent = std::lower_bound(table, table + 101, (int) target) - table;
+    if (percent > 100)
+        percent = 100;
+    // stay within the ramp's range, so that it never overshoots
+    return ramp.mTo > ramp.mFrom ? CLAMP(percent, ramp.mFrom, ramp.mTo) :
+                                   CLAMP(percent, ramp.mTo, ramp.mFrom);
+}
+
+bool PulseAudioMixer::rampVolume (EVirtualSink sink, int endVolume,
+                                  int duration, ERampCurve curve)
+{
+    if (!VERIFY(IsValidVirtualSink(sink)) || !VERIFY(endVolume >= 0 && endVolume <= 100))
+        return false;
+
+    VolumeRamp & ramp = mRamps[sink];
+    if (ramp.mStart && ramp.mTo == endVolume)
+        return true;    // already on its way
+
+    gint64 now = g_get_monotonic_time();
+    // retarget from where the ramp in flight is, or from what Pulse has
+    int from = ramp.mStart ? rampVolumeAt(ramp, now) : mPulseStateVolume[sink];
+
+    // nothing to ramp from, or nobody to hear it
+    if (duration <= 0 || from < 0 || from > 100 || from == endVolume || NULL == mChannel ||
+        (!isNeverMutedSink(sink) && mPulseStateActiveStreamCount[sink] <= 0))
+    {
+        cancelRamp(sink);
+        return setVolume(sink, endVolume, false);
+    }
+
+    g_debug("%s: %s %i -> %i in %i ms (%c)", __FUNCTION__, virtualSinkName(sink),
+                                 from, endVolume, duration, _rampCurveCode(curve));
+    traceEvent(eTrace_VolumeRamp, _rampCurveCode(curve), 0, sink, endVolume, duration);
+
+    if (!ramp.mStart)
+        ++mActiveRamps;
+    ramp.mStart = now;
+    ramp.mDuration = duration;
+    ramp.mFrom = from;
+    ramp.mTo = endVolume;
+    ramp.mCurve = curve;
+
+    if (!mRampSourceID)
+        mRampSourceID = g_timeout_add(cRampStepInterval, ::_rampStep, NULL);
+    return true;
+}
+
+void PulseAudioMixer::cancelRamp (EVirtualSink sink)
+{
+    if (!IsValidVirtualSink(sink) || !mRamps[sink].mStart)
+        return;
+
+    traceEvent(eTrace_VolumeRamp, 'x', 0, sink, mPulseStateVolume[sink]);
+    mRamps[sink].mStart = 0;
+    if (--mActiveRamps == 0 && mRampSourceID)
+    {
+        g_source_remove(mRampSourceID);
+        mRampSourceID = 0;
+    }
+}
+
+bool PulseAudioMixer::_rampStep ()
+{
+    gint64 now = g_get_monotonic_time();
+    for (EVirtualSink sink = eVirtualSink_First;
+         sink <= eVirtualSink_Last;
+         sink = EVirtualSink(sink + 1))
+    {
+        VolumeRamp & ramp = mRamps[sink];
+        if (!ramp.mStart)
+            continue;
+
+        // unchanged steps aren't sent again
+        setVolume(sink, rampVolumeAt(ramp, now), false);
+        if (now - ramp.mStart >= (gint64) ramp.mDuration * 1000 || NULL == mChannel)
+        {
+            ramp.mStart = 0;
+            --mActiveRamps;
+        }
+    }
+
+    if (mActiveRamps > 0)
+        return TRUE;
+    mRampSourceID = 0;
+    return FALSE;
+}
+
 bool PulseAudioMixer::programCallVoiceOrMICVolume (char cmd, int volume)
 {
     return programSource ( cmd, eVirtualSink_None, volume);
@@ -403,6 +960,58 @@ bool PulseAudioMixer::programDestination (EVirtualSink sink,
     return programSource ('d', sink, destination);
 }
 
+bool PulseAudioMixer::programDestinations (const int * sinkDestinations,
+                                           const int * sourceDestinations)
+{
+    if (NULL == mChannel)
+        return false;
+
+    EHeadsetState headset = gAudioDevice.getHeadsetState();
+    char batch[(eVirtualSink_Count + eVirtualSource_Count) * SIZE_MESG_TO_PULSE];
+    // what each message routes, committed once sent
+    int * routes[eVirtualSink_Count + eVirtualSource_Count];
+    int destinations[eVirtualSink_Count + eVirtualSource_Count];
+    size_t count = 0;
+
+    memset(batch, 0, sizeof(batch));
+    for (int sink = eVirtualSink_First; sink <= eVirtualSink_Last; ++sink)
+    {
+        int destination = sinkDestinations[sink];
+        if (destination < 0 || mPulseStateRoute[sink] == destination)
+            continue;
+        char * message = batch + count * SIZE_MESG_TO_PULSE;
+        snprintf(message, SIZE_MESG_TO_PULSE, "d %i %i %i", sink, destination, headset);
+        g_debug ("%s: sending message '%s' %s", __FUNCTION__, message,
+                                            virtualSinkName((EVirtualSink)sink));
+        traceEvent(eTrace_ProgramSource, 'd', 0, sink, destination);
+        routes[count] = &mPulseStateRoute[sink];
+        destinations[count++] = destination;
+    }
+    for (int source = eVirtualSource_First; source <= eVirtualSource_Last; ++source)
+    {
+        int destination = sourceDestinations[source];
+        if (destination < 0 || mPulseStateSourceRoute[source] == destination)
+            continue;
+        char * message = batch + count * SIZE_MESG_TO_PULSE;
+        snprintf(message, SIZE_MESG_TO_PULSE, "e %i %i %i", source, destination, headset);
+        g_debug ("%s: sending message '%s' %s", __FUNCTION__, message,
+                                     virtualSourceName((EVirtualSource)source));
+        traceEvent(eTrace_ProgramSource, 'e', 0, source, destination);
+        routes[count] = &mPulseStateSourceRoute[source];
+        destinations[count++] = destination;
+    }
+
+    if (count == 0)
+        return true;
+
+    // routes not sent stay as they were, to be sent by the next diff
+    size_t sent = sendToPulse(batch, count * SIZE_MESG_TO_PULSE);
+    for (size_t i = 0; i < sent; ++i)
+        *routes[i] = destinations[i];
+
+    return sent == count;
+}
+
 void PulseAudioMixer::sendNREC(bool value)
 {
 
@@ -802,7 +1411,7 @@ bool PulseAudioMixer::setPhoneMuted(const ConstString & scenario, bool muted)
         return programCallVoiceOrMICVolume('c', mPreviousVolume);
 }
 
-bool PulseAudioMixer::setRouting(const ConstString & scenario){
+bool PulseAudioMixer::setRouting(const GenericScenario & scenario){
     char cmd = 'C';
     char buffer[SIZE_MESG_TO_PULSE] ;
     bool ret  = false;
@@ -819,11 +1428,13 @@ bool PulseAudioMixer::setRouting(const ConstString & scenario){
         return ret;
     }
 
-    g_message ("PulseAudioMixer::setRouting: sceanrio = %s", scenario.c_str());
-    if (scenario.hasPrefix(PHONE_, tail)) {
+    g_message ("PulseAudioMixer::setRouting: sceanrio = %s", scenario.getName());
+    if (scenario.isClass(eScenarioClass_Phone)) {
+        tail = ConstString(scenario.getName() + strlen(PHONE_));
      g_message ("PulseAudioMixer::setRouting: phone device = %s", tail.c_str());
         cmd = 'P';
-    } else if (scenario.hasPrefix(MEDIA_, tail)) {
+    } else if (scenario.isClass(eScenarioClass_Media)) {
+        tail = ConstString(scenario.getName() + strlen(MEDIA_));
         g_message ("PulseAudioMixer::setRouting: media device = %s", tail.c_str());
         cmd = 'Q';
     }
@@ -892,6 +1503,11 @@ bool PulseAudioMixer::programLatency (int latency)
 
 bool PulseAudioMixer::muteAll ()
 {
+    for (EVirtualSink sink = eVirtualSink_First;
+         sink <= eVirtualSink_Last;
+         sink = EVirtualSink(sink + 1))
+        cancelRamp(sink);
+
     for (EVirtualSink sink = eVirtualSink_First;
          sink <= eVirtualSink_Last;
          sink = EVirtualSink(sink + 1))
@@ -933,10 +1549,12 @@ PulseAudioMixer::_connectSocket ()
     strncpy (&name.sun_path[1], PALMAUDIO_SOCK_NAME, length);
 
     mConnectAttempt++;
+    StartupPhase    phase("PulseAudioMixer::connectSocket");
 
     int sockfd = -1;
 
-    if (-1 == (sockfd = socket(AF_UNIX, SOCK_STREAM, 0)))
+    // never block the main loop in connect() if Pulse is busy starting up
+    if (-1 == (sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)))
     {
         g_warning ("%s: socket error '%s' on fd (%i)",__FUNCTION__, strerror(errno), sockfd);
         sockfd = -1;
@@ -958,35 +1576,31 @@ PulseAudioMixer::_connectSocket ()
         return false;
     }
 
+    // back to blocking mode, which the rest of the protocol expects
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) & ~O_NONBLOCK);
+
     g_message ("%s: successfully connected to Pulse on attempt #%i",\
                                                               __FUNCTION__,
                                                                mConnectAttempt);
+    startupMark("pulse socket connected");
     mConnectAttempt = 0;
+    mTimeout = cMinTimeout;
 
-    // initialize table for the pulse state lookup table
+    // Stream counts are Pulse's to report again, but routing, volume &
+    // filter tables are kept: they are what was last committed to Pulse
+    // & will be replayed at once below.
     for (EVirtualSink sink = eVirtualSink_First;
          sink <= eVirtualSink_Last;
          sink = EVirtualSink(sink + 1))
     {
-        mPulseStateVolume[sink] = -1;
-        mPulseStateVolumeHeadset[sink] = -1;
-        mPulseStateRoute[sink] = -1;
         while (mPulseStateActiveStreamCount[sink] > 0)
             outputStreamClosed(sink);
         mPulseStateActiveStreamCount[sink] = 0;    // shouldn't be necessary
     }
-
-    EVirtualSource source;
-    for (source = eVirtualSource_First;
-           source <= eVirtualSource_Last;
-           source = EVirtualSource(source + 1))
-    {
-        mPulseStateSourceRoute[source] = -1;
-    }
     mActiveStreams.clear();
-    mPulseStateFilter = 0;
-    mPulseStateLatency = SCENARIO_DEFAULT_LATENCY;
 
+    // not a real source, so that each call counts as one closed stream
+    EVirtualSource source = EVirtualSource(eVirtualSource_Last + 1);
     // Reuse the counting logic above rather than just reset the counters,
     // to preserve closing behavior without re-implementing it
     while (mInputStreamsCurrentlyOpenedCount > 0)
@@ -999,20 +1613,100 @@ PulseAudioMixer::_connectSocket ()
 
     mSourceID = g_io_add_watch (mChannel, condition, ::_pulseStatus, NULL);
 
-    // Let audiod know that we now have a connection, so that the mixer can be programmed
+    replayCommittedState();
+
+    // Let audiod know that we now have a connection, so that the mixer can be programmed.
+    // Only what changed since the replay above will actually be sent.
     if (VERIFY(mCallbacks))
         mCallbacks->onAudioMixerConnected();
 
     // We've just established our direct socket link to Pulse.
-    // It's a good time to see if we can connect using the Pulse APIs
-    if (!mPulseLink.checkConnection()) {
-        g_message("Pulseaudio is not running");
-        return false;
-    }
+    // It's a good time to connect using the Pulse APIs, in the background.
+    mPulseLink.reconnect();
 
     return true;
 }
 
+static void
+appendPulseCommand (std::string & batch, char cmd, int sink, int value, int headset)
+{
+    char buffer[SIZE_MESG_TO_PULSE];
+
+    memset(buffer, 0, sizeof(buffer));
+    snprintf(buffer, sizeof(buffer), "%c %i %i %i", cmd, sink, value, headset);
+    batch.append(buffer, SIZE_MESG_TO_PULSE);
+}
+
+void PulseAudioMixer::replayCommittedState()
+{
+    EHeadsetState headset = gAudioDevice.getHeadsetState();
+    std::string batch;
+
+    for (EVirtualSink sink = eVirtualSink_First;
+         sink <= eVirtualSink_Last;
+         sink = EVirtualSink(sink + 1))
+    {
+        if (mPulseStateRoute[sink] >= 0)
+            appendPulseCommand(batch, 'd', sink, mPulseStateRoute[sink], headset);
+        if (mPulseStateVolume[sink] >= 0)
+        {
+            appendPulseCommand(batch, 'v', sink, mPulseStateVolume[sink], headset);
+            mPulseStateVolumeHeadset[sink] = headset;
+        }
+    }
+
+    for (EVirtualSource source = eVirtualSource_First;
+         source <= eVirtualSource_Last;
+         source = EVirtualSource(source + 1))
+    {
+        if (mPulseStateSourceRoute[source] >= 0)
+            appendPulseCommand(batch, 'e', source, mPulseStateSourceRoute[source], headset);
+    }
+
+    if (mPulseStateFilter != 0)
+        appendPulseCommand(batch, 'f', 0, mPulseFilterEnabled ? mPulseStateFilter : 0, headset);
+    if (mPulseStateLatency > 0 && mPulseStateLatency != SCENARIO_DEFAULT_LATENCY)
+        appendPulseCommand(batch, 'l', 0, mPulseStateLatency, headset);
+
+    if (batch.empty())
+        return;
+
+    // one write for the whole batch, Pulse reads fixed size records
+    size_t count = batch.size() / SIZE_MESG_TO_PULSE;
+    if (sendToPulse(batch.data(), batch.size()) != count)
+    {
+        g_warning("%s: replay to Pulse incomplete", __FUNCTION__);
+        // forget what Pulse may not have, so that it is programmed again
+        resetCommittedState();
+    }
+    else
+    {
+        g_message("%s: replayed %u commands to Pulse", __FUNCTION__,
+                                (unsigned) (batch.size() / SIZE_MESG_TO_PULSE));
+    }
+}
+
+void PulseAudioMixer::resetCommittedState()
+{
+    for (EVirtualSink sink = eVirtualSink_First;
+         sink <= eVirtualSink_Last;
+         sink = EVirtualSink(sink + 1))
+    {
+        mPulseStateVolume[sink] = -1;
+        mPulseStateVolumeHeadset[sink] = -1;
+        mPulseStateRoute[sink] = -1;
+    }
+
+    for (EVirtualSource source = eVirtualSource_First;
+         source <= eVirtualSource_Last;
+         source = EVirtualSource(source + 1))
+    {
+        mPulseStateSourceRoute[source] = -1;
+    }
+    mPulseStateFilter = 0;
+    mPulseStateLatency = SCENARIO_DEFAULT_LATENCY;
+}
+
 static gboolean
 _timer (gpointer data)
 {
@@ -1024,10 +1718,7 @@ void PulseAudioMixer::_timer()
 {
     if (!_connectSocket())
     {
-        g_timeout_add (mTimeout, ::_timer, 0);
-        mTimeout *= 2;
-        if (mTimeout > cMaxTimeout)
-            mTimeout = cMinTimeout;
+        g_timeout_add (nextBackoffDelay(mTimeout, cMaxTimeout), ::_timer, 0);
     }
 }
 
@@ -1072,6 +1763,11 @@ PulseAudioMixer::openCloseSink (EVirtualSink sink, bool openNotClose)
 
     if (oldstreamflags != mActiveStreams)
     {
+        if (cSinkEventsCoalescingDelay >= 0)
+        {
+            queueSinkEvent(sink, openNotClose);
+            return;
+        }
         EControlEvent event = openNotClose ? eControlEvent_FirstStreamOpened :
                                            eControlEvent_LastStreamClosed;
         if (mCallbacks)
@@ -1081,6 +1777,64 @@ PulseAudioMixer::openCloseSink (EVirtualSink sink, bool openNotClose)
     }
 }
 
+static gboolean
+_sinkEvents(gpointer data)
+{
+    gPulseAudioMixer._flushSinkEvents();
+    return FALSE;
+}
+
+void
+PulseAudioMixer::queueSinkEvent (EVirtualSink sink, bool openNotClose)
+{
+    if (!mSinkEventsPending)
+    {
+        mSinkEventsPending = true;
+        mSinkEventsUrgent = false;
+        // mActiveStreams already includes this event
+        mReportedStreams = mActiveStreams;
+        if (openNotClose)
+            mReportedStreams.remove(sink);
+        else
+            mReportedStreams.add(sink);
+    }
+
+    // High latency sinks are muted until their module sets their volume:
+    // opening them can't wait. The rest can, a little.
+    bool urgent = openNotClose && !isNeverMutedSink(sink);
+    if (mSinkEventsSourceID && (mSinkEventsUrgent || !urgent))
+        return;
+
+    if (mSinkEventsSourceID)
+        g_source_remove(mSinkEventsSourceID);
+    mSinkEventsUrgent = urgent;
+    // Pulse messages are dispatched before idle sources, so an idle source
+    // collects whatever is already waiting on the socket.
+    if (urgent || cSinkEventsCoalescingDelay == 0)
+        mSinkEventsSourceID = g_idle_add(_sinkEvents, NULL);
+    else
+        mSinkEventsSourceID = g_timeout_add(cSinkEventsCoalescingDelay,
+                                            _sinkEvents, NULL);
+}
+
+void
+PulseAudioMixer::_flushSinkEvents ()
+{
+    mSinkEventsSourceID = 0;
+    if (!mSinkEventsPending)
+        return;
+    mSinkEventsPending = false;
+
+    if (mReportedStreams == mActiveStreams)
+    {
+        g_debug("%s: sink events cancelled each other out", __FUNCTION__);
+        return;
+    }
+
+    if (mCallbacks)
+        mCallbacks->onActiveSinksChanged(mReportedStreams, mActiveStreams, ePulseAudio);
+}
+
 #define LOG_LEVEL_SINK(sink) \
   ((sink == eDTMF || sink == efeedback || sink == eeffects) ? \
    G_LOG_LEVEL_INFO : G_LOG_LEVEL_MESSAGE)
@@ -1107,6 +1861,7 @@ PulseAudioMixer::_pulseStatus(GIOChannel *ch,
         {
             g_debug("PulseAudioMixer::_pulseStatus: Pulse says: '%c %i %i'",\
                                   cmd, isink, info);
+            traceEvent(eTrace_PulseStatus, cmd, 0, isink, info);
             EVirtualSink sink = EVirtualSink(isink);
                 EVirtualSource source = EVirtualSource(isink);
             switch (cmd)
@@ -1518,16 +2273,46 @@ void  PulseAudioMixer::playOneshotDtmf(const char *snd, EVirtualSink sink)
     playOneshotDtmf(snd, virtualSinkName(sink, false));
 }
 
+bool PulseAudioMixer::reuseDtmf(const char * sink)
+{
+    return mCurrentDtmf && mCurrentDtmfSink && strcmp(mCurrentDtmfSink, sink) == 0 &&
+                               mCurrentDtmfConnection == mPulseLink.connectionId();
+}
+
+void PulseAudioMixer::newDtmf(const char * sink)
+{
+    if (mCurrentDtmf) {
+        mCurrentDtmf->stopping();
+        mCurrentDtmf->unref();
+    }
+    mCurrentDtmf = new PulseDtmfSequence(SHORT_DTMF_LENGTH, DTMF_GAP_LENGTH,
+                                                           DTMF_LINGER_LENGTH);
+    mCurrentDtmfSink = sink;
+    mCurrentDtmfConnection = mPulseLink.connectionId();
+}
+
+bool PulseAudioMixer::startDtmf(const char * sink)
+{
+    if (mPulseLink.play(mCurrentDtmf, sink))
+        return true;
+    mCurrentDtmf->unref();
+    mCurrentDtmf = NULL;
+    return false;
+}
+
 void  PulseAudioMixer::playOneshotDtmf(const char *snd, const char* sink)
 {
     PMTRACE_FUNCTION;
     g_message("PulseAudioMixer::playOneshotDtmf");
-    int tone;
-    if ((tone=IdToDtmf(snd))<0) return;
-    if (mCurrentDtmf) stopDtmf();
-    mCurrentDtmf = new PulseDtmfGenerator((Dtmf)tone, SHORT_DTMF_LENGTH);
+    if (IdToDtmf(snd)<0) return;
+    traceEvent(eTrace_DtmfStart, snd[0], 0, false);
     gAudioDevice.prepareHWForPlayback();
-    mPulseLink.play(mCurrentDtmf, sink);
+    // the whole string is played, in the stream already open if any
+    if (reuseDtmf(sink) && mCurrentDtmf->append(snd))
+        return;
+    newDtmf(sink);
+    mCurrentDtmf->append(snd);
+    startDtmf(sink);
 }
 
 void  PulseAudioMixer::playDtmf(const char *snd, EVirtualSink sink)
@@ -1539,21 +2324,22 @@ void  PulseAudioMixer::playDtmf(const char *snd, EVirtualSink sink)
 
 void  PulseAudioMixer::playDtmf(const char *snd, const char* sink) {
     g_message("PulseAudioMixer::playDtmf");
-    int tone;
-    if ((tone=IdToDtmf(snd))<0) return;
-    if (mCurrentDtmf && tone==mCurrentDtmf->getTone()) return;
-    stopDtmf();
-    mCurrentDtmf = new PulseDtmfGenerator((Dtmf)tone, 0);
+    if (IdToDtmf(snd)<0) return;
+    traceEvent(eTrace_DtmfStart, snd[0], 0, true);
     gAudioDevice.prepareForPlayback();
-    mPulseLink.play(mCurrentDtmf, sink);
+    if (reuseDtmf(sink) && mCurrentDtmf->hold(snd[0]))
+        return;
+    newDtmf(sink);
+    mCurrentDtmf->hold(snd[0]);
+    startDtmf(sink);
 }
 
 void PulseAudioMixer::stopDtmf() {
     if (mCurrentDtmf) {
         g_message("PulseAudioMixer::stopDtmf");
-        mCurrentDtmf->stopping();
-        mCurrentDtmf->unref();
-        mCurrentDtmf = NULL;
+        traceEvent(eTrace_DtmfStop);
+        // the stream stays open a little while, for the next tones
+        mCurrentDtmf->release();
     }
 }
 
@@ -33,6 +33,15 @@ public:
     PulseAudioMixer();
     ~PulseAudioMixer();
 
+    /// Built-in unit test of the volume computations: Returns true on success.
+    static bool         UnitTest();
+
+#ifdef AUDIOD_SIMULATOR
+    /// Time the sink & source name lookups against the linear scans they
+    /// replaced, checking that both agree on every name: true on success.
+    static bool         BenchmarkNameLookups(int rounds);
+#endif
+
     /// Initialize mixer & possibly, register services
     void                init(GMainLoop * loop,
                              LSHandle * handle,
@@ -52,10 +61,18 @@ public:
     bool  rampVolume(EVirtualSink sink, int endVolume)
                        { return programVolume(sink, endVolume, true); }
 
+    /// Ramp stepped by audiod, as Pulse only knows its own fixed ramp
+    bool  rampVolume(EVirtualSink sink, int endVolume,
+                     int duration, ERampCurve curve);
+    void  cancelRamp(EVirtualSink sink);
+
     /// Program destination of a sink
     bool programDestination(EVirtualSink sink, EPhysicalSink destination);
     /// Program destination of a source
     bool programDestination(EVirtualSource source, EPhysicalSource destination);
+    /// Program destinations of all sinks & sources, in one message batch
+    bool programDestinations(const int * sinkDestinations,
+                             const int * sourceDestinations);
 
     /// Program a filter
     bool                programFilter(int filterTable);
@@ -126,6 +143,8 @@ public:
                                      GIOCondition condition,
                                      gpointer user_data);
     void                _timer();
+    void                _flushSinkEvents();
+    bool                _rampStep();
     bool                _sinkStatus(LSHandle *lshandle, LSMessage *message);
     bool                _setFilter(LSHandle * lshandle, LSMessage * message);
     bool                _suspend(LSHandle * lshandle, LSMessage * message);
@@ -141,7 +160,7 @@ public:
     void sendNREC(bool value);
     bool programLoadBluetooth (const char * address , const char *profile);
     bool programUnloadBluetooth (const char *profile);
-    bool setRouting(const ConstString & scenario);
+    bool setRouting(const GenericScenario & scenario);
     bool phoneEvent(EPhoneEvent event, int parameter);
     bool getBTVolumeSupport();
     void setBTDeviceType(int type);
@@ -155,8 +174,21 @@ public:
 
 private:
     bool                programSource(char cmd, int sink, int value);
+    /// programVolume, leaving ramps alone
+    bool                setVolume(EVirtualSink sink, int volume, bool ramp);
+    /// Returns how many whole messages were sent
+    size_t              sendToPulse(const char * data, size_t size);
     void                openCloseSink(EVirtualSink sink, bool openNotClose);
+    /// Hold a sink event back, to report it with the rest of its burst
+    void                queueSinkEvent(EVirtualSink sink, bool openNotClose);
     int                    getCurrentPulseVolume(EVirtualSink sink);// get Pulse volume
+    bool                reuseDtmf(const char * sink);
+    void                newDtmf(const char * sink);
+    bool                startDtmf(const char * sink);
+    /// Send the routing, volume & filter state last committed, in one batch
+    void                replayCommittedState();
+    /// Forget what was committed, so that everything is sent again
+    void                resetCommittedState();
 
     // Direct socket connection to Pulse
     int                    mTimeout;
@@ -165,14 +197,36 @@ private:
 
     // Connection to Pulse via official Pulse APIs
     PulseAudioLink        mPulseLink;
-    PulseDtmfGenerator* mCurrentDtmf;
+    PulseDtmfSequence*  mCurrentDtmf;
+    const char *        mCurrentDtmfSink;
+    unsigned int        mCurrentDtmfConnection;
 
     VirtualSinkSet        mActiveStreams;
+    /// Active sinks last reported to mCallbacks, while events are held back
+    VirtualSinkSet        mReportedStreams;
+    bool                  mSinkEventsPending;
+    bool                  mSinkEventsUrgent;
+    guint                 mSinkEventsSourceID;
     int                    mPulseStateVolume[eVirtualSink_Count];
     int                    mPulseStateVolumeHeadset[eVirtualSink_Count];
     int                    mPulseStateRoute[eVirtualSink_Count];
     int                    mPulseStateSourceRoute[eVirtualSource_Count];
     int                    mPulseStateActiveStreamCount[eVirtualSink_Count];
+
+    struct VolumeRamp
+    {
+        gint64      mStart;         // 0 when no ramp is in flight
+        int         mDuration;      // ms
+        int         mFrom;
+        int         mTo;
+        ERampCurve  mCurve;
+    };
+    /// Volume of a ramp at some point in time
+    int                    rampVolumeAt(const VolumeRamp & ramp, gint64 now);
+
+    VolumeRamp             mRamps[eVirtualSink_Count];
+    int                    mActiveRamps;
+    guint                  mRampSourceID;
     bool                 mPulseFilterEnabled;
     int                    mPulseStateFilter;
     int                    mPulseStateLatency;
@@ -195,5 +249,8 @@ private:
 
 extern PulseAudioMixer gPulseAudioMixer;
 
+/// SINK_EVENTS_COALESCING_DELAY, which the simulator's mixer follows too
+extern const int cSinkEventsCoalescingDelay;
+
 
 #endif /* PULSEAUDIOMIXER_H_ */
@@ -0,0 +1,235 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "soundCatalog.h"
+#include "utils.h"
+#include "log.h"
+
+static const char cSoundSuffix[] = "-ondemand.pcm";
+static const size_t cSoundSuffixLength = sizeof(cSoundSuffix) - 1;
+
+static const uint32_t cWatchedEvents = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                       IN_DELETE | IN_ATTRIB |
+                                       IN_DELETE_SELF | IN_MOVE_SELF;
+
+SoundCatalog gSoundCatalog(SYSTEMSOUNDS_PATH);
+
+SoundCatalog::SoundCatalog(const char * directory) :
+    mDirectory(directory), mInotifyFd(-1), mWatchSourceID(0)
+{
+}
+
+static gboolean
+_soundCatalogEvent(GIOChannel * ch, GIOCondition condition, gpointer user_data)
+{
+    gSoundCatalog._inotifyEvent();
+    return TRUE;
+}
+
+void SoundCatalog::start()
+{
+    if (mInotifyFd >= 0)
+        return;
+
+    // watch first, so that no change can be missed between the scan & the watch
+    mInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mInotifyFd < 0)
+    {
+        g_warning("%s: inotify unavailable (%s), sounds will be looked up on demand",
+                                                     __FUNCTION__, strerror(errno));
+        return;
+    }
+    if (inotify_add_watch(mInotifyFd, mDirectory.c_str(), cWatchedEvents) < 0)
+    {
+        g_warning("%s: can't watch '%s' (%s), sounds will be looked up on demand",
+                             __FUNCTION__, mDirectory.c_str(), strerror(errno));
+        close(mInotifyFd);
+        mInotifyFd = -1;
+        return;
+    }
+
+    GIOChannel * channel = g_io_channel_unix_new(mInotifyFd);
+    mWatchSourceID = g_io_add_watch(channel, G_IO_IN, _soundCatalogEvent, NULL);
+    g_io_channel_unref(channel);
+
+    scan();
+}
+
+void SoundCatalog::stopWatching()
+{
+    if (mWatchSourceID)
+    {
+        g_source_remove(mWatchSourceID);
+        mWatchSourceID = 0;
+    }
+    if (mInotifyFd >= 0)
+    {
+        close(mInotifyFd);
+        mInotifyFd = -1;
+    }
+}
+
+void SoundCatalog::scan()
+{
+    TSounds sounds;
+    GDir * dir = g_dir_open(mDirectory.c_str(), 0, NULL);
+    if (dir)
+    {
+        const gchar * fileName;
+        while ((fileName = g_dir_read_name(dir)) != NULL)
+        {
+            size_t length = strlen(fileName);
+            if (length <= cSoundSuffixLength ||
+                strcmp(fileName + length - cSoundSuffixLength, cSoundSuffix) != 0)
+                continue;
+
+            struct stat fileStat;
+            std::string filePath = mDirectory + fileName;
+            if (stat(filePath.c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode))
+            {
+                std::string name(fileName, length - cSoundSuffixLength);
+                Sound & sound = sounds[name];
+                sound.mSize = fileStat.st_size;
+                // unchanged sounds are still in Pulse
+                TSounds::iterator old = mSounds.find(name);
+                sound.mPreloaded = old != mSounds.end() && old->second.mPreloaded &&
+                                                  old->second.mSize == sound.mSize;
+            }
+        }
+        g_dir_close(dir);
+    }
+    mSounds.swap(sounds);
+
+    g_debug("%s: %u sound(s) in '%s'", __FUNCTION__,
+                            (unsigned) mSounds.size(), mDirectory.c_str());
+}
+
+void SoundCatalog::update(const char * fileName, bool contentChanged)
+{
+    size_t length = strlen(fileName);
+    if (length <= cSoundSuffixLength ||
+        strcmp(fileName + length - cSoundSuffixLength, cSoundSuffix) != 0)
+        return;
+
+    std::string name(fileName, length - cSoundSuffixLength);
+    std::string filePath = mDirectory + fileName;
+    struct stat fileStat;
+    if (stat(filePath.c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode))
+    {
+        TSounds::iterator old = mSounds.find(name);
+        bool preloaded = !contentChanged && old != mSounds.end() &&
+                      old->second.mPreloaded && old->second.mSize == (size_t) fileStat.st_size;
+        Sound & sound = mSounds[name];
+        sound.mSize = fileStat.st_size;
+        sound.mPreloaded = preloaded;    // new content needs another upload
+    }
+    else
+    {
+        mSounds.erase(name);
+    }
+}
+
+void SoundCatalog::_inotifyEvent()
+{
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool rescan = false;
+    bool lost = false;
+
+    for (;;)
+    {
+        ssize_t length = read(mInotifyFd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+
+        for (char * ptr = buffer; ptr < buffer + length; )
+        {
+            const struct inotify_event * event = (const struct inotify_event *) ptr;
+            if (event->mask & IN_Q_OVERFLOW)
+                rescan = true;
+            else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                lost = true;
+            else if (event->len > 0)
+                update(event->name, event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO));
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    if (lost)
+    {
+        g_warning("%s: '%s' went away, sounds will be looked up on demand",
+                                              __FUNCTION__, mDirectory.c_str());
+        stopWatching();
+        mSounds.clear();
+    }
+    else if (rescan)
+    {
+        scan();
+    }
+}
+
+bool SoundCatalog::find(const char * name, size_t * size)
+{
+    // not watching: the catalog can't be trusted, check the file itself
+    if (mInotifyFd < 0)
+        update((std::string(name) + cSoundSuffix).c_str(), false);
+
+    TSounds::iterator iter = mSounds.find(name);
+    if (iter == mSounds.end())
+        return false;
+
+    if (size)
+        *size = iter->second.mSize;
+    return true;
+}
+
+std::string SoundCatalog::path(const char * name) const
+{
+    return mDirectory + name + cSoundSuffix;
+}
+
+bool SoundCatalog::isPreloaded(const char * name)
+{
+    TSounds::iterator iter = mSounds.find(name);
+    return iter != mSounds.end() && iter->second.mPreloaded;
+}
+
+void SoundCatalog::setPreloaded(const char * name, bool preloaded)
+{
+    TSounds::iterator iter = mSounds.find(name);
+    if (iter != mSounds.end())
+        iter->second.mPreloaded = preloaded;
+}
+
+void SoundCatalog::clearPreloaded()
+{
+    for (TSounds::iterator iter = mSounds.begin(); iter != mSounds.end(); ++iter)
+        iter->second.mPreloaded = false;
+}
+
+static int
+SoundCatalogInit(void)
+{
+    gSoundCatalog.start();
+    return 0;
+}
+
+INIT_FUNC (SoundCatalogInit);
@@ -0,0 +1,73 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _SOUNDCATALOG_H_
+#define _SOUNDCATALOG_H_
+
+#include <glib.h>
+#include <map>
+#include <string>
+
+/// In-memory index of the on-demand system sounds, the
+/// "<name>-ondemand.pcm" files of SYSTEMSOUNDS_PATH.
+/// The directory is scanned once, then kept up to date with inotify,
+/// so that playing a sound doesn't need to probe the file system.
+/// All sounds are raw 44.1kHz mono S16LE, so only their size is kept.
+/// Main thread only.
+class SoundCatalog
+{
+public:
+    SoundCatalog(const char * directory);
+
+    /// Scan the directory & start watching it
+    void    start();
+
+    /// Is there a sound by that name? If so, get its size in bytes
+    bool    find(const char * name, size_t * size = 0);
+
+    /// Full path of a sound's file
+    std::string path(const char * name) const;
+
+    /// Sample upload state in Pulse, forgotten when the file changes
+    bool    isPreloaded(const char * name);
+    void    setPreloaded(const char * name, bool preloaded);
+    /// Pulse lost all its samples
+    void    clearPreloaded();
+
+    /// For private use only. Public because global callbacks need them...
+    void    _inotifyEvent();
+
+private:
+    struct Sound
+    {
+        size_t  mSize;
+        bool    mPreloaded;
+    };
+    typedef std::map<std::string, Sound> TSounds;
+
+    void    scan();
+    void    update(const char * fileName, bool contentChanged);
+    void    stopWatching();
+
+    std::string mDirectory;
+    TSounds     mSounds;
+    int         mInotifyFd;
+    guint       mWatchSourceID;
+};
+
+extern SoundCatalog gSoundCatalog;
+
+#endif // _SOUNDCATALOG_H_
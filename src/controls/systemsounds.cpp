@@ -30,6 +30,7 @@
 #include "log.h"
 #include "vibrate.h"
 #include "main.h"
+#include "soundCatalog.h"
 
 static bool
 _playFeedback(LSHandle *lshandle, LSMessage *message, void *ctx)
@@ -47,8 +48,6 @@ _playFeedback(LSHandle *lshandle, LSMessage *message, void *ctx)
     std::string    name, sinkName;
     bool bPlay = true;
     bool bOverride = false;
-    char *filename = NULL;
-    FILE *fp = NULL;
 
     if (gAudioDevice.isSuspended()) {
         reply = STANDARD_JSON_ERROR(4, "Audio suspended");
@@ -70,28 +69,12 @@ _playFeedback(LSHandle *lshandle, LSMessage *message, void *ctx)
             goto error;
         }
     }
-    size_t size ;
-    size = strlen(SYSTEMSOUNDS_PATH) + strlen(name.c_str()) + strlen("-ondemand.pcm")+ 1;
-    filename = (char *)malloc( size );
-    if (filename == NULL) {
-         reply = STANDARD_JSON_ERROR(4, "Unable to allocate memory");
-         goto error;
-    }
-    snprintf(filename, size, SYSTEMSOUNDS_PATH "%s-ondemand.pcm", name.c_str());
-    g_debug("complete file name to playback = %s\n", filename);
-
-    fp = fopen(filename, "r");
-    free(filename);
-    filename= NULL;
-    if (!fp){
-         g_debug("Error : %s : file open failed. returning from here\n", __FUNCTION__);
+    if (!gSoundCatalog.find(name.c_str()))
+    {
+         g_debug("Error : %s : no sound named '%s'\n", __FUNCTION__, name.c_str());
          reply = INVALID_PARAMETER_ERROR(name, string);
          goto error;
     }
-    else{
-         fclose(fp);
-         fp = NULL;
-    }
 
     // if "play" is false, pre-load the sound & do nothing else
     if (!msg.get("play", bPlay))
@@ -25,6 +25,7 @@
 #include "messageUtils.h"
 #include <errno.h>
 #include "main.h"
+#include "soundCatalog.h"
 
 static bool
 _playCallertone(LSHandle *lshandle, LSMessage *message, void *ctx)
@@ -36,8 +37,6 @@ _playCallertone(LSHandle *lshandle, LSMessage *message, void *ctx)
     const gchar *reply = STANDARD_JSON_SUCCESS;
     EVirtualSink sink = ecallertone;
     std::string name;
-    char *fileName = NULL;
-    int fileExist;
 
     if (!msg.get("name", name)) {
         reply = MISSING_PARAMETER_ERROR(name, string);
@@ -47,21 +46,8 @@ _playCallertone(LSHandle *lshandle, LSMessage *message, void *ctx)
     for(std::string::size_type i = 0; i < name.length(); ++i)
         name[i] = std::tolower(name[i]);
 
-    size_t size ;
-    size = strlen(SYSTEMSOUNDS_PATH) + strlen(name.c_str()) + strlen("-ondemand.pcm") + 1 ;
-    fileName = (char *)calloc(1, size);
-    if (fileName == NULL) {
-        g_debug("Error : %s : unable to allocate memory\n", __FUNCTION__);
-        reply = INVALID_PARAMETER_ERROR(name, string);
-        goto error;
-    }
-    snprintf(fileName, size, SYSTEMSOUNDS_PATH "%s-ondemand.pcm", name.c_str());
-    fileExist = access(fileName, F_OK | R_OK);
-    free(fileName);
-    fileName = NULL;
-
-    if (fileExist) {
-        g_debug("Error : %s : file access failed.\n", __FUNCTION__);
+    if (!gSoundCatalog.find(name.c_str())) {
+        g_debug("Error : %s : no sound named '%s'\n", __FUNCTION__, name.c_str());
         reply = INVALID_PARAMETER_ERROR(name, string);
         goto error;
     }
@@ -0,0 +1,203 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <pbnjson/cxx/JDomParser.h>
+
+#include "duckingPolicy.h"
+#include "log.h"
+#include "genericScenarioModule.h"
+
+DuckingPolicy gDuckingPolicy;
+
+static const int cNavigationDuck = -18;     // dB
+static const int cAlertDuck = -12;          // dB
+static const int cDuckRamp = 250;           // ms
+
+DuckingPolicy::DuckingPolicy()
+{
+    setDefaults();
+}
+
+void DuckingPolicy::setDefaults()
+{
+    VirtualSinkSet navigation;
+    navigation.add(enavigation);
+
+    // alarms duck once audible: callers only report them as playing then
+    VirtualSinkSet alerts;
+    alerts.add(ealerts);
+    alerts.add(enotifications);
+    alerts.add(ecalendar);
+    alerts.add(eringtones);
+    alerts.add(evoicerecognition);
+    alerts.add(ealarm);
+
+    Rule rule;
+    mRules.clear();
+
+    // when navigation is playing, duck other media volumes
+    rule.mWhen = navigation;
+    rule.mTargets.clear();
+    rule.mTargets.add(emedia);
+    rule.mTargets.add(eflash);
+    rule.mTargets.add(edefaultapp);
+    rule.mDB = cNavigationDuck;
+    rule.mExceptWireless = false;
+    rule.mRampDuration = cDuckRamp;
+    rule.mRampCurve = eRampCurve_SCurve;
+    mRules.push_back(rule);
+
+    // when an alert is playing, duck media volumes not played on the same output
+    rule.mWhen = alerts;
+    rule.mTargets.clear();
+    rule.mTargets.add(edefaultapp);
+    rule.mDB = cAlertDuck;
+    mRules.push_back(rule);
+
+    rule.mTargets.clear();
+    rule.mTargets.add(emedia);
+    rule.mTargets.add(eflash);
+    rule.mTargets.add(enavigation);
+    rule.mExceptWireless = true;
+    mRules.push_back(rule);
+}
+
+static bool _parseCurve(const pbnjson::JValue & value, ERampCurve & curve)
+{
+    std::string name;
+    if (value.asString(name) != CONV_OK)
+        return false;
+    if (name == "linear")
+        curve = eRampCurve_Linear;
+    else if (name == "dB")
+        curve = eRampCurve_dBLinear;
+    else if (name == "s-curve")
+        curve = eRampCurve_SCurve;
+    else
+        return false;
+    return true;
+}
+
+static bool _parseSinks(const pbnjson::JValue & array, VirtualSinkSet & sinks)
+{
+    sinks.clear();
+    if (!array.isArray())
+        return false;
+    for (int i = 0; i < array.arraySize(); ++i)
+    {
+        std::string name;
+        EVirtualSink sink = eVirtualSink_None;
+        if (array[i].asString(name) == CONV_OK)
+            sink = getSinkByName(name.c_str());
+        if (!IsValidVirtualSink(sink))
+        {
+            g_warning("%s: unknown sink '%s'", __FUNCTION__, name.c_str());
+            return false;
+        }
+        sinks.add(sink);
+    }
+    return true;
+}
+
+bool DuckingPolicy::load(const char * path)
+{
+    pbnjson::JValue json = pbnjson::JDomParser::fromFile(path, pbnjson::JSchema::AllSchema());
+    if (!json.isValid() || !json.isObject())
+    {
+        g_debug("%s: no ducking policy in '%s', using defaults", __FUNCTION__, path);
+        return false;
+    }
+
+    pbnjson::JValue array = json["duckingPolicy"];
+    if (!array.isArray())
+    {
+        g_warning("%s: no 'duckingPolicy' array in '%s'", __FUNCTION__, path);
+        return false;
+    }
+
+    std::vector<Rule> rules;
+    for (int i = 0; i < array.arraySize(); ++i)
+    {
+        pbnjson::JValue object = array[i];
+        Rule rule;
+        rule.mDB = 0;
+        rule.mExceptWireless = false;
+        rule.mRampDuration = 0;
+        rule.mRampCurve = eRampCurve_dBLinear;
+        bool valid = _parseSinks(object["when"], rule.mWhen);
+        if (valid && object.hasKey("mute"))
+        {
+            valid = _parseSinks(object["mute"], rule.mTargets);
+            rule.mDB = cMuted;
+        }
+        else if (valid)
+        {
+            valid = _parseSinks(object["duck"], rule.mTargets) &&
+                    object["dB"].asNumber<int>(rule.mDB) == CONV_OK && rule.mDB <= 0;
+        }
+        if (object.hasKey("exceptWireless"))
+            valid = valid && object["exceptWireless"].asBool(rule.mExceptWireless) == CONV_OK;
+        if (object.hasKey("rampMs"))
+            valid = valid && object["rampMs"].asNumber<int>(rule.mRampDuration) == CONV_OK &&
+                    rule.mRampDuration >= 0;
+        if (object.hasKey("curve"))
+            valid = valid && _parseCurve(object["curve"], rule.mRampCurve);
+        if (!valid)
+        {
+            g_warning("%s: invalid rule #%d in '%s', keeping the current policy",
+                                                           __FUNCTION__, i, path);
+            return false;
+        }
+        rules.push_back(rule);
+    }
+
+    mRules.swap(rules);
+    invalidateTargetVolumes();
+    g_message("%s: %u ducking rule(s) read from '%s'", __FUNCTION__,
+                                         (unsigned) mRules.size(), path);
+    return true;
+}
+
+void DuckingPolicy::adjust(const VirtualSinkSet & playing, bool wireless,
+                           int dB[eVirtualSink_Count]) const
+{
+    for (int sink = 0; sink < eVirtualSink_Count; ++sink)
+        dB[sink] = 0;
+
+    for (std::vector<Rule>::const_iterator rule = mRules.begin(); rule != mRules.end(); ++rule)
+    {
+        if (!playing.containAnyOf(rule->mWhen) || (wireless && rule->mExceptWireless))
+            continue;
+        for (EVirtualSink sink = eVirtualSink_First; sink <= eVirtualSink_Last;
+                                                    sink = EVirtualSink(sink + 1))
+            if (rule->mTargets.contain(sink))
+                dB[sink] = MAX(dB[sink] + rule->mDB, cMuted);
+    }
+}
+
+bool DuckingPolicy::getRamp(EVirtualSink sink, int & duration, ERampCurve & curve) const
+{
+    for (std::vector<Rule>::const_iterator rule = mRules.begin(); rule != mRules.end(); ++rule)
+    {
+        if (rule->mRampDuration > 0 && rule->mTargets.contain(sink))
+        {
+            duration = rule->mRampDuration;
+            curve = rule->mRampCurve;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _DUCKINGPOLICY_H_
+#define _DUCKINGPOLICY_H_
+
+#include <vector>
+
+#include "AudioMixer.h"
+
+/// Data-driven ducking & muting of sinks by the sinks playing.
+/// Rules are read from duckingpolicy.json, next to mixerconfig.json:
+///
+/// { "duckingPolicy": [
+///     { "when": ["navigation"], "duck": ["media", "flash"], "dB": -18 },
+///     { "when": ["alerts"], "duck": ["media"], "dB": -12, "exceptWireless": true },
+///     { "when": ["tts"], "mute": ["media"] },
+///     { "when": ["alarm"], "duck": ["media"], "dB": -12,
+///       "rampMs": 300, "curve": "s-curve" } ] }
+///
+/// A rule applies while any of its "when" sinks plays, & adjustments of
+/// several rules add up. "exceptWireless" skips a rule while media is
+/// streamed to a wireless device, which plays alerts on another output.
+/// "rampMs" & "curve" ("linear", "dB" or "s-curve") shape the volume changes
+/// of the rule's targets, instead of Pulse's own ramp.
+/// Without a valid file, built-in rules matching the historical behavior apply.
+class DuckingPolicy
+{
+public:
+    DuckingPolicy();
+
+    /// Replace the rules with those of a file. Keeps the current ones on failure.
+    bool    load(const char * path);
+
+    /// Adjustment at or below which a sink is muted, in dB
+    static const int cMuted = -1000;
+
+    /// dB adjustment of each sink for the sinks playing, in one pass over the rules
+    void    adjust(const VirtualSinkSet & playing, bool wireless,
+                   int dB[eVirtualSink_Count]) const;
+
+    /// Ramp shaping the ducking of a sink, if any
+    bool    getRamp(EVirtualSink sink, int & duration, ERampCurve & curve) const;
+
+private:
+    struct Rule
+    {
+        VirtualSinkSet  mWhen;
+        VirtualSinkSet  mTargets;
+        int             mDB;
+        bool            mExceptWireless;
+        int             mRampDuration;  // ms, 0 for Pulse's ramp
+        ERampCurve      mRampCurve;
+    };
+
+    void    setDefaults();
+
+    std::vector<Rule>   mRules;
+};
+
+extern DuckingPolicy gDuckingPolicy;
+
+#endif // _DUCKINGPOLICY_H_
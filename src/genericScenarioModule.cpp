@@ -14,6 +14,7 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
 #include <cstring>
 #include <unistd.h>
 
@@ -30,6 +31,7 @@
 #include "utils.h"
 #include "messageUtils.h"
 #include "log.h"
+#include "controlTrace.h"
 #include "notification.h"
 #include "alarm.h"
 #include "timer.h"
@@ -37,40 +39,162 @@
 
 GenericScenarioModule * GenericScenarioModule::sCurrentModule = 0;
 
+guint gTargetVolumesGeneration = 0;
+
 //We've retained the old code changes while separating from Scenario to Generic Architecture
 Volume cNoVolume(ConstString("<Invalid Volume>"), -1);
 
 GenericScenarioModule::GenericScenarioModule(const ConstString & category) :
-mCategory(category), mCurrentScenario(0), mStoreTimerID(0),
-mMuted(false), mVolumeOverride(0)
+mCategory(ConstString::intern(category)), mCurrentScenario(0), mEnabledScenarios(0),
+mScenarioIndex(g_hash_table_new(g_str_hash, g_str_equal)), mStoreTimerID(0),
+mPreferencesDirty(false), mMuted(false), mVolumeOverride(0)
+{
+}
+
+GenericScenarioModule::~GenericScenarioModule()
 {
+    g_hash_table_destroy(mScenarioIndex);
+}
+
+static bool
+_higherPriority(const GenericScenario * lhs, const GenericScenario * rhs)
+{
+    return lhs->mPriority > rhs->mPriority;
 }
 
 void
-GenericScenarioModule::_setCurrentScenarioByPriority ()
+GenericScenarioModule::_setCurrentScenarioByPriority (GenericScenario * excluded)
 {
     GenericScenario * previouslyCurrent = mCurrentScenario;
-    for (ScenarioModule::ScenarioMap::iterator iter = mScenarioTable.begin();
-        iter != mScenarioTable.end(); ++iter)
+
+    guint64 candidates = mEnabledScenarios;
+    for (size_t index = 0; excluded && index < mScenariosByPriority.size(); ++index)
+        if (mScenariosByPriority[index] == excluded)
+            candidates &= ~(G_GUINT64_CONSTANT(1) << index);
+
+    if (candidates)
+    {
+        GenericScenario * best = mScenariosByPriority[__builtin_ctzll(candidates)];
+        // the current scenario stays, unless something has a higher priority
+        if (nullptr == mCurrentScenario || mCurrentScenario == excluded ||
+            mCurrentScenario->mPriority < best->mPriority)
+            mCurrentScenario = best;
+    }
+
+    if (VERIFY (mCurrentScenario != 0) && mCurrentScenario != previouslyCurrent)
+    {
+        g_message("Scenario '%s' selected by priority", mCurrentScenario->getName());
+        traceEvent(eTrace_Scenario, 'p', traceName(mCurrentScenario->getName()));
+    }
+}
+
+/// Module with nothing to program, for the unit test
+class UnitTestScenarioModule : public GenericScenarioModule
+{
+public:
+    UnitTestScenarioModule() : GenericScenarioModule(ConstString("unittest")) {}
+
+protected:
+    void _updateHardwareSettings(bool muteMediaSink) {}
+};
+
+bool
+GenericScenarioModule::UnitTest()
+{
+    int failures = unitTestFailureCount();
+
+    Volume volume(ConstString("unittest"), 50);
+    GenericScenario low(ConstString("unittest_low"), true,
+                        eScenarioPriority_Media_BackSpeaker, volume);
+    GenericScenario tieB(ConstString("unittest_tie_b"), true,
+                         eScenarioPriority_Media_Headset, volume);
+    GenericScenario tieA(ConstString("unittest_tie_a"), true,
+                         eScenarioPriority_Media_HeadsetMic, volume);
+    GenericScenario top(ConstString("unittest_top"), false,
+                        eScenarioPriority_Phone_TTY_Full, volume);
+    UnitTestScenarioModule module;
+    UT_CHECK(module.addScenario(&low));
+    UT_CHECK(module.addScenario(&tieB));
+    UT_CHECK(module.addScenario(&tieA));
+    UT_CHECK(module.addScenario(&top));
+
+    // sorted by priority, then by name, one bit per enabled scenario
+    UT_CHECK(module.mScenariosByPriority.size() == 4 &&
+             module.mScenariosByPriority[0] == &top &&
+             module.mScenariosByPriority[1] == &tieA &&
+             module.mScenariosByPriority[2] == &tieB &&
+             module.mScenariosByPriority[3] == &low);
+    UT_CHECK(module.mEnabledScenarios == 0xe);
+
+    // an equal priority doesn't replace the current scenario...
+    UT_CHECK(module.mCurrentScenario == &tieB);
+    module._setCurrentScenarioByPriority();
+    UT_CHECK(module.mCurrentScenario == &tieB);
+    // ...but without one, the first name wins the tie
+    module._setCurrentScenarioByPriority(&tieB);
+    UT_CHECK(module.mCurrentScenario == &tieA);
+    module._setCurrentScenarioByPriority(&tieA);
+    UT_CHECK(module.mCurrentScenario == &tieB);
+
+    // a higher priority does, once enabled
+    module._setScenarioEnabled(&top, true);
+    UT_CHECK(top.mEnabled && module.mEnabledScenarios == 0xf);
+    module._setCurrentScenarioByPriority();
+    UT_CHECK(module.mCurrentScenario == &top);
+
+    // disabled scenarios aren't candidates
+    module._setScenarioEnabled(&tieA, false);
+    module._setScenarioEnabled(&tieB, false);
+    UT_CHECK(module.mEnabledScenarios == 0x9);
+    module._setCurrentScenarioByPriority(&top);
+    UT_CHECK(module.mCurrentScenario == &low);
+
+    // nothing else enabled: the excluded scenario stays current
+    module._setScenarioEnabled(&top, false);
+    module._setCurrentScenarioByPriority(&low);
+    UT_CHECK(module.mCurrentScenario == &low);
+
+    return unitTestFailureCount() == failures;
+}
+
+void
+GenericScenarioModule::_setScenarioEnabled (GenericScenario * s, bool enabled)
+{
+    s->mEnabled = enabled;
+    for (size_t index = 0; index < mScenariosByPriority.size(); ++index)
     {
-        GenericScenario *s = iter->second;
-        if (true == s->mEnabled)
+        if (mScenariosByPriority[index] == s)
         {
-            if (nullptr == mCurrentScenario)
-            mCurrentScenario = s;
-            else if (mCurrentScenario->mPriority < s->mPriority)
-            mCurrentScenario = s;
+            if (enabled)
+                mEnabledScenarios |= G_GUINT64_CONSTANT(1) << index;
+            else
+                mEnabledScenarios &= ~(G_GUINT64_CONSTANT(1) << index);
+            break;
         }
     }
-    if (VERIFY (mCurrentScenario != 0) && mCurrentScenario != previouslyCurrent)
-    g_message("Scenario '%s' selected by priority", mCurrentScenario->getName());
 }
 
 bool
 GenericScenarioModule::addScenario(GenericScenario *s)
 {
     g_debug ("%s: adding scenario '%s'", __FUNCTION__, s->getName());
+    if (!VERIFY(mScenarioTable.count(s->getName()) ||
+                mScenarioTable.size() < sizeof(mEnabledScenarios) * 8))
+        return false;
     mScenarioTable[s->getName()] = s;
+    g_hash_table_replace(mScenarioIndex, (gpointer) s->getName(), s);
+
+    // name order first, so that equal priorities are picked by name
+    mScenariosByPriority.clear();
+    for (ScenarioMap::iterator iter = mScenarioTable.begin();
+                               iter != mScenarioTable.end(); ++iter)
+        mScenariosByPriority.push_back(iter->second);
+    std::stable_sort(mScenariosByPriority.begin(), mScenariosByPriority.end(),
+                     _higherPriority);
+    mEnabledScenarios = 0;
+    for (size_t index = 0; index < mScenariosByPriority.size(); ++index)
+        if (mScenariosByPriority[index]->mEnabled)
+            mEnabledScenarios |= G_GUINT64_CONSTANT(1) << index;
 
     // To do?: notify of scenario being added
     if (true == s->mEnabled)
@@ -94,7 +218,7 @@ GenericScenarioModule::enableScenario (const char * name)
         LogIndent indentLogs("| ");
         if (false == s->mEnabled)
         {
-            s->mEnabled = true;
+            _setScenarioEnabled(s, true);
             CHECK(sendEnabledUpdate (name, UPDATE_ENABLED_SCENARIO));
         }
         //commented for BT routing : this check is not required
@@ -114,6 +238,7 @@ GenericScenarioModule::setCurrentScenario (const char * name)
         if (s != mCurrentScenario)
         {
             g_message("Scenario '%s' selected", s->getName());
+            traceEvent(eTrace_Scenario, 's', traceName(s->getName()));
             int flags = UPDATE_CHANGED_SCENARIO;
             int volume = -1;
             int micgain = -1;
@@ -198,10 +323,7 @@ GenericScenarioModule::unsetCurrentScenario (const char * name)
             micgain = mCurrentScenario->getMicGain();
         }
 
-        EScenarioPriority priority = s->mPriority;
-        s->mPriority = eScenarioPriority_Special_Lowest;
-        _setCurrentScenarioByPriority();
-        s->mPriority = priority;
+        _setCurrentScenarioByPriority(s);
 
         if (mCurrentScenario != s)
             flags |= UPDATE_CHANGED_SCENARIO;
@@ -239,7 +361,7 @@ GenericScenarioModule::disableScenario (const char * name)
         g_message("Scenario '%s' disabled", s->getName());
         LogIndent    indentLogs("| ");
 
-        s->mEnabled = false;
+        _setScenarioEnabled(s, false);
         if (s == mCurrentScenario)
         {
             int flags = UPDATE_CHANGED_SCENARIO;
@@ -316,7 +438,7 @@ bool volumeNotMicGain)
         }
         // for now, only persist volume
         if (volumeNotMicGain)
-            scheduleStorePreferences();
+            journalVolume(s);
     }
 
     if (volumeNotMicGain)
@@ -354,8 +476,7 @@ bool volumeNotMicGain)
 GenericScenario *
 GenericScenarioModule::getScenario (const char * name)
 {
-    GenericScenarioModule::ScenarioMap::iterator iter = mScenarioTable.find(name);
-    return (iter != mScenarioTable.end()) ? iter->second : 0;
+    return name ? (GenericScenario *) g_hash_table_lookup(mScenarioIndex, name) : 0;
 }
 
 int
@@ -369,13 +490,23 @@ bool enabled,
 EScenarioPriority priority,
 Volume & volume,
 Volume & micGain) :
-mName(name),
+mName(ConstString::intern(name)),
+mClass(0),
 mEnabled(enabled),
 mHardwired(enabled),
 mPriority(priority),
 mVolume(volume), mMicGain(micGain)
 {
+    if (mName.hasPrefix(MEDIA_))
+        mClass |= eScenarioClass_Media;
+    if (mName.hasPrefix(PHONE_))
+        mClass |= eScenarioClass_Phone;
+    if (mName.hasPrefix(VOICE_COMMAND_))
+        mClass |= eScenarioClass_VoiceCommand;
+    if (mName.hasPrefix(VVM_))
+        mClass |= eScenarioClass_Vvm;
+
     // some HW need to know about every scenario
-    gAudioDevice.registerScenario(name);
+    gAudioDevice.registerScenario(mName);
 }
 
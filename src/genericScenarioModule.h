@@ -23,6 +23,7 @@
 //#include "AudioDASS.h"
 #include <map>
 #include <string>
+#include <vector>
 
 enum EScenarioPriority
 {
@@ -76,6 +77,12 @@ enum ESendUpdate {
     eUpdate_GetSoundOut
 };
 
+/// Bumped whenever something the modules' program*Volumes read changes
+/// in a way ScenarioModule::programSoftwareMixer can't see for itself.
+/// Target volumes computed before are then forgotten.
+extern guint gTargetVolumesGeneration;
+inline void invalidateTargetVolumes() { ++gTargetVolumesGeneration; }
+
 class Volume {
 public:
     Volume(const ConstString &name, int defaultValue) : mName(name), mVolume(defaultValue) {}
@@ -84,7 +91,11 @@ public:
         return mVolume;
     }
     void set(int volume) {
-        mVolume = volume;
+        if (volume != mVolume)
+        {
+            mVolume = volume;
+            invalidateTargetVolumes();
+        }
     }
     const char * getName() const {
         return mName.c_str(); 
@@ -101,6 +112,15 @@ private:
 
 extern Volume cNoVolume;
 
+/// Families of scenarios, from their name's prefix
+enum EScenarioClass
+{
+    eScenarioClass_Media = 1 << 0,
+    eScenarioClass_Phone = 1 << 1,
+    eScenarioClass_VoiceCommand = 1 << 2,
+    eScenarioClass_Vvm = 1 << 3
+};
+
 class GenericScenario {
 public:
     GenericScenario(const ConstString & name,
@@ -113,8 +133,12 @@ public:
     const char * getName() const {
         return mName.c_str();
     }
+    bool isClass(EScenarioClass scenarioClass) const {
+        return (mClass & scenarioClass) != 0;
+    }
 
-    ConstString mName;
+    ConstString mName;  ///< interned
+    int mClass;         ///< EScenarioClass bits
     bool mEnabled;
     bool mHardwired; ///< Hardwired scenario are the ones enabled at creation
     EScenarioPriority mPriority;
@@ -159,7 +183,10 @@ public:
 
     GenericScenarioModule(const ConstString & category);
 
-    virtual ~GenericScenarioModule() {}
+    virtual ~GenericScenarioModule();
+
+    /// Built-in unit test of the selection by priority: Returns true on success.
+    static bool UnitTest();
 
     virtual bool makeCurrent() {return true;};
     bool isCurrentModule() {
@@ -207,10 +234,14 @@ public:
     /// Module store preferences for all scenario in
     // one large message to minimize number of transactions
 
+    /// Journal a scenario's new volume & save preferences later
+    void journalVolume(GenericScenario * scenario);
     /// Save preferences in 10 seconds max
     void scheduleStorePreferences();
-    /// Store preferences now
+    /// Store preferences now (queued to the persistence worker)
     void storePreferences();
+    /// The persistence worker is done with our last store
+    void onPreferencesStored(bool stored);
     /// Restore preferences now
     void restorePreferences();
 
@@ -273,13 +304,21 @@ public:
 
 protected:
     ScenarioMap mScenarioTable;
+    /// Scenarios by decreasing priority, then by name, & which are enabled:
+    /// the scenario to select by priority is the first bit set
+    std::vector<GenericScenario *> mScenariosByPriority;
+    guint64 mEnabledScenarios;
+    /// Scenarios by name, looked up without copying the name
+    GHashTable * mScenarioIndex;
 
     guint mStoreTimerID;
+    bool mPreferencesDirty;
 
     bool mMuted;
     int mVolumeOverride;
 
-    void _setCurrentScenarioByPriority();
+    void _setCurrentScenarioByPriority(GenericScenario * excluded = nullptr);
+    void _setScenarioEnabled(GenericScenario * s, bool enabled);
     virtual void _updateHardwareSettings(bool muteMediaSink = false) = 0;
 
     static GenericScenarioModule * sCurrentModule;
@@ -33,11 +33,14 @@
 #include "ringtone.h"
 #include "nav.h"
 #include "state.h"
+#include "persistenceWorker.h"
+#include "startupProfile.h"
 #include "AudioDevice.h"
 #include "AudioMixer.h"
 #include "utils.h"
 #include "messageUtils.h"
 #include "MixerInit.h"
+#include "duckingPolicy.h"
 #include "main.h"
 
 
@@ -73,7 +76,11 @@ PrintUsage(const char* progname)
             " -t send all log entries to the terminal\n"
            " -g turn debug logging on and use the system log (only)\n"
            " -s N sleep N milliseconds & quit\n"
-           " -n <priority> set the priority level\n");
+           " -n <priority> set the priority level\n"
+           " -R <KB> rotate the private log file when it reaches that size\n"
+           " -A <s> ...or when it is that old (0: no age limit)\n"
+           " -B <KB> disk budget of the archived private log files\n"
+           " -Z don't compress the archived private log files\n");
 }
 
 GMainContext *
@@ -118,6 +125,9 @@ main(int argc, char **argv)
 {
     int opt;
     int niceme = 0;
+    size_t logRotateSize, logArchiveBudget;
+    guint logRotateAge;
+    bool logCompress;
 
     signal(SIGTERM, term_handler);
     signal(SIGINT, term_handler);
@@ -130,8 +140,9 @@ main(int argc, char **argv)
     }
 
     setProcessName(argv[0]);
+    getLogRotation(logRotateSize, logRotateAge, logArchiveBudget, logCompress);
 
-    while ((opt = getopt(argc, argv, "hdr:n:gfts:")) != -1)
+    while ((opt = getopt(argc, argv, "hdr:n:gfts:R:A:B:Z")) != -1)
     {
         switch (opt)
         {
@@ -154,6 +165,18 @@ main(int argc, char **argv)
         case 'n':
             niceme = atoi(optarg);
             break;
+        case 'R':
+            logRotateSize = (size_t) atoi(optarg) * 1024;
+            break;
+        case 'A':
+            logRotateAge = (guint) atoi(optarg);
+            break;
+        case 'B':
+            logArchiveBudget = (size_t) atoi(optarg) * 1024;
+            break;
+        case 'Z':
+            logCompress = false;
+            break;
         // simple sleep in ms, not available on device
         case 's':
             usleep(atoi(optarg) * 1000);
@@ -166,6 +189,7 @@ main(int argc, char **argv)
         }
     }
 
+    setLogRotation(logRotateSize, logRotateAge, logArchiveBudget, logCompress);
     g_log_set_default_handler(logFilter, NULL);
 
     g_message("Starting audiod-" xstr(AUDIOD_SUBMISSION) "-%c%s.",
@@ -173,12 +197,21 @@ main(int argc, char **argv)
 
     setpriority(PRIO_PROCESS,getpid(),niceme);
 
+    startupMark("main");
+
     // Initialized audiod shared properties. Do not use them before this point!
+    startupPhaseBegin("State::init");
     gState.init();
+    startupPhaseEnd("State::init");
+
+    // Read stored preferences in the background while we initialize
+    gPersistenceWorker.start();
 
     // Initialize HW and verify, but before all registered inits,
     // except for static initializations & shared properties.
+    startupPhaseBegin("AudioDevice::pre_init");
     VERIFY(gAudioDevice.pre_init());
+    startupPhaseEnd("AudioDevice::pre_init");
 
     gMainLoop = g_main_loop_new(NULL, FALSE);
 
@@ -186,29 +219,45 @@ main(int argc, char **argv)
      *  initialize the lunaservice and we want it before all the init
      *  stuff happening.
      */
+    startupPhaseBegin("RegisterPalmService");
     if(RegisterPalmService() == false)
         return -1;
+    startupPhaseEnd("RegisterPalmService");
     g_message("Register [com.webos.service.audio] Successful");
 
 
     std::stringstream configPath;
     configPath << CONFIG_DIR_PATH << "/" << "mixerconfig.json";
     MixerInit mObjMixerInit(configPath);
-    if(mObjMixerInit.readMixerConfig())
+    startupPhaseBegin("MixerInit::readMixerConfig");
+    bool mixerConfigRead = mObjMixerInit.readMixerConfig();
+    startupPhaseEnd("MixerInit::readMixerConfig");
+    if(mixerConfigRead)
     {
+      StartupPhase phase("MixerInit::initMixerInterface");
       mObjMixerInit.initMixerInterface();
     }
     else
     {
       g_message("Could not reaad mixer config json file");
     }
+    gDuckingPolicy.load(CONFIG_DIR_PATH "/duckingpolicy.json");
+    startupPhaseBegin("oneInitForAll");
     oneInitForAll (gMainLoop, GetPalmService());
+    startupPhaseEnd("oneInitForAll");
     // Verify HW initialization, but after all registered inits,
     // static initializations & shared properties.
+    startupPhaseBegin("AudioDevice::post_init");
     VERIFY(gAudioDevice.post_init());
+    startupPhaseEnd("AudioDevice::post_init");
+    startupMark("main loop");
     g_debug("Starting main loop!");
     g_main_loop_run(gMainLoop);
 
+    // flush preferences still waiting for their write-behind timer
+    gState.storePreferences();
+    gPersistenceWorker.stop();
+
     g_main_loop_unref(gMainLoop);
 
     oneFreeForAll();
@@ -635,6 +635,8 @@ _broadcastEvent(LSHandle *lshandle, LSMessage *message, void *ctx)
 bool
 GenericScenarioModule::setMuted (bool muted)
 {
+    // modules keep their own mute flags next to mMuted
+    invalidateTargetVolumes();
     if (mMuted != muted)
     {
         mMuted = muted;
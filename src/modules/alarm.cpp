@@ -40,7 +40,7 @@
 
 static AlarmScenarioModule * sAlarmModule = 0;
 
-static const ConstString    cAlarm_Default("alarm" SCENARIO_DEFAULT);
+static const ConstString    cAlarm_Default = ConstString::intern("alarm" SCENARIO_DEFAULT);
 
 AlarmScenarioModule * getAlarmModule()
 {
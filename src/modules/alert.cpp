@@ -36,7 +36,7 @@
 
 static AlertScenarioModule * sAlertModule = 0;
 
-static const ConstString    cAlert_Default("alert" SCENARIO_DEFAULT);
+static const ConstString    cAlert_Default = ConstString::intern("alert" SCENARIO_DEFAULT);
 
 AlertScenarioModule * getAlertModule()
 {
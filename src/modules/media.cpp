@@ -31,6 +31,7 @@
 
 #include "vvm.h"
 #include "AudioMixer.h"
+#include "duckingPolicy.h"
 #include "volume.h"
 #include "utils.h"
 #include "messageUtils.h"
@@ -115,65 +116,43 @@ bool MediaScenarioModule::getRequestedState(void)
 
 
 
+/// Volume adjusted as the ducking policy says
+static int _duckVolume(int volume, int dB)
+{
+    if (volume <= 0 || dB == 0)
+        return volume;
+    if (dB <= DuckingPolicy::cMuted)
+        return 0;
+    return gAudioMixer.adjustVolume(volume, dB);
+}
+
 void
 MediaScenarioModule::programMediaVolumes(bool rampVolumes,
                                          bool rampMedia,
                                          bool muteMedia)
 {
 
-    const int cNavigationDuck = -18;    // dB
-
     VirtualSinkSet activeStreams = gAudioMixer.getActiveStreams ();
 
+    // alarms only duck media once audible
+    VirtualSinkSet playing = activeStreams;
+    if (!gAudioMixer.isSinkAudible(ealarm))
+        playing.remove(ealarm);
+    int dB[eVirtualSink_Count];
+    gDuckingPolicy.adjust(playing, _isWirelessStreamingScenario(), dB);
+
     int baseVolume = mCurrentScenario->getVolume();
 
     int    mediaVolume = !mMuted && activeStreams.contain(emedia) ?
-                                                                baseVolume : 0;
+                                        _duckVolume(baseVolume, dB[emedia]) : 0;
     int flashVolume = !mMuted && activeStreams.contain(eflash) ?
-                                                                baseVolume : 0;
+                                        _duckVolume(baseVolume, dB[eflash]) : 0;
     int defaultAppVolume = !mMuted && activeStreams.contain(edefaultapp) ?
-                                                                baseVolume : 0;
+                                   _duckVolume(baseVolume, dB[edefaultapp]) : 0;
     int navigationVolume = !mMuted && activeStreams.contain(enavigation) ?
-                                                                baseVolume : 0;
+                                   _duckVolume(baseVolume, dB[enavigation]) : 0;
     int volume_to_set = 0;
 
-    int duckMedia = 0;
-    int duckFlash = 0;
-    int duckDefaultApp = 0;
-    int duckNavigation = 0;
-
-    // when navigation is playing, duck other media volumes
-    if (activeStreams.contain(enavigation))
-    {
-        duckMedia = duckFlash = duckDefaultApp = cNavigationDuck;
-    }
-
-    // when an alert is playing, duck media volumes not played on the same output
-    if (someAlertIsPlaying())
-    {
-        duckDefaultApp += cAlertDuck;
-        if (!_isWirelessStreamingScenario())
-        {
-               duckMedia += cAlertDuck;
-               duckFlash += cAlertDuck;
-               duckNavigation += cAlertDuck;
-         }
-    }
-
-    if (mediaVolume > 0 && duckMedia != 0)
-        mediaVolume = gAudioMixer.adjustVolume(mediaVolume, duckMedia);
-
-    if (flashVolume > 0 && duckFlash != 0)
-        flashVolume = gAudioMixer.adjustVolume(flashVolume, duckFlash);
-
-    if (defaultAppVolume > 0 && duckDefaultApp != 0)
-        defaultAppVolume = gAudioMixer.adjustVolume(defaultAppVolume,
-                                                    duckDefaultApp);
-
-    if (navigationVolume > 0 && duckNavigation != 0)
-        navigationVolume = gAudioMixer.adjustVolume(navigationVolume,
-                                                    duckNavigation);
-
     // Apply as necessary, with or without ramping
 
     //ScenarioModule::disableScenario...mute back speaker for media playback
@@ -200,25 +179,39 @@ MediaScenarioModule::programMediaVolumes(bool rampVolumes,
             volume_to_set = navigationVolume;
 
         if(-1 != mPreviousSink )
-            programVolume(mPreviousSink, volume_to_set, rampVolumes || rampMedia);
+            _programDuckedVolume(mPreviousSink, volume_to_set, dB[mPreviousSink],
+                                 rampVolumes || rampMedia);
     }
 
     if(mPreviousSink != emedia)
-        programVolume(emedia, mediaVolume, rampVolumes);
+        _programDuckedVolume(emedia, mediaVolume, dB[emedia], rampVolumes);
 
     if(mPreviousSink != eflash)
-        programVolume(eflash, flashVolume, rampVolumes);
+        _programDuckedVolume(eflash, flashVolume, dB[eflash], rampVolumes);
 
     if(mPreviousSink != edefaultapp)
     {
-        programVolume(edefaultapp, defaultAppVolume, rampVolumes);
+        _programDuckedVolume(edefaultapp, defaultAppVolume, dB[edefaultapp], rampVolumes);
     }
 
     if(mPreviousSink != enavigation)
-        programVolume(enavigation, navigationVolume, rampVolumes);
+        _programDuckedVolume(enavigation, navigationVolume, dB[enavigation], rampVolumes);
 
 }
 
+void
+MediaScenarioModule::_programDuckedVolume(EVirtualSink sink, int volume,
+                                          int dB, bool ramp)
+{
+    int duration;
+    ERampCurve curve;
+    if (ramp && dB != mDuckingDB[sink] && gDuckingPolicy.getRamp(sink, duration, curve))
+        rampVolume(sink, volume, duration, curve);
+    else
+        programVolume(sink, volume, ramp);
+    mDuckingDB[sink] = dB;
+}
+
 gboolean
 MediaScenarioModule::_A2DPDelayedUpdate(gpointer)
 {
@@ -652,7 +645,7 @@ MediaScenarioModule::_updateRouting()
        {
             g_debug("Media :_updateRouting activating routing for alerts.");
             LogIndent    indentLogs("> ");
-            gAudioMixer.setRouting(mCurrentScenario->mName);
+            gAudioMixer.setRouting(*mCurrentScenario);
             mAlertsRoutingActive = true;
         }
     }
@@ -662,7 +655,7 @@ MediaScenarioModule::_updateRouting()
         {
             g_debug("Media:_updateRouting disabling routing for alerts.");
             LogIndent    indentLogs("> ");
-            gAudioMixer.setRouting(mCurrentScenario->mName);
+            gAudioMixer.setRouting(*mCurrentScenario);
             mAlertsRoutingActive = false;
         }
     }
@@ -927,6 +920,8 @@ MediaScenarioModule::MediaScenarioModule(int default_volume) :
     mRingtoneTimeoutSource(0)
 {
     mPreviousSink = eVirtualSink_None;
+    for (int sink = 0; sink < eVirtualSink_Count; ++sink)
+        mDuckingDB[sink] = 0;
     g_debug("%s: MediaScenarioModule with arg '%d' volume", __FUNCTION__, default_volume);
 }
 
@@ -955,6 +950,8 @@ MediaScenarioModule::MediaScenarioModule() :
     mRingtoneTimeoutSource(0)
 {
     mPreviousSink = eVirtualSink_None;
+    for (int sink = 0; sink < eVirtualSink_Count; ++sink)
+        mDuckingDB[sink] = 0;
 
         gAudiodCallbacks.registerModuleCallback (this, eVirtualSink_All);
 
@@ -1028,5 +1025,5 @@ MediaInterfaceInit(GMainLoop *loop, LSHandle *handle)
      return 0;
 }
 
-MODULE_START_FUNC (MediaInterfaceInit);
+MODULE_START_FUNC_DEPS (MediaInterfaceInit, eInitPriority_Critical, "StateInit");
 
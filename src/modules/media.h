@@ -68,8 +68,18 @@ public:
     EA2DP mA2DPCurrentState;
     virtual void _updateA2DP(bool play, bool immediate = true);
 
+    /// Ducking last programmed, per sink in dB. Whether the next change of a
+    /// sink ramps depends on it, so cached target volumes do too.
+    const int *     getDuckingDB() const        { return mDuckingDB; }
+    void            setDuckingDB(const int dB[eVirtualSink_Count])
+                        { memcpy(mDuckingDB, dB, sizeof(mDuckingDB)); }
+
 private:
     int                _applyMinVolume(int adjustedVolume, int originalVolume);
+    /// Program a media sink, with the ducking policy's ramp if its ducking changed
+    void               _programDuckedVolume(EVirtualSink sink, int volume,
+                                            int dB, bool ramp);
+    int                mDuckingDB[eVirtualSink_Count];  // last ducking programmed
     bool            PriorityToRingtone;
     Volume            mFrontSpeakerVolume;
     Volume            mHeadsetVolume;
@@ -82,7 +92,6 @@ private:
     std::string       mA2DPAddress;
 
 protected:
-    const int cAlertDuck = -12;
     Volume mFrontMicGain;
     Volume mBackSpeakerVolume;
     bool mPriorityToAlerts;
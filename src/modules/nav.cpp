@@ -32,7 +32,7 @@
 
 static NavigationScenarioModule * sNavModule = 0;
 
-static const ConstString    cNav_Default("nav" SCENARIO_DEFAULT);
+static const ConstString    cNav_Default = ConstString::intern("nav" SCENARIO_DEFAULT);
 
 NavigationScenarioModule * getNavModule()
 {
@@ -38,7 +38,7 @@
 
 static NotificationScenarioModule * sNotificationModule = 0;
 
-static const ConstString    cNotification_Default("notification" SCENARIO_DEFAULT);
+static const ConstString    cNotification_Default = ConstString::intern("notification" SCENARIO_DEFAULT);
 
 NotificationScenarioModule * getNotificationModule()
 {
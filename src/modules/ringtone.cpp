@@ -47,7 +47,7 @@
 
 static RingtoneScenarioModule * sRingtoneModule = 0;
 
-static const ConstString    cRingtone_Default("ringtone" SCENARIO_DEFAULT);
+static const ConstString    cRingtone_Default = ConstString::intern("ringtone" SCENARIO_DEFAULT);
 
 RingtoneScenarioModule * getRingtoneModule()
 {
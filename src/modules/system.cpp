@@ -36,7 +36,7 @@
 
 static SystemScenarioModule * sSystemModule = 0;
 
-static const ConstString    cSystem_Default("system" SCENARIO_DEFAULT);
+static const ConstString    cSystem_Default = ConstString::intern("system" SCENARIO_DEFAULT);
 
 SystemScenarioModule * getSystemModule()
 {
@@ -196,4 +196,4 @@ SystemInterfaceInit(GMainLoop *loop, LSHandle *handle)
     return 0;
 }
 
-MODULE_START_FUNC (SystemInterfaceInit);
+MODULE_START_FUNC_DEPS (SystemInterfaceInit, eInitPriority_Critical, "StateInit");
@@ -38,7 +38,7 @@
 
 static TimerScenarioModule * sTimerModule = 0;
 
-static const ConstString    cTimer_Default("timer" SCENARIO_DEFAULT);
+static const ConstString    cTimer_Default = ConstString::intern("timer" SCENARIO_DEFAULT);
 
 TimerScenarioModule * getTimerModule()
 {
@@ -0,0 +1,373 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <lunaprefs.h>
+
+#include "persistenceWorker.h"
+#include "messageUtils.h"
+#include "log.h"
+#include "main.h"
+#include "utils.h"
+#include "startupProfile.h"
+
+PersistenceWorker gPersistenceWorker;
+
+enum EPersistenceJob
+{
+    ePersistenceJob_Store,
+    ePersistenceJob_Append,
+    ePersistenceJob_Replace,
+    ePersistenceJob_Quit
+};
+
+struct PersistenceWorker::Job
+{
+    EPersistenceJob     mType;
+    std::string         mKey;
+    std::string         mValue;
+    PersistenceCallback mCallback;
+    gpointer            mUserData;
+    bool                mResult;
+};
+
+PersistenceWorker::PersistenceWorker() :
+    mRunning(false),
+    mQueue(g_async_queue_new()),
+    mDone(g_async_queue_new()),
+    mDoneScheduled(0),
+    mPrefetched(false),
+    mAppendFd(-1)
+{
+    pthread_mutex_init(&mMutex, NULL);
+    pthread_cond_init(&mPrefetchDone, NULL);
+}
+
+void PersistenceWorker::start()
+{
+    if (mRunning)
+        return;
+
+    if (pthread_create(&mThread, NULL, &PersistenceWorker::_thread, this) == 0)
+    {
+        mRunning = true;
+    }
+    else
+    {
+        g_warning("%s: can't create persistence thread, doing I/O inline",
+                                                                  __FUNCTION__);
+        prefetch();
+    }
+}
+
+void PersistenceWorker::stop()
+{
+    if (!mRunning)
+        return;
+
+    Job * job = new Job();
+    job->mType = ePersistenceJob_Quit;
+    g_async_queue_push(mQueue, job);
+    pthread_join(mThread, NULL);
+    mRunning = false;
+
+    // the main loop is over: its idle callbacks won't run anymore
+    reportDone();
+}
+
+void * PersistenceWorker::_thread(void * data)
+{
+    PersistenceWorker * worker = (PersistenceWorker *) data;
+
+    worker->prefetch();
+
+    for (;;)
+    {
+        Job * job = (Job *) g_async_queue_pop(worker->mQueue);
+        if (job->mType == ePersistenceJob_Quit)
+        {
+            delete job;
+            break;
+        }
+        worker->run(job);
+    }
+
+    if (worker->mAppendFd >= 0)
+    {
+        close(worker->mAppendFd);
+        worker->mAppendFd = -1;
+    }
+
+    return NULL;
+}
+
+void PersistenceWorker::prefetch()
+{
+    StartupPhase    phase("prefetch preferences");
+    std::map<std::string, std::string> values;
+    LPAppHandle prefHandle = NULL;
+
+    if (VERIFY(LPAppGetHandle(AUDIOD_SERVICE_PATH, &prefHandle) == LP_ERR_NONE) &&
+                                                           VERIFY(prefHandle))
+    {
+        char * keys = 0;
+        if (LPAppCopyKeys(prefHandle, &keys) == LP_ERR_NONE && keys)
+        {
+            JsonMessageParser    msg(keys, SCHEMA_ANY);
+            if (CHECK(msg.parse(__FUNCTION__)))
+            {
+                pbnjson::JValue array = msg.get();
+                for (int i = 0; i < array.arraySize(); ++i)
+                {
+                    std::string key;
+                    char * json = 0;
+                    if (array[i].asString(key) == CONV_OK &&
+                        LPAppCopyValue(prefHandle, key.c_str(), &json) == LP_ERR_NONE &&
+                        json)
+                    {
+                        values[key] = json;
+                        g_free(json);
+                    }
+                }
+            }
+            g_free(keys);
+        }
+    }
+    LPAppFreeHandle(prefHandle, false);
+
+    g_debug("%s: %u value(s) read", __FUNCTION__, (unsigned) values.size());
+
+    pthread_mutex_lock(&mMutex);
+    // values stored meanwhile are newer than what we just read
+    for (std::map<std::string, std::string>::iterator iter = mValues.begin();
+                                            iter != mValues.end(); ++iter)
+        values[iter->first] = iter->second;
+    mValues.swap(values);
+    mPrefetched = true;
+    pthread_cond_broadcast(&mPrefetchDone);
+    pthread_mutex_unlock(&mMutex);
+}
+
+bool PersistenceWorker::copyValue(const char * key, std::string & value)
+{
+    bool found = false;
+
+    if (!mRunning && !mPrefetched)
+        prefetch();
+
+    pthread_mutex_lock(&mMutex);
+    if (!mPrefetched)
+    {
+        guint64 start = getCurrentTimeInMs();
+        while (!mPrefetched)
+            pthread_cond_wait(&mPrefetchDone, &mMutex);
+        g_debug("%s: waited %llu ms for the prefetch", __FUNCTION__,
+                           (unsigned long long) (getCurrentTimeInMs() - start));
+    }
+    std::map<std::string, std::string>::iterator iter = mValues.find(key);
+    if (iter != mValues.end())
+    {
+        value = iter->second;
+        found = true;
+    }
+    pthread_mutex_unlock(&mMutex);
+
+    return found;
+}
+
+void PersistenceWorker::storeValue(const std::string & key,
+                                   const std::string & value,
+                                   PersistenceCallback callback,
+                                   gpointer userData)
+{
+    // keep later copyValue() calls consistent with what's being stored
+    pthread_mutex_lock(&mMutex);
+    mValues[key] = value;
+    pthread_mutex_unlock(&mMutex);
+
+    Job * job = new Job();
+    job->mType = ePersistenceJob_Store;
+    job->mKey = key;
+    job->mValue = value;
+    job->mCallback = callback;
+    job->mUserData = userData;
+    push(job);
+}
+
+void PersistenceWorker::appendFile(const std::string & path,
+                                   const std::string & data)
+{
+    Job * job = new Job();
+    job->mType = ePersistenceJob_Append;
+    job->mKey = path;
+    job->mValue = data;
+    job->mCallback = 0;
+    push(job);
+}
+
+void PersistenceWorker::replaceFile(const std::string & path,
+                                    const std::string & data)
+{
+    Job * job = new Job();
+    job->mType = ePersistenceJob_Replace;
+    job->mKey = path;
+    job->mValue = data;
+    job->mCallback = 0;
+    push(job);
+}
+
+void PersistenceWorker::push(Job * job)
+{
+    if (mRunning)
+        g_async_queue_push(mQueue, job);
+    else
+        run(job);
+}
+
+void PersistenceWorker::run(Job * job)
+{
+    switch (job->mType)
+    {
+    case ePersistenceJob_Store:
+        job->mResult = store(job->mKey, job->mValue);
+        break;
+    case ePersistenceJob_Append:
+        job->mResult = append(job->mKey, job->mValue);
+        break;
+    case ePersistenceJob_Replace:
+        job->mResult = replace(job->mKey, job->mValue);
+        break;
+    default:
+        SHOULD_NOT_REACH_HERE;
+        job->mResult = false;
+        break;
+    }
+
+    if (!job->mCallback)
+    {
+        delete job;
+        return;
+    }
+
+    // report back to the main loop, one idle callback for all done jobs
+    g_async_queue_push(mDone, job);
+    if (g_atomic_int_compare_and_exchange(&mDoneScheduled, 0, 1))
+        g_idle_add(_jobsDone, this);
+}
+
+gboolean PersistenceWorker::_jobsDone(gpointer data)
+{
+    PersistenceWorker * worker = (PersistenceWorker *) data;
+
+    g_atomic_int_set(&worker->mDoneScheduled, 0);
+    worker->reportDone();
+
+    return FALSE;
+}
+
+void PersistenceWorker::reportDone()
+{
+    while (Job * job = (Job *) g_async_queue_try_pop(mDone))
+    {
+        job->mCallback(job->mResult, job->mUserData);
+        delete job;
+    }
+}
+
+bool PersistenceWorker::store(const std::string & key, const std::string & value)
+{
+    LPAppHandle prefHandle = NULL;
+
+    if (!VERIFY(LPAppGetHandle(AUDIOD_SERVICE_PATH, &prefHandle) == LP_ERR_NONE) ||
+                                                          !VERIFY(prefHandle))
+    {
+        LPAppFreeHandle(prefHandle, false);
+        return false;
+    }
+
+    g_debug("Storing '%s': %s", key.c_str(), value.c_str());
+    if (!CHECK(LPAppSetValue(prefHandle, key.c_str(), value.c_str()) == LP_ERR_NONE))
+    {
+        LPAppFreeHandle(prefHandle, false);
+        return false;
+    }
+
+    return VERIFY(LPAppFreeHandle(prefHandle, true) == LP_ERR_NONE);
+}
+
+bool PersistenceWorker::append(const std::string & path, const std::string & data)
+{
+    if (mAppendFd >= 0 && mAppendPath != path)
+    {
+        close(mAppendFd);
+        mAppendFd = -1;
+    }
+
+    if (mAppendFd < 0)
+    {
+        gchar * dir = g_path_get_dirname(path.c_str());
+        g_mkdir_with_parents(dir, 0755);
+        g_free(dir);
+
+        mAppendFd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (mAppendFd < 0)
+        {
+            g_warning("%s: can't open '%s': %s", __FUNCTION__,
+                                             path.c_str(), strerror(errno));
+            return false;
+        }
+        mAppendPath = path;
+    }
+
+    // one write per record, so that a crash can only tear the last one
+    return CHECK(write(mAppendFd, data.c_str(), data.size()) == (ssize_t) data.size());
+}
+
+bool PersistenceWorker::replace(const std::string & path, const std::string & data)
+{
+    // the file we append to is about to be replaced
+    if (mAppendFd >= 0 && mAppendPath == path)
+    {
+        close(mAppendFd);
+        mAppendFd = -1;
+    }
+
+    if (data.empty())
+    {
+        if (g_file_test(path.c_str(), G_FILE_TEST_EXISTS))
+            return CHECK(truncate(path.c_str(), 0) == 0);
+        return true;
+    }
+
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (!CHECK(fd >= 0))
+        return false;
+    bool written = CHECK(write(fd, data.c_str(), data.size()) ==
+                                                  (ssize_t) data.size());
+    written = written && CHECK(fdatasync(fd) == 0);
+    close(fd);
+    if (!written || !CHECK(rename(tmpPath.c_str(), path.c_str()) == 0))
+    {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
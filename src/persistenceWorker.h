@@ -0,0 +1,89 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _PERSISTENCEWORKER_H_
+#define _PERSISTENCEWORKER_H_
+
+#include <glib.h>
+#include <pthread.h>
+#include <map>
+#include <string>
+
+/// Called on the main loop once a queued store is done
+typedef void (*PersistenceCallback)(bool stored, gpointer userData);
+
+/// Thread doing all luna-prefs & journal file I/O, so that flash writes
+/// never block the main loop. Jobs carry their own copy of the data and
+/// are processed in order.
+/// At start, all of audiod's luna-prefs values are read in the background,
+/// while the main thread goes on with its own initialization.
+class PersistenceWorker
+{
+public:
+    PersistenceWorker();
+
+    /// Start the thread & the prefetch of all stored values
+    void start();
+    /// Process the jobs already queued, then stop the thread.
+    /// Callbacks of jobs done meanwhile are called before returning.
+    void stop();
+
+    /// Get a stored value, waiting for the prefetch if needed
+    bool copyValue(const char * key, std::string & value);
+
+    /// Queue the store of a luna-prefs value
+    void storeValue(const std::string & key, const std::string & value,
+                    PersistenceCallback callback = 0, gpointer userData = 0);
+
+    /// Queue an append to a file
+    void appendFile(const std::string & path, const std::string & data);
+    /// Queue an atomic replacement of a file's content (empty truncates it)
+    void replaceFile(const std::string & path, const std::string & data);
+
+private:
+    struct Job;
+
+    static void * _thread(void * data);
+    static gboolean _jobsDone(gpointer data);
+
+    void push(Job * job);
+    void run(Job * job);
+    /// Call the callbacks of the done jobs, on the main thread
+    void reportDone();
+    void prefetch();
+    bool store(const std::string & key, const std::string & value);
+    bool append(const std::string & path, const std::string & data);
+    bool replace(const std::string & path, const std::string & data);
+
+    pthread_t mThread;
+    bool mRunning;
+    GAsyncQueue * mQueue;
+    GAsyncQueue * mDone;        // jobs with a callback, once done
+    gint mDoneScheduled;        // an idle callback will report them
+
+    pthread_mutex_t mMutex;
+    pthread_cond_t mPrefetchDone;
+    bool mPrefetched;
+    std::map<std::string, std::string> mValues;
+
+    // only used by the worker thread
+    std::string mAppendPath;
+    int mAppendFd;
+};
+
+extern PersistenceWorker gPersistenceWorker;
+
+#endif // _PERSISTENCEWORKER_H_
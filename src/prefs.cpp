@@ -14,7 +14,6 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
-#include <lunaprefs.h>
 #include "messageUtils.h"
 #include "state.h"
 #include "scenario.h"
@@ -22,18 +21,57 @@
 #include "IPC_SharedAudiodProperties.h"
 #include "main.h"
 #include "genericScenarioModule.h"
+#include "prefsJournal.h"
+#include "persistenceWorker.h"
 
-bool State::storePreferences()
+/// State preferences are few & rarely changed: store them soon after a change
+static const guint cStatePreferencesStoreDelay = 1000;
+
+template <class T> static bool _hasDirtyPreference(const std::map<std::string,
+                                                   PreferencePair<T> > & prefs)
+{
+    for (typename std::map<std::string, PreferencePair<T> >::const_iterator
+                                iter = prefs.begin(); iter != prefs.end(); ++iter)
+        if (iter->second.mDirty)
+            return true;
+    return false;
+}
+
+template <class T> static void _clearDirtyPreferences(std::map<std::string,
+                                                      PreferencePair<T> > & prefs)
 {
-    LPAppHandle prefHandle = NULL;
+    for (typename std::map<std::string, PreferencePair<T> >::iterator
+                                iter = prefs.begin(); iter != prefs.end(); ++iter)
+        iter->second.mDirty = false;
+}
+
+template <class T> static void _setDirtyPreferences(std::map<std::string,
+                                                    PreferencePair<T> > & prefs)
+{
+    for (typename std::map<std::string, PreferencePair<T> >::iterator
+                                iter = prefs.begin(); iter != prefs.end(); ++iter)
+        iter->second.mDirty = true;
+}
 
-    if (!VERIFY(LPAppGetHandle(AUDIOD_SERVICE_PATH, &prefHandle) == LP_ERR_NONE) ||
-                                                          !VERIFY(prefHandle))
+static void _statePreferencesStored(bool stored, gpointer data)
+{
+    ((State *) data)->onPreferencesStored(stored);
+}
+
+bool State::storePreferences()
+{
+    if (mStoreTimerID)
     {
-        LPAppFreeHandle(prefHandle, false);
-        return false;
+        g_source_remove(mStoreTimerID);
+        mStoreTimerID = 0;
     }
 
+    // nothing changed since the last store: don't touch luna-prefs at all
+    if (!_hasDirtyPreference(mBooleanPreferences) &&
+        !_hasDirtyPreference(mStringPreferences) &&
+        !_hasDirtyPreference(mIntegerPreferences))
+        return true;
+
     pbnjson::JValue pref = pbnjson::Object();
 
     // don't store preferences set to default value,
@@ -52,45 +90,71 @@ bool State::storePreferences()
         if (iter->second.mValue != iter->second.mDefaultValue)
             pref.put(iter->first, iter->second.mValue);
 
-    std::string    prefString = jsonToString(pref);
-    g_debug("Storing 'state_preferences': %s", prefString.c_str());
-    CHECK(LPAppSetValue(prefHandle, "state_preferences",
-                                           prefString.c_str()) == LP_ERR_NONE);
+    // the worker stores this snapshot, so we can consider it clean now
+    _clearDirtyPreferences(mBooleanPreferences);
+    _clearDirtyPreferences(mStringPreferences);
+    _clearDirtyPreferences(mIntegerPreferences);
+
+    gPersistenceWorker.storeValue("state_preferences", jsonToString(pref),
+                                  _statePreferencesStored, this);
+
+    return true;
+}
 
-    return VERIFY(LPAppFreeHandle(prefHandle, true) == LP_ERR_NONE);
+void State::onPreferencesStored(bool stored)
+{
+    // flag everything again, so that the next change retries the store
+    if (!stored)
+    {
+        _setDirtyPreferences(mBooleanPreferences);
+        _setDirtyPreferences(mStringPreferences);
+        _setDirtyPreferences(mIntegerPreferences);
+    }
 }
 
-template <class T> bool _restorePreference(LPAppHandle prefHandle,
-                                           const char * keyName,
+static
+gboolean _storeStatePreferencesCallback(gpointer data)
+{
+    State * state = (State *) data;
+
+    state->storePreferences();
+
+    return FALSE;
+}
+
+void
+State::scheduleStorePreferences()
+{
+    if (0 == mStoreTimerID)
+    {
+        mStoreTimerID = g_timeout_add_full (G_PRIORITY_DEFAULT_IDLE,
+                cStatePreferencesStoreDelay,
+                _storeStatePreferencesCallback,
+                this,
+                NULL);
+    }
+}
+
+template <class T> bool _restorePreference(const char * keyName,
                                            const char * valueName, T & value)
 {
     bool result = false;
-    char * json = 0;
-    if (LPAppCopyValue(prefHandle, keyName, &json) == LP_ERR_NONE && json)
+    std::string json;
+    if (gPersistenceWorker.copyValue(keyName, json))
     {
-        JsonMessageParser    msg(json, SCHEMA_ANY);
+        JsonMessageParser    msg(json.c_str(), SCHEMA_ANY);
         result = msg.parse(__FUNCTION__) && msg.get(valueName, value);
-        g_free(json);
     }
     return result;
 }
 
 bool State::restorePreferences()
 {
-    LPAppHandle prefHandle = NULL;
-
-    if (!VERIFY(LPAppGetHandle(AUDIOD_SERVICE_PATH, &prefHandle) == LP_ERR_NONE) ||
-                                                          !VERIFY(prefHandle))
+    std::string json;
+    if (gPersistenceWorker.copyValue("state_preferences", json))
     {
-        LPAppFreeHandle(prefHandle, false);
-        return false;
-    }
-
-    char * json = 0;
-    if (LPAppCopyValue(prefHandle, "state_preferences", &json) == LP_ERR_NONE && json)
-    {
-        g_debug("Restoring 'state_preferences': %s", json);
-        JsonMessageParser    msg(json, SCHEMA_ANY);
+        g_debug("Restoring 'state_preferences': %s", json.c_str());
+        JsonMessageParser    msg(json.c_str(), SCHEMA_ANY);
         if (CHECK(msg.parse(__FUNCTION__)))
         {
             pbnjson::JValue request = msg.get();
@@ -176,45 +240,47 @@ bool State::restorePreferences()
                 }
             }
         }
-        g_free(json);
     }
     else    // fallback on pre-Blowfish persistence code, in case we need to pick-up
     {
         bool settingOn;
-        if (_restorePreference(prefHandle, cPref_VibrateWhenRingerOn,
+        if (_restorePreference(cPref_VibrateWhenRingerOn,
                                                            "value", settingOn))
             mBooleanPreferences[cPref_VibrateWhenRingerOn].mValue = settingOn;
 
-        if (_restorePreference(prefHandle, cPref_PrevVibrateWhenRingerOn,
+        if (_restorePreference(cPref_PrevVibrateWhenRingerOn,
                                                            "value", settingOn))
             mBooleanPreferences[cPref_PrevVibrateWhenRingerOn].mValue = settingOn;
 
         bool settingOff;
-        if (_restorePreference(prefHandle, cPref_VibrateWhenRingerOff,
+        if (_restorePreference(cPref_VibrateWhenRingerOff,
                                                           "value", settingOff))
             mBooleanPreferences[cPref_VibrateWhenRingerOff].mValue = settingOff;
 
-        if (_restorePreference(prefHandle, cPref_PrevVibrateWhenRingerOff,
+        if (_restorePreference(cPref_PrevVibrateWhenRingerOff,
                                                           "value", settingOff))
             mBooleanPreferences[cPref_PrevVibrateWhenRingerOff].mValue = settingOff;
     }
 
-    // close handle and discard stuff
-    LPAppFreeHandle(prefHandle, false);
-
     return true;
 }
 
+static void _modulePreferencesStored(bool stored, gpointer data)
+{
+    ((GenericScenarioModule *) data)->onPreferencesStored(stored);
+}
+
 void GenericScenarioModule::storePreferences()
 {
-    LPAppHandle prefHandle = NULL;
+    if (mStoreTimerID)
+    {
+        g_source_remove(mStoreTimerID);
+        mStoreTimerID = 0;
+    }
 
-     if(!VERIFY(LPAppGetHandle(AUDIOD_SERVICE_PATH, &prefHandle) == LP_ERR_NONE) ||
-                                                           !VERIFY(prefHandle))
-     {
-         LPAppFreeHandle(prefHandle, false);
-         return;
-     }
+    // volumes changed since the last store are in the journal until then
+    if (!mPreferencesDirty)
+        return;
 
     pbnjson::JValue pref = pbnjson::Object();
 
@@ -224,38 +290,34 @@ void GenericScenarioModule::storePreferences()
     {
         GenericScenario * scenario = iter->second;
         snprintf(label, G_N_ELEMENTS(label), "%s_volume", scenario->getName());
-        pref.put(label, mCurrentScenario->getVolume());
+        pref.put(label, scenario->getVolume());
     }
 
     snprintf(label, G_N_ELEMENTS(label), "%s_preferences", this->getCategory());
-    std::string    prefString = jsonToString(pref);
-    g_debug("Storing '%s': %s", label, prefString.c_str());
-    CHECK(LPAppSetValue(prefHandle, label, prefString.c_str()) == LP_ERR_NONE);
-
-    VERIFY(LPAppFreeHandle(prefHandle, true) == LP_ERR_NONE);
+    mPreferencesDirty = false;
+    gPersistenceWorker.storeValue(label, jsonToString(pref),
+                                  _modulePreferencesStored, this);
+}
 
-    mStoreTimerID = 0;
+void GenericScenarioModule::onPreferencesStored(bool stored)
+{
+    if (!stored)
+        mPreferencesDirty = true;
+    // volumes changed since the snapshot was taken still need the journal
+    else if (!mPreferencesDirty)
+        gPreferencesJournal.flushed(getCategory());
 }
 
 void GenericScenarioModule::restorePreferences()
 {
-    LPAppHandle prefHandle = NULL;
-
-    if (!VERIFY(LPAppGetHandle(AUDIOD_SERVICE_PATH, &prefHandle) == LP_ERR_NONE) ||
-                                                           !VERIFY(prefHandle))
-    {
-        LPAppFreeHandle(prefHandle, false);
-        return;
-    }
-
     char    label[256];
     snprintf(label, G_N_ELEMENTS(label), "%s_preferences", this->getCategory());
 
-    char * json = 0;
-    if (LPAppCopyValue(prefHandle, label, &json) == LP_ERR_NONE && json)
+    std::string json;
+    if (gPersistenceWorker.copyValue(label, json))
     {
-        g_debug("Restoring '%s': %s", label, json);
-        JsonMessageParser    msg(json, SCHEMA_ANY);
+        g_debug("Restoring '%s': %s", label, json.c_str());
+        JsonMessageParser    msg(json.c_str(), SCHEMA_ANY);
         if (CHECK(msg.parse(__FUNCTION__)))
         {
             for (ScenarioMap::iterator iter = mScenarioTable.begin();
@@ -265,10 +327,9 @@ void GenericScenarioModule::restorePreferences()
                 snprintf(label, G_N_ELEMENTS(label), "%s_volume", scenario->getName());
                 int value;
                 if (msg.get(label, value))
-                    mCurrentScenario->setVolume(value);
+                    scenario->setVolume(value);
             }
         }
-        g_free(json);
     }
     else    // fallback on pre-Blowfish persistence code,
             // in case we need to read pre-blowfish settings
@@ -279,25 +340,47 @@ void GenericScenarioModule::restorePreferences()
             GenericScenario * scenario = iter->second;
             std::string volumeKey = string_printf("%s_volume", scenario->getName());
             int volume;
-            if (_restorePreference(prefHandle, volumeKey.c_str(), "volume", volume))
+            if (_restorePreference(volumeKey.c_str(), "volume", volume))
                 scenario->setVolume(volume);
         }
     }
 
-    // close handle and discard stuff
-    LPAppFreeHandle(prefHandle, false);
+    // volumes changed after the last store, possibly before a crash
+    for (ScenarioMap::iterator iter = mScenarioTable.begin();
+                                      iter != mScenarioTable.end(); ++iter)
+    {
+        GenericScenario * scenario = iter->second;
+        int volume;
+        if (gPreferencesJournal.lookup(getCategory(), scenario->getName(), volume))
+        {
+            g_debug("Restoring journaled %s volume: %i", scenario->getName(), volume);
+            scenario->setVolume(volume);
+            mPreferencesDirty = true;
+        }
+    }
+    if (mPreferencesDirty)
+        scheduleStorePreferences();
 }
 
 static
 gboolean _storePreferencesCallback(gpointer data)
 {
-    ScenarioModule * module = (ScenarioModule *) data;
+    GenericScenarioModule * module = (GenericScenarioModule *) data;
 
     module->storePreferences();
 
     return FALSE;
 }
 
+void
+GenericScenarioModule::journalVolume(GenericScenario * scenario)
+{
+    gPreferencesJournal.append(getCategory(), scenario->getName(),
+                                                    scenario->getVolume());
+    mPreferencesDirty = true;
+    scheduleStorePreferences();
+}
+
 void
 GenericScenarioModule::scheduleStorePreferences()
 {
@@ -0,0 +1,126 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "prefsJournal.h"
+#include "persistenceWorker.h"
+#include "log.h"
+#include "ConstString.h"
+
+/// Rewrite the journal once it holds that many records
+static const int cJournalCompactThreshold = 256;
+
+#ifndef AUDIOD_SIMULATOR   // the simulator journals to a scratch file
+PreferencesJournal gPreferencesJournal(PREFERENCES_JOURNAL_PATH);
+#endif
+
+PreferencesJournal::PreferencesJournal(const char * path) :
+    mPath(path), mLoaded(false), mRecords(0)
+{
+}
+
+void PreferencesJournal::load()
+{
+    if (mLoaded)
+        return;
+    mLoaded = true;
+
+    FILE * file = fopen(mPath.c_str(), "r");
+    if (!file)
+        return;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        // a line without its newline was torn by a crash: ignore it
+        if (!strchr(line, '\n'))
+            break;
+
+        char category[80], scenario[80];
+        int volume;
+        if (sscanf(line, "%79s %79s %d", category, scenario, &volume) == 3)
+        {
+            mPending[category][scenario] = volume;
+            ++mRecords;
+        }
+        else
+            g_warning("%s: ignoring invalid record '%s'", __FUNCTION__, line);
+    }
+    fclose(file);
+
+    g_debug("%s: %i record(s) replayed from '%s'", __FUNCTION__,
+                                                 mRecords, mPath.c_str());
+}
+
+void PreferencesJournal::append(const char * category,
+                                const char * scenario, int volume)
+{
+    load();
+    mPending[category][scenario] = volume;
+
+    if (++mRecords > cJournalCompactThreshold)
+    {
+        compact();
+        return;
+    }
+
+    gPersistenceWorker.appendFile(mPath,
+                      string_printf("%s %s %d\n", category, scenario, volume));
+}
+
+bool PreferencesJournal::lookup(const char * category,
+                                const char * scenario, int & volume)
+{
+    load();
+    TCategoryVolumes::iterator cat = mPending.find(category);
+    if (cat == mPending.end())
+        return false;
+    TScenarioVolumes::iterator entry = cat->second.find(scenario);
+    if (entry == cat->second.end())
+        return false;
+    volume = entry->second;
+    return true;
+}
+
+void PreferencesJournal::flushed(const char * category)
+{
+    load();
+    if (mPending.erase(category) > 0)
+        compact();
+}
+
+void PreferencesJournal::compact()
+{
+    // keep only the latest value of each entry not in luna-prefs yet,
+    // the worker switches files atomically (or truncates if none is left)
+    std::string content;
+    int records = 0;
+    for (TCategoryVolumes::iterator cat = mPending.begin();
+                                         cat != mPending.end(); ++cat)
+        for (TScenarioVolumes::iterator entry = cat->second.begin();
+                                      entry != cat->second.end(); ++entry)
+        {
+            append_format(content, "%s %s %d\n", cat->first.c_str(),
+                                       entry->first.c_str(), entry->second);
+            ++records;
+        }
+
+    gPersistenceWorker.replaceFile(mPath, content);
+    mRecords = records;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _PREFSJOURNAL_H_
+#define _PREFSJOURNAL_H_
+
+#include <map>
+#include <string>
+
+#ifndef PREFERENCES_JOURNAL_PATH
+#define PREFERENCES_JOURNAL_PATH "/var/lib/audiod/volume.journal"
+#endif
+
+/// Append-only journal of scenario volume changes.
+/// Each change is appended as one "<category> <scenario> <volume>" line,
+/// which is much cheaper than rewriting the module's luna-prefs value,
+/// and survives an audiod crash until the delayed luna-prefs store happens.
+/// Once a module stored its preferences, its entries are dropped and the
+/// journal is compacted. File writes are done by the persistence worker.
+class PreferencesJournal
+{
+public:
+    PreferencesJournal(const char * path);
+
+    /// Record a new volume for a scenario
+    void append(const char * category, const char * scenario, int volume);
+
+    /// Get a journaled volume not yet stored in luna-prefs
+    bool lookup(const char * category, const char * scenario, int & volume);
+
+    /// luna-prefs now has everything journaled for that category
+    void flushed(const char * category);
+
+private:
+    typedef std::map<std::string, int> TScenarioVolumes;
+    typedef std::map<std::string, TScenarioVolumes> TCategoryVolumes;
+
+    void load();
+    void compact();
+
+    std::string mPath;
+    bool mLoaded;
+    int mRecords;
+    TCategoryVolumes mPending;
+};
+
+extern PreferencesJournal gPreferencesJournal;
+
+#endif // _PREFSJOURNAL_H_
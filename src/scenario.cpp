@@ -37,49 +37,50 @@
 #include "alarm.h"
 #include "timer.h"
 #include "alert.h"
+#include "stateTransition.h"
 
 #define VOICE_COMMAND_SAMPLING_RATE 8000
 #define PHONE_SAMPLING_RATE 8000
 #define MEDIA_SAMPLING_RATE 44100
 
-const ConstString    cMedia_Default(MEDIA_SCENARIO_DEFAULT);
-const ConstString    cMedia_FrontSpeaker(MEDIA_SCENARIO_FRONT_SPEAKER);
-const ConstString    cMedia_BackSpeaker(MEDIA_SCENARIO_BACK_SPEAKER);
-const ConstString    cMedia_Headset(MEDIA_SCENARIO_HEADSET);
-const ConstString    cMedia_HeadsetMic(MEDIA_SCENARIO_HEADSET_MIC);
-const ConstString    cMedia_A2DP(MEDIA_SCENARIO_A2DP);
-const ConstString    cMedia_Wireless(MEDIA_SCENARIO_WIRELESS);
-
-const ConstString    cMedia_Mic_Front(MEDIA_MIC_FRONT);
-const ConstString    cMedia_Mic_HeadsetMic(MEDIA_MIC_HEADSET_MIC);
-
-const ConstString    cPhone_FrontSpeaker(PHONE_SCENARIO_FRONT_SPEAKER);
-const ConstString    cPhone_BackSpeaker(PHONE_SCENARIO_BACK_SPEAKER);
-const ConstString    cPhone_Headset(PHONE_SCENARIO_HEADSET);
-const ConstString    cPhone_HeadsetMic(PHONE_SCENARIO_HEADSET_MIC);
-const ConstString    cPhone_BluetoothSCO(PHONE_SCENARIO_BLUETOOTH_SCO);
-const ConstString    cPhone_TTY_Full(PHONE_SCENARIO_TTY_FULL);
-const ConstString    cPhone_TTY_HCO(PHONE_SCENARIO_TTY_HCO);
-const ConstString    cPhone_TTY_VCO(PHONE_SCENARIO_TTY_VCO);
-
-const ConstString    cVoiceCommand_BackSpeaker(VOICE_COMMAND_SCENARIO_BACK_SPEAKER);
-const ConstString    cVoiceCommand_Headset(VOICE_COMMAND_SCENARIO_HEADSET);
-const ConstString    cVoiceCommand_HeadsetMic(VOICE_COMMAND_SCENARIO_HEADSET_MIC);
-const ConstString    cVoiceCommand_BluetoothSCO(VOICE_COMMAND_SCENARIO_BLUETOOTH_SCO);
-
-const ConstString    cVoiceCommand_Mic_Front(VOICE_COMMAND_ );
-const ConstString    cVoiceCommand_Mic_HeadsetMic(VOICE_COMMAND_MIC_HEADSET_MIC);
-const ConstString    cVoiceCommand_Mic_BluetoothSCO(VOICE_COMMAND_MIC_BLUETOOTH_SCO);
-
-const ConstString    cVvm_BackSpeaker(VVM_SCENARIO_BACK_SPEAKER);
-const ConstString    cVvm_FrontSpeaker(VVM_SCENARIO_FRONT_SPEAKER);
-const ConstString    cVvm_Headset(VVM_SCENARIO_HEADSET);
-const ConstString    cVvm_HeadsetMic(VVM_SCENARIO_HEADSET_MIC);
-const ConstString    cVvm_BluetoothSCO(VVM_SCENARIO_BLUETOOTH_SCO);
-
-const ConstString    cVvm_Mic_Front(VVM_);
-const ConstString    cVvm_Mic_HeadsetMic(VVM_MIC_HEADSET_MIC);
-const ConstString    cVvm_Mic_BluetoothSCO(VVM_MIC_BLUETOOTH_SCO);
+const ConstString    cMedia_Default = ConstString::intern(MEDIA_SCENARIO_DEFAULT);
+const ConstString    cMedia_FrontSpeaker = ConstString::intern(MEDIA_SCENARIO_FRONT_SPEAKER);
+const ConstString    cMedia_BackSpeaker = ConstString::intern(MEDIA_SCENARIO_BACK_SPEAKER);
+const ConstString    cMedia_Headset = ConstString::intern(MEDIA_SCENARIO_HEADSET);
+const ConstString    cMedia_HeadsetMic = ConstString::intern(MEDIA_SCENARIO_HEADSET_MIC);
+const ConstString    cMedia_A2DP = ConstString::intern(MEDIA_SCENARIO_A2DP);
+const ConstString    cMedia_Wireless = ConstString::intern(MEDIA_SCENARIO_WIRELESS);
+
+const ConstString    cMedia_Mic_Front = ConstString::intern(MEDIA_MIC_FRONT);
+const ConstString    cMedia_Mic_HeadsetMic = ConstString::intern(MEDIA_MIC_HEADSET_MIC);
+
+const ConstString    cPhone_FrontSpeaker = ConstString::intern(PHONE_SCENARIO_FRONT_SPEAKER);
+const ConstString    cPhone_BackSpeaker = ConstString::intern(PHONE_SCENARIO_BACK_SPEAKER);
+const ConstString    cPhone_Headset = ConstString::intern(PHONE_SCENARIO_HEADSET);
+const ConstString    cPhone_HeadsetMic = ConstString::intern(PHONE_SCENARIO_HEADSET_MIC);
+const ConstString    cPhone_BluetoothSCO = ConstString::intern(PHONE_SCENARIO_BLUETOOTH_SCO);
+const ConstString    cPhone_TTY_Full = ConstString::intern(PHONE_SCENARIO_TTY_FULL);
+const ConstString    cPhone_TTY_HCO = ConstString::intern(PHONE_SCENARIO_TTY_HCO);
+const ConstString    cPhone_TTY_VCO = ConstString::intern(PHONE_SCENARIO_TTY_VCO);
+
+const ConstString    cVoiceCommand_BackSpeaker = ConstString::intern(VOICE_COMMAND_SCENARIO_BACK_SPEAKER);
+const ConstString    cVoiceCommand_Headset = ConstString::intern(VOICE_COMMAND_SCENARIO_HEADSET);
+const ConstString    cVoiceCommand_HeadsetMic = ConstString::intern(VOICE_COMMAND_SCENARIO_HEADSET_MIC);
+const ConstString    cVoiceCommand_BluetoothSCO = ConstString::intern(VOICE_COMMAND_SCENARIO_BLUETOOTH_SCO);
+
+const ConstString    cVoiceCommand_Mic_Front = ConstString::intern(VOICE_COMMAND_);
+const ConstString    cVoiceCommand_Mic_HeadsetMic = ConstString::intern(VOICE_COMMAND_MIC_HEADSET_MIC);
+const ConstString    cVoiceCommand_Mic_BluetoothSCO = ConstString::intern(VOICE_COMMAND_MIC_BLUETOOTH_SCO);
+
+const ConstString    cVvm_BackSpeaker = ConstString::intern(VVM_SCENARIO_BACK_SPEAKER);
+const ConstString    cVvm_FrontSpeaker = ConstString::intern(VVM_SCENARIO_FRONT_SPEAKER);
+const ConstString    cVvm_Headset = ConstString::intern(VVM_SCENARIO_HEADSET);
+const ConstString    cVvm_HeadsetMic = ConstString::intern(VVM_SCENARIO_HEADSET_MIC);
+const ConstString    cVvm_BluetoothSCO = ConstString::intern(VVM_SCENARIO_BLUETOOTH_SCO);
+
+const ConstString    cVvm_Mic_Front = ConstString::intern(VVM_);
+const ConstString    cVvm_Mic_HeadsetMic = ConstString::intern(VVM_MIC_HEADSET_MIC);
+const ConstString    cVvm_Mic_BluetoothSCO = ConstString::intern(VVM_MIC_BLUETOOTH_SCO);
 
 
 void
@@ -96,13 +97,13 @@ ScenarioModule::programHardwareState ()
          mCurrentScenario->getMicGainTics()))
         return;*/
     if(!gAudioMixer.inHfpAgRole()) {
-        if (!gAudioMixer.setRouting(mCurrentScenario->mName))
+        if (!gAudioMixer.setRouting(*mCurrentScenario))
             return;
     }
 
     programState();
 
-    if (mCurrentScenario->mName == "phone_bluetooth_sco" && gAudioMixer.getBTVolumeSupport()) {
+    if (mCurrentScenario->mName == cPhone_BluetoothSCO && gAudioMixer.getBTVolumeSupport()) {
         g_debug ("programHardwareState: BT has volume support, set MAX volume on DSP");
         gAudioMixer.programCallVoiceOrMICVolume ( 'a', 100);
     }
@@ -132,7 +133,7 @@ bool ScenarioModule::makeCurrent ()
 
     onActivating();
 
-    if(!strcmp(sCurrentModule->getCategory(),"media")){
+    if (sCurrentModule == getMediaModule()) {
         ConstString scenario = (ConstString)sCurrentModule->getCurrentScenarioName();
         g_message("Restoring hardware volume %s",scenario.c_str());
         gAudioDevice.restoreMediaVolume(scenario,60);
@@ -142,7 +143,10 @@ bool ScenarioModule::makeCurrent ()
     programHardwareState ();
     programSoftwareMixer(true);
 
-    programMuted ();
+    // muting follows the software mixer, even when a state transition
+    // defers both to its end
+    if (!StateTransition::deferProgramMuted())
+        programMuted ();
 
     CHECK(sendChangedUpdate (UPDATE_CHANGED_ACTIVE));
 
@@ -169,38 +173,167 @@ void ScenarioModule::_updateHardwareSettings(bool muteMediaSink)
     }
 }
 
+/// Target volumes computed by the modules' program*Volumes, for the last few
+/// combinations of what they read. Streams opening & closing in a loop then
+/// replay recorded volumes, rather than walking all the modules again.
+/// Anything not in the key invalidates the cache through
+/// gTargetVolumesGeneration. Main thread only.
+struct TargetVolumesKey
+{
+    VirtualSinkSet      mActiveStreams;
+    GenericScenario *   mScenarios[4];  ///< current module, media, phone, voice command
+    int                 mDuckingDB[eVirtualSink_Count]; ///< media's, before programming
+    guint               mGeneration;
+    bool                mRamp;
+    bool                mRingerOn;
+    bool                mOnActiveCall;
+    bool                mAlarmOn;
+    bool                mTimerOn;
+    bool                mAlarmAudible;
+
+    bool operator==(const TargetVolumesKey & rhs) const
+    {
+        return mActiveStreams == rhs.mActiveStreams &&
+               memcmp(mScenarios, rhs.mScenarios, sizeof(mScenarios)) == 0 &&
+               memcmp(mDuckingDB, rhs.mDuckingDB, sizeof(mDuckingDB)) == 0 &&
+               mGeneration == rhs.mGeneration && mRamp == rhs.mRamp &&
+               mRingerOn == rhs.mRingerOn && mOnActiveCall == rhs.mOnActiveCall &&
+               mAlarmOn == rhs.mAlarmOn && mTimerOn == rhs.mTimerOn &&
+               mAlarmAudible == rhs.mAlarmAudible;
+    }
+};
+
+struct TargetVolumes
+{
+    TargetVolumesKey    mKey;
+    guint               mLastUse;       ///< 0 when unused
+    VirtualSinkSet      mProgrammed;
+    int                 mVolume[eVirtualSink_Count];
+    bool                mRampVolume[eVirtualSink_Count];
+    int                 mRampDuration[eVirtualSink_Count];  ///< 0: Pulse's ramp, if any
+    ERampCurve          mRampCurve[eVirtualSink_Count];
+    int                 mDuckingDB[eVirtualSink_Count];     ///< media's, once programmed
+};
+
+static const int cTargetVolumesCacheSize = 8;
+static TargetVolumes sTargetVolumesCache[cTargetVolumesCacheSize];
+static guint sTargetVolumesUse = 0;
+/// Entry recording what ScenarioModule::programVolume is asked to program
+static TargetVolumes * sRecordedTargetVolumes = NULL;
+
+static TargetVolumes *
+_findTargetVolumes(const TargetVolumesKey & key, bool & found)
+{
+    TargetVolumes * oldest = &sTargetVolumesCache[0];
+    for (int i = 0; i < cTargetVolumesCacheSize; ++i)
+    {
+        TargetVolumes & entry = sTargetVolumesCache[i];
+        if (entry.mLastUse && entry.mKey == key)
+        {
+            entry.mLastUse = ++sTargetVolumesUse;
+            found = true;
+            return &entry;
+        }
+        if (entry.mLastUse < oldest->mLastUse)
+            oldest = &entry;
+    }
+
+    oldest->mKey = key;
+    oldest->mLastUse = ++sTargetVolumesUse;
+    oldest->mProgrammed.clear();
+    found = false;
+    return oldest;
+}
+
+static void
+_clearTargetVolumes()
+{
+    for (int i = 0; i < cTargetVolumesCacheSize; ++i)
+        sTargetVolumesCache[i].mLastUse = 0;
+}
+
+bool ScenarioModule::UnitTest()
+{
+    int failures = unitTestFailureCount();
+
+    TargetVolumesKey key, other;
+    memset(&key, 0, sizeof(key));
+    key.mActiveStreams.add(emedia);
+    key.mGeneration = gTargetVolumesGeneration;
+    key.mRamp = true;
+    other = key;
+    UT_CHECK(key == other);
+    other.mActiveStreams.add(enotifications);
+    UT_CHECK(!(key == other));
+    other = key;
+    other.mDuckingDB[emedia] = -12;
+    UT_CHECK(!(key == other));
+    other = key;
+    other.mScenarios[1] = (GenericScenario *) &other;
+    UT_CHECK(!(key == other));
+    other = key;
+    other.mRingerOn = true;
+    UT_CHECK(!(key == other));
+
+    // found once recorded, then forgotten on invalidation or by eviction
+    _clearTargetVolumes();
+    bool found;
+    TargetVolumes * entry = _findTargetVolumes(key, found);
+    UT_CHECK(!found);
+    UT_CHECK(_findTargetVolumes(key, found) == entry && found);
+    invalidateTargetVolumes();
+    other = key;
+    other.mGeneration = gTargetVolumesGeneration;
+    _findTargetVolumes(other, found);
+    UT_CHECK(!found);
+    for (int i = 0; i < cTargetVolumesCacheSize; ++i)
+    {
+        other.mDuckingDB[emedia] = -1 - i;
+        _findTargetVolumes(other, found);
+        UT_CHECK(!found);
+    }
+    _findTargetVolumes(key, found);
+    UT_CHECK(!found);
+
+    _clearTargetVolumes();
+    return unitTestFailureCount() == failures;
+}
+
 void ScenarioModule::programSoftwareMixer (bool ramp, bool muteMediaSink)
 {
     if (VERIFY(isCurrentModule()))
     {
         LogIndent    indentLogs("| ");
 
+        // state changes program the module they end up with, once
+        if (StateTransition::deferProgramSoftwareMixer(ramp))
+            return;
+
         if (!gAudioMixer.readyToProgram())
         {
             g_warning ("%s: audio mixer not ready for programming", __FUNCTION__);
             return;
         }
 
-        if ((!mCurrentScenario) && (!(dynamic_cast <Scenario *> (mCurrentScenario))))
+        Scenario * scenario = dynamic_cast <Scenario *> (mCurrentScenario);
+        if (!scenario)
         {
             g_warning ("%s: no current scenario", __FUNCTION__);
             return;
         }
 
 
-        ConstString tail;
-
-        if (mCurrentScenario->mName.hasPrefix(VOICE_COMMAND_, tail)) {
+        if (scenario->isClass(eScenarioClass_VoiceCommand)) {
             gAudioMixer.updateRate(VOICE_COMMAND_SAMPLING_RATE);
-        } else if (mCurrentScenario->mName.hasPrefix(PHONE_, tail)) {
+        } else if (scenario->isClass(eScenarioClass_Phone)) {
             gAudioMixer.updateRate(PHONE_SAMPLING_RATE);
         } else {
             gAudioMixer.updateRate(MEDIA_SAMPLING_RATE);
         }
 
-        dynamic_cast <Scenario *> (mCurrentScenario)->logRoutes();
+        scenario->logRoutes();
 
-        gAudioMixer.programFilter(dynamic_cast <Scenario *> (mCurrentScenario)->mFilter);
+        gAudioMixer.programFilter(scenario->mFilter);
 
         /* effects' volume is only ever set here, when we switch module
         in particular, which is the only possible cause for a change*/
@@ -212,46 +345,82 @@ void ScenarioModule::programSoftwareMixer (bool ramp, bool muteMediaSink)
             gAudioMixer.programVolume (eeffects, gState.getOnActiveCall () ?
                                                      25 : 0);
 
-        // emedia, eflash, edefaultapp, enavigation
-        //getMediaModule()->programMediaVolumes(ramp, ramp, muteMediaSink);
-        //changed to implement policy of restoring volume level of sinks after headset is removed
-        getMediaModule()->programMediaVolumes(ramp, ramp, FALSE);
-        // eringtones
-        getRingtoneModule()->programRingToneVolumes(ramp);
-        // eDTMF, efeedback
-        getSystemModule()->programSystemVolumes(ramp);
-        // evoicedial
-        getVoiceCommandModule()->programVoiceCommandVolume(ramp);
-        // enotifications, ecalendar
-        getNotificationModule()->programNotificationVolumes(ramp);
-        // ealarm
-        getAlarmModule()->programAlarmVolumes(ramp);
-       // etimer
-        getTimerModule()->programTimerVolumes(ramp);
-       //ealerts,effects
-        getAlertModule()->programAlertVolumes(ramp);
-        //ecallertone
-        getPhoneModule()->programCallertoneVolume(ramp);
-        // Update routing
-        for (EVirtualSink sink = eVirtualSink_First; sink <= eVirtualSink_Last;
-               sink = EVirtualSink(sink + 1))
+        TargetVolumesKey key;
+        memset(&key, 0, sizeof(key));
+        key.mActiveStreams = gAudioMixer.getActiveStreams();
+        key.mScenarios[0] = mCurrentScenario;
+        key.mScenarios[1] = getMediaModule()->mCurrentScenario;
+        key.mScenarios[2] = getPhoneModule()->mCurrentScenario;
+        key.mScenarios[3] = getVoiceCommandModule()->mCurrentScenario;
+        memcpy(key.mDuckingDB, getMediaModule()->getDuckingDB(), sizeof(key.mDuckingDB));
+        key.mGeneration = gTargetVolumesGeneration;
+        key.mRamp = ramp;
+        key.mRingerOn = gState.getRingerOn();
+        key.mOnActiveCall = gState.getOnActiveCall();
+        key.mAlarmOn = getAlarmModule()->getAlarmOn();
+        key.mTimerOn = getTimerModule()->getTimerOn();
+        key.mAlarmAudible = gAudioMixer.isSinkAudible(ealarm);
+
+        bool found;
+        TargetVolumes * targetVolumes = _findTargetVolumes(key, found);
+        if (found)
         {
-            if (!strcmp(mCurrentScenario->getName(),"phone_bluetooth_sco") &&
-                 (sink == emedia || sink == edefaultapp))
-                 g_debug ("dont move media/defaultapp streams to MainSink");
-             else {
-                 EPhysicalSink    destination = dynamic_cast <Scenario *> (mCurrentScenario)->getDestination(sink);
-
-                 gAudioMixer.programDestination (sink, destination);
+            for (EVirtualSink sink = eVirtualSink_First; sink <= eVirtualSink_Last;
+                   sink = EVirtualSink(sink + 1))
+            {
+                if (!targetVolumes->mProgrammed.contain(sink))
+                    continue;
+                if (targetVolumes->mRampDuration[sink] > 0)
+                    gAudioMixer.rampVolume(sink, targetVolumes->mVolume[sink],
+                                           targetVolumes->mRampDuration[sink],
+                                           targetVolumes->mRampCurve[sink]);
+                else
+                    gAudioMixer.programVolume(sink, targetVolumes->mVolume[sink],
+                                              targetVolumes->mRampVolume[sink]);
             }
+            getMediaModule()->setDuckingDB(targetVolumes->mDuckingDB);
         }
-        for (EVirtualSource source = eVirtualSource_First; source <=
-               eVirtualSource_Last; source = EVirtualSource(source + 1))
+        else
         {
-            EPhysicalSource destination = dynamic_cast <Scenario *> (mCurrentScenario)->getDestination(source);
-
-            gAudioMixer.programDestination (source, destination);
+            sRecordedTargetVolumes = targetVolumes;
+
+            // emedia, eflash, edefaultapp, enavigation
+            //getMediaModule()->programMediaVolumes(ramp, ramp, muteMediaSink);
+            //changed to implement policy of restoring volume level of sinks after headset is removed
+            getMediaModule()->programMediaVolumes(ramp, ramp, FALSE);
+            // eringtones
+            getRingtoneModule()->programRingToneVolumes(ramp);
+            // eDTMF, efeedback
+            getSystemModule()->programSystemVolumes(ramp);
+            // evoicedial
+            getVoiceCommandModule()->programVoiceCommandVolume(ramp);
+            // enotifications, ecalendar
+            getNotificationModule()->programNotificationVolumes(ramp);
+            // ealarm
+            getAlarmModule()->programAlarmVolumes(ramp);
+            // etimer
+            getTimerModule()->programTimerVolumes(ramp);
+            //ealerts,effects
+            getAlertModule()->programAlertVolumes(ramp);
+            //ecallertone
+            getPhoneModule()->programCallertoneVolume(ramp);
+
+            memcpy(targetVolumes->mDuckingDB, getMediaModule()->getDuckingDB(),
+                                              sizeof(targetVolumes->mDuckingDB));
+            sRecordedTargetVolumes = NULL;
+        }
+        // Update routing: the mixer only sends what changed
+        int sinkDestinations[eVirtualSink_Count];
+        memcpy(sinkDestinations, scenario->getDestinations(gState.getRingerOn()),
+                                                     sizeof(sinkDestinations));
+        if (mCurrentScenario->mName == cPhone_BluetoothSCO)
+        {
+            g_debug ("dont move media/defaultapp streams to MainSink");
+            sinkDestinations[emedia] = -1;
+            sinkDestinations[edefaultapp] = -1;
         }
+        gAudioMixer.programDestinations(sinkDestinations,
+                                        scenario->getSourceDestinations());
 
 //for balance;
          g_message("The volume balance applying for the BT case = %d\n",gState.getSoundBalance());
@@ -260,9 +429,9 @@ void ScenarioModule::programSoftwareMixer (bool ramp, bool muteMediaSink)
     }
 }
 
-bool ScenarioModule::programVolume (EVirtualSink sink, int volume, bool ramp)
+bool ScenarioModule::getRoutedVolume (EVirtualSink sink, int & volume, bool & routed)
 {
-    bool routed = true;
+    routed = true;
     if ((!sCurrentModule) && (!(dynamic_cast <ScenarioModule *> (sCurrentModule))))
     {
         g_warning ("%s: no current module exiting", __FUNCTION__);
@@ -283,11 +452,46 @@ bool ScenarioModule::programVolume (EVirtualSink sink, int volume, bool ramp)
         volume = 0;
         routed = false;
     }
+    return true;
+}
+
+void ScenarioModule::recordTargetVolume (EVirtualSink sink, int volume, bool ramp,
+                                         int duration, ERampCurve curve)
+{
+    if (sRecordedTargetVolumes && IsValidVirtualSink(sink))
+    {
+        sRecordedTargetVolumes->mProgrammed.add(sink);
+        sRecordedTargetVolumes->mVolume[sink] = volume;
+        sRecordedTargetVolumes->mRampVolume[sink] = ramp;
+        sRecordedTargetVolumes->mRampDuration[sink] = duration;
+        sRecordedTargetVolumes->mRampCurve[sink] = curve;
+    }
+}
+
+bool ScenarioModule::programVolume (EVirtualSink sink, int volume, bool ramp)
+{
+    bool routed;
+    if (!getRoutedVolume(sink, volume, routed))
+        return false;
+
+    recordTargetVolume(sink, volume, ramp, 0, eRampCurve_Linear);
 
     // always program the volume, even if it's not routed
     return gAudioMixer.programVolume (sink, volume, ramp) && routed;
 }
 
+bool ScenarioModule::rampVolume (EVirtualSink sink, int volume,
+                                 int duration, ERampCurve curve)
+{
+    bool routed;
+    if (!getRoutedVolume(sink, volume, routed))
+        return false;
+
+    recordTargetVolume(sink, volume, true, duration, curve);
+
+    return gAudioMixer.rampVolume (sink, volume, duration, curve) && routed;
+}
+
 bool ScenarioModule::programMute (EVirtualSource source, int mute)
 {
     bool    routed = true;
@@ -372,30 +576,16 @@ bool ScenarioModule::getScenarioLatency (const char * name, int & latency)
     return true;
 }
 
-ScenarioRoute * Scenario::getScenarioRoute(EVirtualSink sink, bool ringerOn)
-{
-    if (VERIFY(sink >= 0 && sink < eVirtualSink_Count))
-        return ringerOn ? mRoutesRingerOn + sink : mRoutesRingerOff + sink;
-    return 0;
-}
-
-ScenarioRoute * Scenario::getScenarioRoute(EVirtualSource source, bool ringerOn)
-{
-    if (VERIFY(source >= 0 && source < eVirtualSource_Count))
-        return mRoutesSource + source;
-    return 0;
-}
-
 void Scenario::configureRoute (EVirtualSink sink,
                           EPhysicalSink destination,
                           bool ringerSwitchOn,
                           bool enabled)
 {
-    ScenarioRoute * route = getScenarioRoute(sink, ringerSwitchOn);
-    if (VERIFY(route))
+    if (VERIFY(IsValidVirtualSink(sink)))
     {
-        route->mDestination = destination;
-        route->mRouted = enabled;
+        mSinkDestinations[ringerSwitchOn][sink] = destination;
+        mSinkRouted[ringerSwitchOn][sink] = enabled;
+        invalidateTargetVolumes();
     }
 }
 
@@ -404,43 +594,38 @@ void Scenario::configureRoute (EVirtualSource source,
                           bool ringerSwitchOn,
                           bool enabled)
 {
-    ScenarioRoute * route = getScenarioRoute(source, ringerSwitchOn);
-    if (VERIFY(route))
+    if (VERIFY(IsValidVirtualSource(source)))
     {
-        route->mDestination = destination;
-        route->mRouted = enabled;
+        mSourceDestinations[source] = destination;
+        mSourceRouted[source] = enabled;
     }
 }
 
 bool Scenario::isRouted(EVirtualSink sink)
 {
-    ScenarioRoute * route = getScenarioRoute(sink, gState.getRingerOn());
-    if (VERIFY(route))
-        return route->mRouted;
+    if (VERIFY(IsValidVirtualSink(sink)))
+        return mSinkRouted[gState.getRingerOn()][sink];
     return false;
 }
 
 bool Scenario::isRouted(EVirtualSource source)
 {
-    ScenarioRoute * route = getScenarioRoute(source, gState.getRingerOn());
-    if (VERIFY(route))
-        return route->mRouted;
+    if (VERIFY(IsValidVirtualSource(source)))
+        return mSourceRouted[source];
     return false;
 }
 
 EPhysicalSink Scenario::getDestination(EVirtualSink sink)
 {
-    ScenarioRoute * route = getScenarioRoute(sink, gState.getRingerOn());
-    if (VERIFY(route))
-        return (EPhysicalSink)route->mDestination;
+    if (VERIFY(IsValidVirtualSink(sink)))
+        return (EPhysicalSink)mSinkDestinations[gState.getRingerOn()][sink];
     return eMainSink;
 }
 
 EPhysicalSource Scenario::getDestination(EVirtualSource source)
 {
-    ScenarioRoute * route = getScenarioRoute(source, gState.getRingerOn());
-    if (VERIFY(route))
-        return (EPhysicalSource)route->mDestination;
+    if (VERIFY(IsValidVirtualSource(source)))
+        return (EPhysicalSource)mSourceDestinations[source];
     return eMainSource;
 }
 
@@ -449,10 +634,10 @@ void Scenario::logRoutes() const
     std::string    routeList;
     routeList.reserve(200);
     bool    ringerOn = gState.getRingerOn();
-    const ScenarioRoute * routes = (ringerOn ? mRoutesRingerOn : mRoutesRingerOff);
+    const bool * routed = mSinkRouted[ringerOn];
     for (int sink = eVirtualSink_First; sink <= eVirtualSink_Last; ++sink)
     {
-        if (routes[sink].mRouted)
+        if (routed[sink])
         {
             if (routeList.size() > 0)
                 routeList += ", ";
@@ -461,10 +646,9 @@ void Scenario::logRoutes() const
     }
     g_message("Routes for %s ringer %s: %s.", this->getName(),
                                    ringerOn ? "on" : "off", routeList.c_str());
-    const ScenarioRoute * sourceroutes = mRoutesSource;
     for (int source = eVirtualSource_First; source <= eVirtualSource_Last; ++source)
     {
-        if (sourceroutes[source].mRouted)
+        if (mSourceRouted[source])
         {
             if (routeList.size() > 0)
                 routeList += ", ";
@@ -492,6 +676,15 @@ Scenario::Scenario(const ConstString & name,
     mLatency(SCENARIO_DEFAULT_LATENCY)
     
 {
-
+    for (int sink = 0; sink < eVirtualSink_Count; ++sink)
+    {
+        mSinkDestinations[0][sink] = mSinkDestinations[1][sink] = eMainSink;
+        mSinkRouted[0][sink] = mSinkRouted[1][sink] = false;
+    }
+    for (int source = 0; source < eVirtualSource_Count; ++source)
+    {
+        mSourceDestinations[source] = eMainSink;
+        mSourceRouted[source] = false;
+    }
 }
 
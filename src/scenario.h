@@ -76,13 +76,6 @@ enum ESendUpdate {
     eUpdate_GetSoundOut
 };*/
 
-struct ScenarioRoute {
-    ScenarioRoute() : mDestination(eMainSink), mRouted(false) {}
-
-    int mDestination;
-    bool mRouted;
-};
-
 /// Scenario names: always use these definitions rather than constants!
 extern const ConstString    cMedia_Default;
 extern const ConstString    cMedia_BackSpeaker;
@@ -183,15 +176,22 @@ public:
     EPhysicalSink getDestination(EVirtualSink sink);
     EPhysicalSource getDestination(EVirtualSource source);
 
+    /// Destinations of all sinks, indexed by EVirtualSink
+    const int * getDestinations(bool ringerOn) const
+                    { return mSinkDestinations[ringerOn]; }
+    /// Destinations of all sources, indexed by EVirtualSource
+    const int * getSourceDestinations() const
+                    { return mSourceDestinations; }
+
     void logRoutes() const;
 
 private:
-    ScenarioRoute * getScenarioRoute(EVirtualSink sink, bool ringerOn);
-    ScenarioRoute * getScenarioRoute(EVirtualSource source, bool ringerOn);
-
-    ScenarioRoute mRoutesRingerOn[eVirtualSink_Count];
-    ScenarioRoute mRoutesRingerOff[eVirtualSink_Count];
-    ScenarioRoute mRoutesSource[eVirtualSource_Count];
+    /// Flat tables, so that the mixer can diff them against its own state
+    /// in one pass. Sink routes depend on the ringer switch: [off, on].
+    int  mSinkDestinations[2][eVirtualSink_Count];
+    bool mSinkRouted[2][eVirtualSink_Count];
+    int  mSourceDestinations[eVirtualSource_Count];
+    bool mSourceRouted[eVirtualSource_Count];
 
 };
 
@@ -204,6 +204,9 @@ public:
 
     ScenarioModule(const ConstString & category) : GenericScenarioModule(category){}
 
+    /// Built-in unit test of the target volumes cache: Returns true on success.
+    static bool     UnitTest();
+
     
 
     bool            makeCurrent();
@@ -220,6 +223,9 @@ public:
     bool            programMute (EVirtualSource source, int mute);
     bool            rampVolume (EVirtualSink sink, int volume)
                                 { return programVolume (sink, volume, true); }
+    /// Ramp stepped by audiod, over duration ms
+    bool            rampVolume (EVirtualSink sink, int volume,
+                                int duration, ERampCurve curve);
 
     
 
@@ -230,6 +236,14 @@ protected:
     
     void            _updateHardwareSettings(bool muteMediaSink = false);
 
+private:
+    /// Volume a sink gets in the current scenario: none if not routed.
+    /// Returns false without a current module & scenario.
+    static bool     getRoutedVolume (EVirtualSink sink, int & volume, bool & routed);
+    /// Note what programSoftwareMixer programs, when recording
+    static void     recordTargetVolume (EVirtualSink sink, int volume, bool ramp,
+                                        int duration, ERampCurve curve);
+
 };
 
 #endif // _SCENARIO_H_
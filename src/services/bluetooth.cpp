@@ -213,4 +213,4 @@ BluetoothInterfaceInit(GMainLoop *loop, LSHandle *handle)
     return 0;
 }
 
-SERVICE_START_FUNC (BluetoothInterfaceInit);
+SERVICE_START_FUNC_DEPS (BluetoothInterfaceInit, eInitPriority_Deferred, NULL);
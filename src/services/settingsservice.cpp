@@ -94,5 +94,5 @@ SettingsServiceInterfaceInit(GMainLoop *loop, LSHandle *handle)
     return 0;
 }
 
-SERVICE_START_FUNC(SettingsServiceInterfaceInit);
+SERVICE_START_FUNC_DEPS (SettingsServiceInterfaceInit, eInitPriority_Deferred, NULL);
 
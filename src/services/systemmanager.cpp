@@ -151,5 +151,5 @@ SystemmanagerInterfaceInit(GMainLoop *loop, LSHandle *handle)
     return 0;
 }
 
-SERVICE_START_FUNC (SystemmanagerInterfaceInit);
+SERVICE_START_FUNC_DEPS (SystemmanagerInterfaceInit, eInitPriority_Deferred, NULL);
 
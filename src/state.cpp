@@ -41,6 +41,10 @@
 #include "timer.h"
 #include "alert.h"
 #include "genericScenarioModule.h"
+#include "startupProfile.h"
+#include "controlTrace.h"
+#include "playLatency.h"
+#include "stateTransition.h"
 #include <pulse/simple.h>
 
 
@@ -191,6 +195,7 @@ State::State()
     mRecordOpened = false;
     mLoopback = false;
     mRTPLoaded = false;
+    mStoreTimerID = 0;
 
     // declare & initialize supported preferences to default values.
     // No other preference are supported.
@@ -310,6 +315,7 @@ static int firstCall = 1;
 
 void State::setOnActiveCall (bool state, ECallMode mode)
 {
+    StateTransition transition(eStateEvent_OnActiveCall, state, mode);
     int totalState = 0;
 
     if (mode == eCallMode_Carrier) {
@@ -428,6 +434,7 @@ bool State::checkPhoneScenario (ScenarioModule * phone)
 
 void State::setRingerOn (bool ringerOn)
 {
+    StateTransition transition(eStateEvent_Ringer, ringerOn);
     if (getRingerOn() != ringerOn)
     {
         gState.setPreference(cPref_RingerOn, ringerOn);
@@ -630,6 +637,7 @@ ECallMode State::getCallMode ()
 
 void State::setCallMode (ECallMode mode, ECallStatus status)
 {
+    StateTransition transition(eStateEvent_CallMode, mode, status);
     ScenarioModule * phone = getPhoneModule();
     MediaScenarioModule * media = getMediaModule();
 
@@ -879,6 +887,7 @@ static const char * _getHeadsetStateName(EHeadsetState state)
 
 void State::setHeadsetState (EHeadsetState newState)
 {
+    StateTransition transition(eStateEvent_Headset, newState);
     EHeadsetState previousState = getHeadsetState();
 
     if (previousState == newState)
@@ -1028,11 +1037,10 @@ bool State::setPreference(const char * name, bool value)
                                  is not a supported boolean preference", name);
         return false;
     }
-    if (pref->second.mValue != value)
-    {
-        pref->second.mValue = value;
-        storePreferences();
-    }
+    // restored preferences are set behind our back, then set again
+    invalidateTargetVolumes();
+    if (pref->second.set(value))
+        scheduleStorePreferences();
     return true;
 }
 
@@ -1045,11 +1053,8 @@ bool State::setPreference(const char * name, int balance)
                                  is not a supported integer preference", name);
         return false;
     }
-    if (pref->second.mValue != balance)
-    {
-        pref->second.mValue = balance;
-        storePreferences();
-    }
+    if (pref->second.set(balance))
+        scheduleStorePreferences();
     return true;
 }
 
@@ -1088,11 +1093,8 @@ bool State::setPreference(const char * name, const std::string & value)
                                  is not a supported string preference", name);
         return false;
     }
-    if (pref->second.mValue != value)
-    {
-        pref->second.mValue = value;
-        storePreferences();
-    }
+    if (pref->second.set(value))
+        scheduleStorePreferences();
     return true;
 }
 
@@ -1130,6 +1132,7 @@ bool State::getPhoneLocked ()
 
 void State::setIncomingCallActive (bool state, ECallMode mode)
 {
+    StateTransition transition(eStateEvent_IncomingCallActive, state, mode);
     if (mode == eCallMode_Carrier) {
         if (mIncomingCarrierCallActive == state)
             return;
@@ -1443,6 +1446,95 @@ _getTouchSound(LSHandle *lshandle, LSMessage *message, void *ctx)
     return true;
 }
 
+static bool
+_getStartupProfile(LSHandle *lshandle, LSMessage *message, void *ctx)
+{
+    LSMessageJsonParser    msg(message, SCHEMA_0);
+    if (!msg.parse(__FUNCTION__, lshandle))
+        return true;
+
+    pbnjson::JValue    reply = pbnjson::Object();
+    reply.put("returnValue", true);
+    startupProfileToJson(reply);
+
+    CLSError lserror;
+    if (!LSMessageReply(lshandle, message, jsonToString(reply).c_str(), &lserror))
+        lserror.Print(__FUNCTION__, __LINE__);
+
+    return true;
+}
+
+static bool
+_getMetrics(LSHandle *lshandle, LSMessage *message, void *ctx)
+{
+    LSMessageJsonParser    msg(message, SCHEMA_1(OPTIONAL(reset, boolean)));
+    if (!msg.parse(__FUNCTION__, lshandle))
+        return true;
+
+    bool reset = false;
+    msg.get("reset", reset);
+
+    pbnjson::JValue    reply = pbnjson::Object();
+    reply.put("returnValue", true);
+    lunaMetricsToJson(reply, reset);
+    playLatencyToJson(reply, reset);
+    // cumulative: reset doesn't apply, the log file reports them too
+    reply.put("droppedLogLines", (int64_t) getDroppedLogLines());
+
+    CLSError lserror;
+    if (!LSMessageReply(lshandle, message, jsonToString(reply).c_str(), &lserror))
+        lserror.Print(__FUNCTION__, __LINE__);
+
+    return true;
+}
+
+static bool
+_getTransitionLog(LSHandle *lshandle, LSMessage *message, void *ctx)
+{
+    LSMessageJsonParser    msg(message, SCHEMA_0);
+    if (!msg.parse(__FUNCTION__, lshandle))
+        return true;
+
+    pbnjson::JValue    reply = pbnjson::Object();
+    reply.put("returnValue", true);
+    stateTransitionLogToJson(reply);
+
+    CLSError lserror;
+    if (!LSMessageReply(lshandle, message, jsonToString(reply).c_str(), &lserror))
+        lserror.Print(__FUNCTION__, __LINE__);
+
+    return true;
+}
+
+static bool
+_dumpTrace(LSHandle *lshandle, LSMessage *message, void *ctx)
+{
+    LSMessageJsonParser    msg(message, SCHEMA_0);
+    if (!msg.parse(__FUNCTION__, lshandle))
+        return true;
+
+    int count = traceDump(cTraceDumpPath);
+    std::string reply;
+    if (count >= 0)
+    {
+        pbnjson::JValue    json = pbnjson::Object();
+        json.put("returnValue", true);
+        json.put("path", cTraceDumpPath);
+        json.put("records", count);
+        reply = jsonToString(json);
+    }
+    else
+    {
+        reply = STANDARD_JSON_ERROR(2, "can't write the trace dump");
+    }
+
+    CLSError lserror;
+    if (!LSMessageReply(lshandle, message, reply.c_str(), &lserror))
+        lserror.Print(__FUNCTION__, __LINE__);
+
+    return true;
+}
+
 static bool
 _setTouchSound(LSHandle *lshandle, LSMessage *message, void *ctx)
 {
@@ -1897,7 +1989,7 @@ State::setPreferenceRequest(LSHandle *lshandle, LSMessage *message, void *ctx)
                 TBooleanPreferences::iterator iter = gState.mBooleanPreferences.find(name);
                 if (iter != gState.mBooleanPreferences.end())
                 {
-                    iter->second.mValue = boolValue;
+                    iter->second.set(boolValue);
                     g_debug("Boolean");
                     found = true;
 
@@ -1912,7 +2004,7 @@ State::setPreferenceRequest(LSHandle *lshandle, LSMessage *message, void *ctx)
                 TStringPreferences::iterator iter = gState.mStringPreferences.find(name);
                 if (iter != gState.mStringPreferences.end())
                 {
-                    iter->second.mValue = stringValue;
+                    iter->second.set(stringValue);
                     g_debug("String");
                     found = true;
                 }
@@ -1927,7 +2019,7 @@ State::setPreferenceRequest(LSHandle *lshandle, LSMessage *message, void *ctx)
 
     // if we changed any setting, we save, reply with success and only log warnings
     if (reply == success)
-        gState.storePreferences();
+        gState.scheduleStorePreferences();
 
     CLSError lserror;
     if (!LSMessageReply(lshandle, message, reply, &lserror))
@@ -2190,6 +2282,10 @@ static LSMethod stateMethods[] = {
     { "getSoundProfile", _getSoundProfile},
     { "setSoundProfile", _setSoundProfile},
     { "getTouchSound", _getTouchSound},
+    { "getStartupProfile", _getStartupProfile},
+    { "getMetrics", _getMetrics},
+    { "dumpTrace", _dumpTrace},
+    { "getTransitionLog", _getTransitionLog},
     { },
 };
 
@@ -2216,6 +2312,6 @@ ServiceInterfaceInit(GMainLoop *loop, LSHandle *handle)
     return 0;
 }
 
-INIT_FUNC (StateInit);
+INIT_FUNC_DEPS (StateInit, eInitPriority_Critical, NULL);
 CONTROL_START_FUNC (ControlInterfaceInit);
 SERVICE_START_FUNC (ServiceInterfaceInit);
@@ -56,12 +56,25 @@ enum ETTYMode
 
 template <class T> struct PreferencePair
 {
+    PreferencePair() : mValue(), mDefaultValue(), mDirty(false) {}
+
     void    init(const T & value)
     {
         mValue = mDefaultValue = value;
+        mDirty = false;
+    }
+    /// Change the value, flagging it for the next store if it changed
+    bool    set(const T & value)
+    {
+        if (mValue == value)
+            return false;
+        mValue = value;
+        mDirty = true;
+        return true;
     }
     T    mValue;
     T    mDefaultValue;
+    bool mDirty;
 };
 
 typedef std::map<std::string, PreferencePair<bool> > TBooleanPreferences;
@@ -169,6 +182,10 @@ public:
     /// Store/restore all preferences
     bool storePreferences();
     bool restorePreferences();
+    /// Store changed preferences shortly, coalescing bursts of changes
+    void scheduleStorePreferences();
+    /// The persistence worker is done with our last store
+    void onPreferencesStored(bool stored);
 
     // combines vibrate switch state & vibrate preferences
     bool shouldVibrate();
@@ -278,6 +295,7 @@ private:
     bool mBTHfpConnected;
     int mBallance;
     TintPreferences      mIntegerPreferences;
+    guint                mStoreTimerID;
     bool mQvoiceOpened;
     bool mRecordOpened;
     bool mLoopback;
@@ -0,0 +1,206 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stateTransition.h"
+#include "state.h"
+#include "phone.h"
+#include "controlTrace.h"
+#include "log.h"
+
+/// A few calls worth of transitions. Once full, the oldest are overwritten.
+static const int cStateTransitionLogSize = 256;
+
+/// What the policy decided, as seen from outside
+struct StateSnapshot
+{
+    int             mCallMode;
+    bool            mOnActiveCall;
+    bool            mIncomingCallActive;
+    int             mHeadset;
+    bool            mRingerOn;
+    const char *    mModule;
+    const char *    mPhoneScenario;
+};
+
+struct StateTransitionRecord
+{
+    gint64          mTime;
+    char            mEvent;
+    int             mArg0;
+    int             mArg1;
+    int             mDepth;
+    int             mProgrammed;    // deferred programSoftwareMixer calls, outermost only
+    bool            mDone;
+    StateSnapshot   mBefore;
+    StateSnapshot   mAfter;
+};
+
+static StateTransitionRecord sTransitions[cStateTransitionLogSize];
+static int sTransitionCount = 0;    // total recorded, the ring holds the last ones
+static gint64 sOrigin = g_get_monotonic_time();
+
+static int sDepth = 0;
+static int sDeferredCalls = 0;
+static bool sDeferredRamp = true;
+static bool sDeferredMuted = false;
+
+static void
+_snapshot(StateSnapshot & snapshot)
+{
+    GenericScenarioModule * module = GenericScenarioModule::getCurrent();
+    ScenarioModule * phone = getPhoneModule();
+    snapshot.mCallMode = gState.getCallMode();
+    snapshot.mOnActiveCall = gState.getOnActiveCall();
+    snapshot.mIncomingCallActive = gState.getIncomingCallActive();
+    snapshot.mHeadset = gState.getHeadsetState();
+    snapshot.mRingerOn = gState.getRingerOn();
+    snapshot.mModule = module ? module->getCategory() : "none";
+    snapshot.mPhoneScenario = phone ? phone->getCurrentScenarioName() : "none";
+}
+
+static StateTransitionRecord *
+_getRecord(int index)
+{
+    if (index < 0 || sTransitionCount - index > cStateTransitionLogSize)
+        return NULL;    // overwritten meanwhile
+    return &sTransitions[index % cStateTransitionLogSize];
+}
+
+StateTransition::StateTransition(EStateEvent event, int arg0, int arg1) :
+    mRecord(sTransitionCount++)
+{
+    StateTransitionRecord & record = sTransitions[mRecord % cStateTransitionLogSize];
+    record.mTime = g_get_monotonic_time();
+    record.mEvent = event;
+    record.mArg0 = arg0;
+    record.mArg1 = arg1;
+    record.mDepth = sDepth;
+    record.mProgrammed = 0;
+    record.mDone = false;
+    _snapshot(record.mBefore);
+
+    traceEvent(eTrace_StateEvent, event, 0, arg0, arg1, sDepth);
+    ++sDepth;
+}
+
+StateTransition::~StateTransition()
+{
+    int programmed = 0;
+    if (--sDepth == 0 && (sDeferredCalls > 0 || sDeferredMuted))
+    {
+        programmed = sDeferredCalls;
+        bool ramp = sDeferredRamp;
+        bool muted = sDeferredMuted;
+        sDeferredCalls = 0;
+        sDeferredRamp = true;
+        sDeferredMuted = false;
+        g_debug("%s: programming once for %i request(s)", __FUNCTION__, programmed);
+        if (ScenarioModule * module = dynamic_cast <ScenarioModule *> (ScenarioModule::getCurrent()))
+        {
+            if (programmed > 0)
+                module->programSoftwareMixer(ramp);
+            if (muted)
+                module->programMuted();
+        }
+    }
+
+    if (StateTransitionRecord * record = _getRecord(mRecord))
+    {
+        record->mProgrammed = programmed;
+        record->mDone = true;
+        _snapshot(record->mAfter);
+    }
+}
+
+bool StateTransition::deferProgramSoftwareMixer(bool ramp)
+{
+    if (sDepth == 0)
+        return false;
+
+    ++sDeferredCalls;
+    sDeferredRamp = sDeferredRamp && ramp;    // any hard switch wins
+    return true;
+}
+
+bool StateTransition::deferProgramMuted()
+{
+    if (sDepth == 0)
+        return false;
+
+    sDeferredMuted = true;
+    return true;
+}
+
+static const char *
+_eventName(char event)
+{
+    switch (event)
+    {
+    case eStateEvent_CallMode:              return "callMode";
+    case eStateEvent_OnActiveCall:          return "onActiveCall";
+    case eStateEvent_IncomingCallActive:    return "incomingCallActive";
+    case eStateEvent_Headset:               return "headset";
+    case eStateEvent_Ringer:                return "ringer";
+    case eStateEvent_Sinks:                 return "sinks";
+    }
+    return "<invalid>";
+}
+
+static pbnjson::JValue
+_snapshotToJson(const StateSnapshot & snapshot)
+{
+    pbnjson::JValue json = pbnjson::Object();
+    json.put("callMode", snapshot.mCallMode);
+    json.put("onActiveCall", snapshot.mOnActiveCall);
+    json.put("incomingCallActive", snapshot.mIncomingCallActive);
+    json.put("headset", snapshot.mHeadset);
+    json.put("ringerOn", snapshot.mRingerOn);
+    json.put("module", std::string(snapshot.mModule));
+    json.put("phoneScenario", std::string(snapshot.mPhoneScenario));
+    return json;
+}
+
+void stateTransitionLogToJson(pbnjson::JValue & reply)
+{
+    pbnjson::JValue transitions = pbnjson::Array();
+
+    int first = sTransitionCount > cStateTransitionLogSize ?
+                                  sTransitionCount - cStateTransitionLogSize : 0;
+    for (int index = first; index < sTransitionCount; ++index)
+    {
+        const StateTransitionRecord & record = sTransitions[index % cStateTransitionLogSize];
+        pbnjson::JValue transition = pbnjson::Object();
+        pbnjson::JValue args = pbnjson::Array();
+        args.append(record.mArg0);
+        args.append(record.mArg1);
+        transition.put("time", (record.mTime - sOrigin) / 1000.);
+        transition.put("event", std::string(_eventName(record.mEvent)));
+        transition.put("args", args);
+        transition.put("depth", record.mDepth);
+        transition.put("before", _snapshotToJson(record.mBefore));
+        if (record.mDone)
+        {
+            transition.put("after", _snapshotToJson(record.mAfter));
+            if (record.mProgrammed > 0)
+                transition.put("programmed", record.mProgrammed);
+        }
+        transitions.append(transition);
+    }
+
+    reply.put("transitions", transitions);
+    if (first > 0)
+        reply.put("dropped", first);
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _STATETRANSITION_H_
+#define _STATETRANSITION_H_
+
+#include <glib.h>
+#include <pbnjson.hpp>
+
+/// Inputs of the call & routing policy of State
+enum EStateEvent
+{
+    eStateEvent_CallMode = 'c',             // arg0: ECallMode, arg1: ECallStatus
+    eStateEvent_OnActiveCall = 'a',         // arg0: active, arg1: ECallMode
+    eStateEvent_IncomingCallActive = 'i',   // arg0: active, arg1: ECallMode
+    eStateEvent_Headset = 'h',              // arg0: EHeadsetState
+    eStateEvent_Ringer = 'r',               // arg0: ringer on
+    eStateEvent_Sinks = 's'                 // arg0: active sinks before, arg1: after
+};
+
+/// Scope of a State event. Events nest: setCallMode sets the active call,
+/// which changes the current module, which selects scenarios...
+/// Until the outermost event is done, ScenarioModule::programSoftwareMixer
+/// requests are only noted, then the current module is programmed once.
+/// A module made current meanwhile has its muting programmed right after,
+/// in the order makeCurrent uses outside of any event.
+/// Each event is kept in a bounded log, with the state before & after,
+/// so that field issues can be replayed offline. Main thread only.
+class StateTransition
+{
+public:
+    StateTransition(EStateEvent event, int arg0, int arg1 = 0);
+    ~StateTransition();
+
+    /// Defer a programSoftwareMixer call if a transition is running.
+    /// Returns true if the call was deferred.
+    static bool deferProgramSoftwareMixer(bool ramp);
+
+    /// Defer the current module's programMuted call if a transition is
+    /// running, to follow the deferred programSoftwareMixer.
+    /// Returns true if the call was deferred.
+    static bool deferProgramMuted();
+
+private:
+    int     mRecord;
+
+    StateTransition(const StateTransition &);
+    StateTransition & operator=(const StateTransition &);
+};
+
+/// Add the last transitions to a luna reply, oldest first
+void stateTransitionLogToJson(pbnjson::JValue & reply);
+
+#endif // _STATETRANSITION_H_
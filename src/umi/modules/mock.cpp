@@ -33,7 +33,7 @@
 
 #define MOCK_MEDIA_KEY "umimedia"
 
-static const ConstString    cMockMedia_Default(MOCK_MEDIA_KEY SCENARIO_DEFAULT);
+static const ConstString    cMockMedia_Default = ConstString::intern(MOCK_MEDIA_KEY SCENARIO_DEFAULT);
 
 bool MockScenarioModule :: connectAudioOut(LSHandle *lshandle, LSMessage *message, void *ctx)
 {
@@ -329,7 +329,7 @@ void MockScenarioModule::onSinkChanged (EVirtualSink sink, EControlEvent event,
 MockScenarioModule :: MockScenarioModule():UMIScenarioModule(ConstString("/MockScenarioModule")),
                mMockScenarioModuleVolume(cMockMedia_Default, 80), mMockScenarioModuleMuted (false)
 {
-    gAudiodCallbacks.registerModuleCallback(this,eumiAll,true);
+    gAudiodCallbacks.registerModuleCallback(this, eumiAll, true, eSinkTypeMask_Umi);
     gAudiodCallbacks.registerModuleCallback(this, eVirtualSink_All);
 
     GenericScenario *mockMediaScenario = new (std::nothrow) GenericScenario (cMockMedia_Default,
@@ -0,0 +1,144 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+
+#include "controlTrace.h"
+#include "utils.h"
+#include "log.h"
+
+/// 4096 records of 24 bytes: the last few minutes of a busy device
+static const guint cTraceRingSize = 4096;   // power of 2
+static const size_t cTraceNamesSize = 4096;
+static const guint32 cTraceVersion = 1;
+
+struct TraceRecord
+{
+    gint64  mTime;      // monotonic, us
+    guint8  mEvent;
+    char    mCode;
+    guint16 mName;
+    gint32  mArg[3];
+};
+
+struct TraceFileHeader
+{
+    char    mMagic[4];      // "ADTR"
+    guint32 mVersion;
+    guint32 mRecordSize;
+    guint32 mRecordCount;   // records following the names, oldest first
+    guint32 mNamesSize;     // zero separated names, id 1 first
+    guint32 mDropped;       // overwritten records
+    gint64  mNow;           // monotonic time of the dump, us
+};
+
+static TraceRecord sTraceRing[cTraceRingSize];
+static volatile gint sTraceNext = 0;
+
+// names are only appended, & the size published after, so that a dump
+// interrupting the main thread reads a consistent table
+static char sTraceNames[cTraceNamesSize];
+static volatile gint sTraceNamesSize = 0;
+static guint16 sTraceNameCount = 0;
+static std::map<std::string, guint16> sTraceNameIds;
+
+guint16 traceName(const char * name)
+{
+    std::map<std::string, guint16>::iterator iter = sTraceNameIds.find(name);
+    if (iter != sTraceNameIds.end())
+        return iter->second;
+
+    size_t length = strlen(name) + 1;
+    gint size = g_atomic_int_get(&sTraceNamesSize);
+    if (size + length > cTraceNamesSize || sTraceNameCount == G_MAXUINT16)
+        return 0;
+    memcpy(sTraceNames + size, name, length);
+    g_atomic_int_set(&sTraceNamesSize, size + (gint) length);
+    sTraceNameIds[name] = ++sTraceNameCount;
+    return sTraceNameCount;
+}
+
+void traceEvent(ETraceEvent event, char code, guint16 name,
+                gint32 arg0, gint32 arg1, gint32 arg2)
+{
+    guint index = (guint) g_atomic_int_add(&sTraceNext, 1);
+    TraceRecord & record = sTraceRing[index & (cTraceRingSize - 1)];
+    record.mTime = g_get_monotonic_time();
+    record.mEvent = event;
+    record.mCode = code;
+    record.mName = name;
+    record.mArg[0] = arg0;
+    record.mArg[1] = arg1;
+    record.mArg[2] = arg2;
+}
+
+int traceDump(const char * path)
+{
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+
+    guint next = (guint) g_atomic_int_get(&sTraceNext);
+    guint count = next < cTraceRingSize ? next : cTraceRingSize;
+    guint first = next - count;
+
+    TraceFileHeader header;
+    memcpy(header.mMagic, "ADTR", sizeof(header.mMagic));
+    header.mVersion = cTraceVersion;
+    header.mRecordSize = sizeof(TraceRecord);
+    header.mRecordCount = count;
+    header.mNamesSize = g_atomic_int_get(&sTraceNamesSize);
+    header.mDropped = first;
+    header.mNow = g_get_monotonic_time();
+
+    // records being written while we dump may be torn: they are the newest
+    guint start = first & (cTraceRingSize - 1);
+    guint tail = MIN(count, cTraceRingSize - start);
+    bool ok = write(fd, &header, sizeof(header)) == (ssize_t) sizeof(header) &&
+        write(fd, sTraceNames, header.mNamesSize) == (ssize_t) header.mNamesSize &&
+        write(fd, sTraceRing + start, tail * sizeof(TraceRecord)) == (ssize_t) (tail * sizeof(TraceRecord)) &&
+        write(fd, sTraceRing, (count - tail) * sizeof(TraceRecord)) == (ssize_t) ((count - tail) * sizeof(TraceRecord));
+    close(fd);
+
+    return ok ? (int) count : -1;
+}
+
+static void
+_dumpTraceSignal(int signal)
+{
+    // no logging here: only async-signal safe calls
+    traceDump(cTraceDumpPath);
+}
+
+static int
+ControlTraceInit(void)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = _dumpTraceSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (!CHECK(sigaction(SIGUSR1, &action, NULL) == 0))
+        return -1;
+    return 0;
+}
+
+INIT_FUNC_DEPS (ControlTraceInit, eInitPriority_Critical, NULL);
@@ -0,0 +1,98 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cmath>
+#include <cstring>
+
+#include "latencyHistogram.h"
+
+int LatencyHistogram::bucketIndex(gint64 us)
+{
+    if (us < 4)
+        return us < 0 ? 0 : (int) us;
+    if (us > G_MAXUINT32)
+        us = G_MAXUINT32;
+    int exponent = g_bit_storage((gulong) us) - 1;
+    int index = 4 * (exponent - 1) + (int) ((us >> (exponent - 2)) & 3);
+    return MIN(index, cBucketCount - 1);
+}
+
+gint64 LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < 4)
+        return index + 1;
+    int exponent = index / 4 + 1;
+    return (gint64) (5 + index % 4) << (exponent - 2);
+}
+
+void LatencyHistogram::record(gint64 us)
+{
+    ++mBuckets[bucketIndex(us)];
+    ++mCount;
+    mTotal += us;
+    if (us > mMax)
+        mMax = us;
+}
+
+void LatencyHistogram::reset()
+{
+    memset(mBuckets, 0, sizeof(mBuckets));
+    mCount = 0;
+    mTotal = 0;
+    mMax = 0;
+}
+
+gint64 LatencyHistogram::percentile(double percent) const
+{
+    if (mCount == 0)
+        return 0;
+    guint64 rank = (guint64) ceil(percent / 100. * mCount);
+    guint64 seen = 0;
+    for (int index = 0; index < cBucketCount; ++index)
+    {
+        seen += mBuckets[index];
+        if (seen >= rank && seen > 0)
+            return MIN(bucketUpperBound(index), mMax);
+    }
+    return mMax;
+}
+
+void LatencyHistogram::toJson(pbnjson::JValue & json, bool withBuckets) const
+{
+    json.put("count", (int64_t) mCount);
+    if (mCount == 0)
+        return;
+    json.put("mean", mTotal / 1000. / mCount);
+    json.put("max", mMax / 1000.);
+    json.put("p50", percentile(50) / 1000.);
+    json.put("p95", percentile(95) / 1000.);
+    json.put("p99", percentile(99) / 1000.);
+    if (withBuckets)
+    {
+        // [upper bound in ms, count] of the buckets used
+        pbnjson::JValue buckets = pbnjson::Array();
+        for (int index = 0; index < cBucketCount; ++index)
+        {
+            if (mBuckets[index] == 0)
+                continue;
+            pbnjson::JValue bucket = pbnjson::Array();
+            bucket.append(bucketUpperBound(index) / 1000.);
+            bucket.append((int64_t) mBuckets[index]);
+            buckets.append(bucket);
+        }
+        json.put("buckets", buckets);
+    }
+}
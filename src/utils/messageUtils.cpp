@@ -17,6 +17,7 @@
 
 #include "messageUtils.h"
 #include "ConstString.h"
+#include "utils.h"
 
 void CLSError::Print(const char * where, int line, GLogLevelFlags logLevel)
 {
@@ -108,6 +109,7 @@ bool LSMessageJsonParser::parse(const char * callerFunction,
             if (!LSMessageReply(lssender, mMessage, reply.c_str(), &lserror))
                 lserror.Print(callerFunction, 0);
         }
+        lunaRequestFailed();
         return false;
     }
     return true;
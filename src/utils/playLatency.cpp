@@ -0,0 +1,72 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <map>
+#include <string>
+
+#include "playLatency.h"
+#include "latencyHistogram.h"
+#include "controlTrace.h"
+
+struct SinkPlayLatency
+{
+    LatencyHistogram    mDefer;     // request to Pulse thread
+    LatencyHistogram    mStart;     // request to sound
+};
+
+static std::map<std::string, SinkPlayLatency> sPlayLatencies;
+
+G_LOCK_DEFINE_STATIC(sPlayLatenciesLock);
+
+void playLatencyRecord(const char * sink, guint16 traceSink,
+                       gint64 request, gint64 deferred, gint64 started)
+{
+    if (request <= 0 || sink == 0)
+        return;
+
+    gint64 defer = deferred > 0 ? deferred - request : 0;
+    traceEvent(eTrace_PlayLatency, 0, traceSink, (gint32) defer, (gint32) (started - request));
+
+    G_LOCK(sPlayLatenciesLock);
+    SinkPlayLatency & latency = sPlayLatencies[sink];
+    latency.mDefer.record(defer);
+    latency.mStart.record(started - request);
+    G_UNLOCK(sPlayLatenciesLock);
+}
+
+void playLatencyToJson(pbnjson::JValue & reply, bool reset)
+{
+    pbnjson::JValue sinks = pbnjson::Object();
+
+    G_LOCK(sPlayLatenciesLock);
+    for (std::map<std::string, SinkPlayLatency>::iterator iter = sPlayLatencies.begin();
+                                                  iter != sPlayLatencies.end(); ++iter)
+    {
+        pbnjson::JValue sink = pbnjson::Object();
+        pbnjson::JValue defer = pbnjson::Object();
+        pbnjson::JValue start = pbnjson::Object();
+        iter->second.mDefer.toJson(defer, false);
+        iter->second.mStart.toJson(start, false);
+        sink.put("defer", defer);
+        sink.put("start", start);
+        sinks.put(iter->first, sink);
+    }
+    if (reset)
+        sPlayLatencies.clear();
+    G_UNLOCK(sPlayLatenciesLock);
+
+    reply.put("playLatency", sinks);
+}
@@ -0,0 +1,121 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstring>
+
+#include "startupProfile.h"
+#include "audiodTracer.h"
+
+/// Enough for all init hooks & a few Pulse connection attempts.
+/// Once full, the oldest phases are overwritten, but nothing new is
+/// recorded once startup is complete.
+static const int cStartupProfileSize = 128;
+
+struct StartupPhaseRecord
+{
+    char    mName[48];
+    gint64  mBegin;
+    gint64  mEnd;       // -1 while the phase is running
+};
+
+static StartupPhaseRecord sPhases[cStartupProfileSize];
+static int sPhaseCount = 0;     // total recorded, the ring holds the last ones
+static gint64 sOrigin = g_get_monotonic_time();
+static gint sComplete = 0;      // later phases, like Pulse reconnects, aren't startup
+
+G_LOCK_DEFINE_STATIC(sPhasesLock);
+
+static void
+recordPhase(const char * name, gint64 begin, gint64 end)
+{
+    if (g_atomic_int_get(&sComplete))
+        return;
+
+    G_LOCK(sPhasesLock);
+    StartupPhaseRecord & record = sPhases[sPhaseCount % cStartupProfileSize];
+    g_strlcpy(record.mName, name, sizeof(record.mName));
+    record.mBegin = begin;
+    record.mEnd = end;
+    ++sPhaseCount;
+    G_UNLOCK(sPhasesLock);
+}
+
+void startupPhaseBegin(const char * name)
+{
+    PMTRACE_BEFORE(const_cast<char *>(name));
+    recordPhase(name, g_get_monotonic_time(), -1);
+}
+
+void startupPhaseEnd(const char * name)
+{
+    gint64 now = g_get_monotonic_time();
+
+    G_LOCK(sPhasesLock);
+    int first = sPhaseCount > cStartupProfileSize ? sPhaseCount - cStartupProfileSize : 0;
+    for (int index = sPhaseCount - 1; index >= first; --index)
+    {
+        StartupPhaseRecord & record = sPhases[index % cStartupProfileSize];
+        if (record.mEnd < 0 && strncmp(record.mName, name, sizeof(record.mName) - 1) == 0)
+        {
+            record.mEnd = now;
+            break;
+        }
+    }
+    G_UNLOCK(sPhasesLock);
+
+    PMTRACE_AFTER(const_cast<char *>(name));
+}
+
+void startupMark(const char * name)
+{
+    PMTRACE(const_cast<char *>(name));
+    gint64 now = g_get_monotonic_time();
+    recordPhase(name, now, now);
+}
+
+void startupProfileComplete()
+{
+    startupMark("startup complete");
+    g_atomic_int_set(&sComplete, 1);
+}
+
+void startupProfileToJson(pbnjson::JValue & reply)
+{
+    pbnjson::JValue phases = pbnjson::Array();
+
+    G_LOCK(sPhasesLock);
+    int first = sPhaseCount > cStartupProfileSize ? sPhaseCount - cStartupProfileSize : 0;
+    for (int index = first; index < sPhaseCount; ++index)
+    {
+        const StartupPhaseRecord & record = sPhases[index % cStartupProfileSize];
+        pbnjson::JValue phase = pbnjson::Object();
+        phase.put("name", std::string(record.mName));
+        phase.put("start", (record.mBegin - sOrigin) / 1000.);
+        if (record.mEnd >= 0)
+            phase.put("duration", (record.mEnd - record.mBegin) / 1000.);
+        else
+            phase.put("running", true);
+        phases.append(phase);
+    }
+    int dropped = first;
+    G_UNLOCK(sPhasesLock);
+
+    reply.put("phases", phases);
+    reply.put("elapsed", (g_get_monotonic_time() - sOrigin) / 1000.);
+    reply.put("complete", g_atomic_int_get(&sComplete) != 0);
+    if (dropped > 0)
+        reply.put("dropped", dropped);
+}
@@ -16,11 +16,16 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <map>
+#include <string>
 
 #include "utils.h"
 #include "messageUtils.h"
 #include "log.h"
 #include "main.h"
+#include "startupProfile.h"
+#include "controlTrace.h"
+#include "latencyHistogram.h"
 
 static GHookList *sInitList         = NULL;
 static GHookList *sModuleStartList  = NULL;
@@ -31,6 +36,20 @@ static GHookList *sCancelSubscriptionCallbackList = NULL;
 static GMainLoop *sCurrentLoop = NULL;
 static LSHandle *sCurrentHandle =NULL;
 
+/// Hooks above longer than that are reported at message level
+static const gint64 cSlowHookThreshold = 5000;    // us
+
+/// GHook extended with what we need to order init hooks
+struct InitHook
+{
+    GHook           mHook;
+    const char *    mName;
+    EInitPriority   mPriority;
+    const char *    mRequirements;
+    bool            mRunning;
+    bool            mDone;
+};
+
 static void
 hookInit(gpointer func)
 {
@@ -56,68 +75,54 @@ guint64 getCurrentTimeInMs ()
     return guint64(now.tv_sec) * 1000ULL + guint64(now.tv_nsec) / 1000000ULL;
 }
 
-void registerInitFunction (InitFunction function)
+static void
+registerHook (GHookList ** list, GHookFunc hookFunc, gpointer function,
+              const char * name, EInitPriority priority, const char * requirements)
 {
-    if (NULL == sInitList)
+    if (NULL == *list)
     {
-       sInitList = (GHookList*) malloc (sizeof (GHookList));
-       g_hook_list_init(sInitList, sizeof (GHook));
+       *list = (GHookList*) malloc (sizeof (GHookList));
+       g_hook_list_init(*list, sizeof (InitHook));
     }
 
-    GHook *hook = g_hook_alloc (sInitList);
-    hook->func = (gpointer) hookInit;
-    hook->data = (gpointer) function;
+    InitHook *hook = (InitHook *) g_hook_alloc (*list);
+    hook->mHook.func = (gpointer) hookFunc;
+    hook->mHook.data = function;
+    hook->mName = name ? name : "<unnamed>";
+    hook->mPriority = priority;
+    hook->mRequirements = requirements;
+    hook->mRunning = false;
+    hook->mDone = false;
 
-    g_hook_append(sInitList, hook);
+    g_hook_append(*list, &hook->mHook);
 }
 
-void registerModuleFunction (StartFunction function)
+void registerInitFunction (InitFunction function, const char * name,
+                           EInitPriority priority, const char * requirements)
 {
-
-    if (NULL == sModuleStartList)
-    {
-       sModuleStartList = (GHookList*) malloc (sizeof (GHookList));
-       g_hook_list_init(sModuleStartList, sizeof (GHook));
-    }
-
-    GHook *hook = g_hook_alloc (sModuleStartList);
-    hook->func = (gpointer) hookStart;
-    hook->data = (gpointer) function;
-
-    g_hook_append(sModuleStartList, hook);
+    registerHook(&sInitList, hookInit, (gpointer) function,
+                 name, priority, requirements);
 }
 
-void registerControlFunction (StartFunction function)
+void registerModuleFunction (StartFunction function, const char * name,
+                             EInitPriority priority, const char * requirements)
 {
-
-    if (NULL == sControlStartList)
-    {
-       sControlStartList = (GHookList*) malloc (sizeof (GHookList));
-       g_hook_list_init(sControlStartList, sizeof (GHook));
-    }
-
-    GHook *hook = g_hook_alloc (sControlStartList);
-    hook->func = (gpointer) hookStart;
-    hook->data = (gpointer) function;
-
-
-    g_hook_append(sControlStartList, hook);
+    registerHook(&sModuleStartList, hookStart, (gpointer) function,
+                 name, priority, requirements);
 }
 
-void registerServiceFunction (StartFunction function)
+void registerControlFunction (StartFunction function, const char * name,
+                              EInitPriority priority, const char * requirements)
 {
+    registerHook(&sControlStartList, hookStart, (gpointer) function,
+                 name, priority, requirements);
+}
 
-    if (NULL == sServiceStartList)
-    {
-       sServiceStartList = (GHookList*) malloc (sizeof (GHookList));
-       g_hook_list_init(sServiceStartList, sizeof (GHook));
-    }
-
-    GHook *hook = g_hook_alloc (sServiceStartList);
-    hook->func = (gpointer) hookStart;
-    hook->data = (gpointer) function;
-
-    g_hook_append(sServiceStartList, hook);
+void registerServiceFunction (StartFunction function, const char * name,
+                              EInitPriority priority, const char * requirements)
+{
+    registerHook(&sServiceStartList, hookStart, (gpointer) function,
+                 name, priority, requirements);
 }
 
 static LSMessage * sCancelSubscription_LSMessage = NULL;
@@ -193,33 +198,264 @@ void registerCancelSubscription(LSHandle *handle) {
         lserror.Print(__FUNCTION__, __LINE__);
 }
 
+/// Init lists in the order their hooks run, priority being equal.
+/// The init stage comes first, all priorities, before any start stage:
+/// start functions rely on what init functions set up.
+static GHookList ** sInitStages[] = {
+    &sInitList, &sModuleStartList, &sControlStartList, &sServiceStartList
+};
+static const size_t cFirstStartStage = 1;
+
+static InitHook *
+findHook (const char * name, size_t length)
+{
+    for (size_t stage = 0; stage < G_N_ELEMENTS(sInitStages); ++stage)
+    {
+        GHookList * list = *sInitStages[stage];
+        if (NULL == list)
+            continue;
+        for (GHook * hook = list->hooks; hook; hook = hook->next)
+        {
+            InitHook * initHook = (InitHook *) hook;
+            if (strlen(initHook->mName) == length &&
+                strncmp(initHook->mName, name, length) == 0)
+                return initHook;
+        }
+    }
+    return NULL;
+}
+
+static void runHook (InitHook * hook);
+
+static void
+runRequirements (InitHook * hook)
+{
+    const char * name = hook->mRequirements;
+    while (name && *name)
+    {
+        size_t length = strcspn(name, ", ");
+        if (length > 0)
+        {
+            InitHook * required = findHook(name, length);
+            if (required)
+                runHook(required);
+            else
+                g_warning ("%s: '%s' requires unknown hook '%.*s'", __FUNCTION__,
+                                               hook->mName, (int) length, name);
+        }
+        name += length;
+        name += strspn(name, ", ");
+    }
+}
+
+static void
+runHook (InitHook * hook)
+{
+    if (hook->mDone)
+        return;
+    if (hook->mRunning)
+    {
+        g_critical ("%s: circular requirement on '%s'", __FUNCTION__, hook->mName);
+        return;
+    }
+
+    hook->mRunning = true;
+    runRequirements(hook);
+
+    gint64 start = g_get_monotonic_time();
+    startupPhaseBegin(hook->mName);
+    ((GHookFunc) hook->mHook.func)(hook->mHook.data);
+    startupPhaseEnd(hook->mName);
+    gint64 duration = g_get_monotonic_time() - start;
+
+    hook->mRunning = false;
+    hook->mDone = true;
+
+    if (duration >= cSlowHookThreshold)
+        g_message ("%s: %s took %.1f ms", __FUNCTION__, hook->mName, duration / 1000.);
+    else
+        g_debug ("%s: %s took %.1f ms", __FUNCTION__, hook->mName, duration / 1000.);
+}
+
+/// Run all hooks of that priority in these stages, in stage & registration order
+static void
+runHooks (EInitPriority priority, size_t firstStage, size_t endStage)
+{
+    for (size_t stage = firstStage; stage < endStage; ++stage)
+    {
+        GHookList * list = *sInitStages[stage];
+        if (NULL == list)
+            continue;
+        for (GHook * hook = list->hooks; hook; hook = hook->next)
+            if (((InitHook *) hook)->mPriority == priority)
+                runHook((InitHook *) hook);
+    }
+}
+
+static InitHook *
+nextDeferredHook ()
+{
+    for (size_t stage = 0; stage < G_N_ELEMENTS(sInitStages); ++stage)
+    {
+        GHookList * list = *sInitStages[stage];
+        if (NULL == list)
+            continue;
+        for (GHook * hook = list->hooks; hook; hook = hook->next)
+        {
+            InitHook * initHook = (InitHook *) hook;
+            if (initHook->mPriority == eInitPriority_Deferred && !initHook->mDone)
+                return initHook;
+        }
+    }
+    return NULL;
+}
+
+/// Run deferred hooks one at a time, so that the main loop stays responsive
+static gboolean
+_runDeferredHooks (gpointer data)
+{
+    InitHook * hook = nextDeferredHook();
+    if (hook)
+    {
+        runHook(hook);
+        return TRUE;
+    }
+
+    g_debug ("%s: complete!", __FUNCTION__);
+    startupMark("deferred init done");
+    startupProfileComplete();
+    sCurrentLoop   = NULL;
+    sCurrentHandle = NULL;
+
+    return FALSE;
+}
+
 void oneInitForAll(GMainLoop *loop, LSHandle *handle)
 {
     sCurrentLoop   = loop;
     sCurrentHandle = handle;
 
-    g_debug ("%s: calling all init functions", __FUNCTION__);
-    if (NULL != sInitList)
-        g_hook_list_invoke (sInitList, FALSE);
+    gint64 start = g_get_monotonic_time();
 
-    g_debug ("%s: calling all start module functions", __FUNCTION__);
-    if (NULL != sModuleStartList)
-        g_hook_list_invoke (sModuleStartList, FALSE);
+    g_debug ("%s: calling init functions, critical ones first", __FUNCTION__);
+    runHooks(eInitPriority_Critical, 0, cFirstStartStage);
+    runHooks(eInitPriority_Normal, 0, cFirstStartStage);
 
-    g_debug ("%s: calling all start control functions", __FUNCTION__);
-    if (NULL != sControlStartList)
-        g_hook_list_invoke (sControlStartList, FALSE);
+    g_debug ("%s: calling start functions, critical ones first", __FUNCTION__);
+    runHooks(eInitPriority_Critical, cFirstStartStage, G_N_ELEMENTS(sInitStages));
+    runHooks(eInitPriority_Normal, cFirstStartStage, G_N_ELEMENTS(sInitStages));
 
-    g_debug ("%s: calling all start service functions", __FUNCTION__);
-    if (NULL != sServiceStartList)
-        g_hook_list_invoke (sServiceStartList, FALSE);
+    registerCancelSubscription(GetPalmService());
 
+    g_message ("%s: done in %.1f ms", __FUNCTION__,
+                                   (g_get_monotonic_time() - start) / 1000.);
 
-    registerCancelSubscription(GetPalmService());
-    sCurrentLoop   = NULL;
-    sCurrentHandle = NULL;
+    // whatever isn't needed to play sound goes after the main loop started
+    g_idle_add_full (G_PRIORITY_LOW, _runDeferredHooks, NULL, NULL);
+}
 
-    g_debug("oneInitForAll: complete!");
+/// Luna methods are called through _lunaMethod, so that requests get traced
+/// & measured. Main thread only, like luna itself.
+struct LunaMethod
+{
+    LSMethodFunction    mFunction;
+    guint16             mTraceName;
+    guint64             mCalls;
+    guint64             mErrors;
+    LatencyHistogram    mLatency;
+};
+static std::map<std::string, LunaMethod> sLunaMethods;    // by "/category/method"
+
+struct CStringLess
+{
+    bool operator()(const char * a, const char * b) const { return strcmp(a, b) < 0; }
+};
+
+/// The user data of categories registered by ServiceRegisterCategory:
+/// their methods, found without building a key, & the caller's user data.
+/// luna has no per method user data, so this is as close as it gets.
+struct LunaCategory
+{
+    std::map<const char *, LunaMethod *, CStringLess>  mMethods;
+    void *                                              mUserData;
+};
+static LunaMethod * sCurrentLunaMethod = NULL;
+static gint64 sCurrentLunaRequestStart = 0;
+static gint64 sLunaMetricsStart = g_get_monotonic_time();
+
+gint64 lunaRequestStartTime()
+{
+    return sCurrentLunaRequestStart ? sCurrentLunaRequestStart : g_get_monotonic_time();
+}
+
+void lunaRequestFailed()
+{
+    if (sCurrentLunaMethod)
+        ++sCurrentLunaMethod->mErrors;
+}
+
+static bool
+_lunaMethod(LSHandle *lshandle, LSMessage *message, void *ctx)
+{
+    LunaCategory * lunaCategory = (LunaCategory *) ctx;
+    const char * method = LSMessageGetMethod(message);
+    if (!VERIFY(lunaCategory && method))
+        return false;
+    std::map<const char *, LunaMethod *, CStringLess>::iterator iter =
+                                                lunaCategory->mMethods.find(method);
+    if (!VERIFY(iter != lunaCategory->mMethods.end()))
+        return false;
+
+    LunaMethod & lunaMethod = *iter->second;
+    ctx = lunaCategory->mUserData;
+    LunaMethod * previousMethod = sCurrentLunaMethod;
+    gint64 previousStart = sCurrentLunaRequestStart;
+    gint64 start = g_get_monotonic_time();
+    sCurrentLunaMethod = &lunaMethod;
+    sCurrentLunaRequestStart = start;
+    traceEvent(eTrace_LunaBegin, 0, lunaMethod.mTraceName);
+    bool result = lunaMethod.mFunction(lshandle, message, ctx);
+    gint64 latency = g_get_monotonic_time() - start;
+    traceEvent(eTrace_LunaEnd, 0, lunaMethod.mTraceName, (gint32) latency);
+    sCurrentLunaMethod = previousMethod;
+    sCurrentLunaRequestStart = previousStart;
+
+    ++lunaMethod.mCalls;
+    if (!result)
+        ++lunaMethod.mErrors;
+    lunaMethod.mLatency.record(latency);
+    return result;
+}
+
+void lunaMetricsToJson(pbnjson::JValue & reply, bool reset)
+{
+    gint64 now = g_get_monotonic_time();
+    pbnjson::JValue methods = pbnjson::Array();
+    for (std::map<std::string, LunaMethod>::iterator iter = sLunaMethods.begin();
+                                                iter != sLunaMethods.end(); ++iter)
+    {
+        LunaMethod & lunaMethod = iter->second;
+        if (lunaMethod.mCalls == 0)
+            continue;
+        pbnjson::JValue json = pbnjson::Object();
+        json.put("method", iter->first);
+        json.put("calls", (int64_t) lunaMethod.mCalls);
+        json.put("errors", (int64_t) lunaMethod.mErrors);
+        pbnjson::JValue latency = pbnjson::Object();
+        lunaMethod.mLatency.toJson(latency);
+        json.put("latency", latency);
+        methods.append(json);
+        if (reset)
+        {
+            lunaMethod.mCalls = 0;
+            lunaMethod.mErrors = 0;
+            lunaMethod.mLatency.reset();
+        }
+    }
+    reply.put("methods", methods);
+    reply.put("period", (now - sLunaMetricsStart) / 1000.);
+    if (reset)
+        sLunaMetricsStart = now;
 }
 
 bool ServiceRegisterCategory(const char *category, LSMethod *methods,
@@ -228,15 +464,44 @@ bool ServiceRegisterCategory(const char *category, LSMethod *methods,
     bool result;
     CLSError lserror;
     g_message("%s: Registering Service for '%s' category", __FUNCTION__, category);
+
+    // our own copy of the table, with every method wrapped, kept as long as the service
+    LunaCategory * lunaCategory = new LunaCategory;
+    lunaCategory->mUserData = category_user_data;
+    LSMethod * wrapped = NULL;
+    if (methods)
+    {
+        int count = 0;
+        while (methods[count].name)
+            ++count;
+        wrapped = new LSMethod[count + 1];
+        memset(wrapped, 0, sizeof(LSMethod) * (count + 1));
+        for (int i = 0; i < count; ++i)
+        {
+            std::string key = std::string(category) + '/' + methods[i].name;
+            LunaMethod & lunaMethod = sLunaMethods[key];
+            lunaMethod.mFunction = methods[i].function;
+            lunaMethod.mTraceName = traceName(key.c_str());
+            lunaMethod.mCalls = 0;
+            lunaMethod.mErrors = 0;
+            lunaCategory->mMethods[methods[i].name] = &lunaMethod;
+            wrapped[i] = methods[i];
+            wrapped[i].function = _lunaMethod;
+        }
+    }
+
     result = LSRegisterCategory (GetPalmService(), category,
-            methods, signal, NULL, &lserror);
+            wrapped, signal, NULL, &lserror);
     if (!result)
     {
         lserror.Print(__FUNCTION__, __LINE__);
+        delete [] wrapped;
+        delete lunaCategory;
         return false;
     }
 
-    if (!LSCategorySetData(GetPalmService(), category, category_user_data, &lserror))
+    // registered: luna keeps using the table & the category, even on failure here
+    if (!LSCategorySetData(GetPalmService(), category, lunaCategory, &lserror))
     {
         lserror.Print(__FUNCTION__, __LINE__);
         return false;
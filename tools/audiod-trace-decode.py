@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# Copyright (c) 2012-2019 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+"""Decode an audiod control trace dump, as written on SIGUSR1 or by the
+/state/dumpTrace luna method (see include/controlTrace.h).
+
+usage: audiod-trace-decode.py [/var/log/audiod-trace.bin]
+"""
+
+import struct
+import sys
+
+HEADER = struct.Struct('<4sIIIIIq')
+RECORD = struct.Struct('<qBcHiii')
+
+EVENTS = {
+    1: 'scenario',
+    2: 'programSource',
+    3: 'pulseStatus',
+    4: 'luna>',
+    5: 'luna<',
+    6: 'dtmfStart',
+    7: 'dtmfStop',
+    8: 'playLatency',
+    9: 'stateEvent',
+    10: 'volumeRamp',
+}
+
+
+def decode(path):
+    with open(path, 'rb') as dump:
+        data = dump.read()
+
+    magic, version, recordSize, count, namesSize, dropped, now = HEADER.unpack_from(data)
+    if magic != b'ADTR' or version != 1 or recordSize != RECORD.size:
+        sys.exit('%s: not a version 1 audiod trace dump' % path)
+
+    names = data[HEADER.size:HEADER.size + namesSize].split(b'\0')
+    offset = HEADER.size + namesSize
+
+    print('%d record(s), %d older one(s) overwritten' % (count, dropped))
+    for index in range(count):
+        time, event, code, name, arg0, arg1, arg2 = RECORD.unpack_from(data, offset)
+        offset += RECORD.size
+        line = '%12.3f ms  %-14s' % ((time - now) / 1000., EVENTS.get(event, '#%d' % event))
+        if 0 < name <= len(names):
+            line += ' ' + names[name - 1].decode('utf-8', 'replace')
+        if code != b'\0':
+            line += " '%s'" % code.decode('latin-1')
+        if event == 5:
+            line += ' %.3f ms' % (arg0 / 1000.)
+        elif event in (2, 3):
+            line += ' %d %d' % (arg0, arg1)
+        elif event == 8:
+            line += ' defer %.3f ms, start %.3f ms' % (arg0 / 1000., arg1 / 1000.)
+        elif event == 9:
+            line += ' %d %d%s' % (arg0, arg1, ' (nested %d)' % arg2 if arg2 else '')
+        elif event == 6:
+            line += ' held' if arg0 else ''
+        elif event == 10:
+            if code == b'x':
+                line += ' sink %d cancelled at %d' % (arg0, arg1)
+            else:
+                line += ' sink %d to %d in %d ms' % (arg0, arg1, arg2)
+        print(line)
+
+
+if __name__ == '__main__':
+    decode(sys.argv[1] if len(sys.argv) > 1 else '/var/log/audiod-trace.bin')
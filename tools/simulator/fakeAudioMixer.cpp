@@ -0,0 +1,445 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "fakeAudioMixer.h"
+#include "PulseAudioMixer.h"
+#include "AudioDevice.h"
+#include "genericScenarioModule.h"
+#include "simulator.h"
+#include "log.h"
+
+FakeAudioMixer gFakeAudioMixer;
+
+AudioMixer & gAudioMixer = gFakeAudioMixer;
+
+static const char *
+_rampCurveName(ERampCurve curve)
+{
+    switch (curve)
+    {
+    case eRampCurve_Linear:     return "linear";
+    case eRampCurve_dBLinear:   return "dB";
+    case eRampCurve_SCurve:     return "s-curve";
+    }
+    return "<invalid>";
+}
+
+FakeAudioMixer::FakeAudioMixer() : mCallbacks(NULL),
+                                   mOutputStreamsCount(0),
+                                   mSinkEventsUrgent(false),
+                                   mSinkEventsSourceID(0),
+                                   mFilter(-1),
+                                   mLatency(-1),
+                                   mBalance(0),
+                                   mHfpAgRole(false)
+{
+    for (int i = 0; i < eVirtualSink_Count; ++i)
+    {
+        mVolume[i] = -1;
+        mRoute[i] = -1;
+        mRampTo[i] = -1;
+        mRampEnd[i] = 0;
+        mStreamCount[i] = 0;
+    }
+    for (int i = 0; i < eVirtualSource_Count; ++i)
+        mSourceRoute[i] = -1;
+}
+
+void FakeAudioMixer::init(GMainLoop * loop, LSHandle * handle,
+                          AudiodCallbacksInterface * interface)
+{
+    mCallbacks = interface;
+    // nothing to connect to, but report it from the main loop, as Pulse would
+    g_idle_add(_connected, this);
+}
+
+gboolean FakeAudioMixer::_connected(gpointer data)
+{
+    static_cast <FakeAudioMixer *> (data)->mCallbacks->onAudioMixerConnected();
+    return FALSE;
+}
+
+bool FakeAudioMixer::command(char cmd, int sink, int value)
+{
+    switch (cmd)
+    {
+    case 'm':
+        value = 0;
+    case 'v':
+    case 'r':
+        if (!VERIFY(IsValidVirtualSink((EVirtualSink) sink)) || mVolume[sink] == value)
+            return true;
+        mVolume[sink] = value;
+        break;
+    case 'd':
+        if (!VERIFY(IsValidVirtualSink((EVirtualSink) sink)) || mRoute[sink] == value)
+            return true;
+        mRoute[sink] = value;
+        break;
+    case 'e':
+        if (!VERIFY(IsValidVirtualSource((EVirtualSource) sink)) || mSourceRoute[sink] == value)
+            return true;
+        mSourceRoute[sink] = value;
+        break;
+    case 'f':
+        if (mFilter == value)
+            return true;
+        mFilter = value;
+        break;
+    case 'l':
+        if (mLatency == value)
+            return true;
+        mLatency = value;
+        break;
+    }
+
+    simCountCommand(cmd);
+    if (cmd == 'e' || cmd == 'h')
+        simOutput("mixer", "%c %s %i", cmd, virtualSourceName((EVirtualSource) sink), value);
+    else if (IsValidVirtualSink((EVirtualSink) sink))
+        simOutput("mixer", "%c %s %i", cmd, virtualSinkName((EVirtualSink) sink), value);
+    else
+        simOutput("mixer", "%c %i", cmd, value);
+    return true;
+}
+
+void FakeAudioMixer::openCloseSink(EVirtualSink sink, bool openNotClose)
+{
+    if (!VERIFY(IsValidVirtualSink(sink)))
+        return;
+
+    int & streamCount = mStreamCount[sink];
+    if (openNotClose)
+    {
+        ++streamCount;
+        ++mOutputStreamsCount;
+    }
+    else if (streamCount > 0)
+    {
+        --streamCount;
+        --mOutputStreamsCount;
+    }
+    else
+    {
+        g_warning("%s: no %s stream to close", __FUNCTION__, virtualSinkName(sink));
+        return;
+    }
+
+    VirtualSinkSet before = mActiveStreams;
+    if (streamCount > 0)
+        mActiveStreams.add(sink);
+    else
+        mActiveStreams.remove(sink);
+    if (before == mActiveStreams)
+        return;
+
+    // like PulseAudioMixer::openCloseSink & queueSinkEvent, on the virtual clock
+    if (cSinkEventsCoalescingDelay < 0)
+    {
+        mReportedStreams = mActiveStreams;
+        if (mCallbacks)
+            mCallbacks->onSinkChanged(sink, openNotClose ? eControlEvent_FirstStreamOpened :
+                                                           eControlEvent_LastStreamClosed,
+                                      ePulseAudio);
+        return;
+    }
+
+    bool urgent = openNotClose && !isNeverMutedSink(sink);
+    if (mSinkEventsSourceID && (mSinkEventsUrgent || !urgent))
+        return;
+
+    if (mSinkEventsSourceID)
+        g_source_remove(mSinkEventsSourceID);
+    mSinkEventsUrgent = urgent;
+    if (urgent || cSinkEventsCoalescingDelay == 0)
+        mSinkEventsSourceID = g_idle_add(_flushSinkEvents, this);
+    else
+        mSinkEventsSourceID = g_timeout_add(cSinkEventsCoalescingDelay,
+                                            _flushSinkEvents, this);
+}
+
+gboolean FakeAudioMixer::_flushSinkEvents(gpointer data)
+{
+    FakeAudioMixer * mixer = static_cast <FakeAudioMixer *> (data);
+    mixer->mSinkEventsSourceID = 0;
+    mixer->flushSinkEvents();
+    return FALSE;
+}
+
+void FakeAudioMixer::flushSinkEvents()
+{
+    if (mSinkEventsSourceID)
+    {
+        g_source_remove(mSinkEventsSourceID);
+        mSinkEventsSourceID = 0;
+    }
+    if (mReportedStreams == mActiveStreams)
+        return;
+
+    VirtualSinkSet before = mReportedStreams;
+    mReportedStreams = mActiveStreams;
+    if (mCallbacks)
+        mCallbacks->onActiveSinksChanged(before, mActiveStreams, ePulseAudio);
+}
+
+bool FakeAudioMixer::programVolume(EVirtualSink sink, int volume, bool ramp)
+{
+    if (IsValidVirtualSink(sink) && ramping(sink))
+    {
+        if (mRampTo[sink] == volume)
+            return true;
+        cancelRamp(sink);
+    }
+
+    if (volume && !isNeverMutedSink(sink) && mStreamCount[sink] <= 0)
+        volume = 0;
+    return command(ramp ? 'r' : 'v', sink, volume);
+}
+
+bool FakeAudioMixer::programMute(EVirtualSource source, int mute)
+{
+    return command('h', source, mute);
+}
+
+bool FakeAudioMixer::rampVolume(EVirtualSink sink, int endVolume,
+                                int duration, ERampCurve curve)
+{
+    if (!VERIFY(IsValidVirtualSink(sink)) || !VERIFY(endVolume >= 0 && endVolume <= 100))
+        return false;
+
+    if (ramping(sink) && mRampTo[sink] == endVolume)
+        return true;
+
+    int from = mVolume[sink];
+    if (duration <= 0 || from < 0 || from == endVolume ||
+        (!isNeverMutedSink(sink) && mStreamCount[sink] <= 0))
+    {
+        cancelRamp(sink);
+        return programVolume(sink, endVolume, false);
+    }
+
+    // Only the ramp is recorded, not its steps:
+    // they depend on the step timer, not on the policy.
+    mRampTo[sink] = endVolume;
+    mRampEnd[sink] = g_get_monotonic_time() + (gint64) duration * 1000;
+    mVolume[sink] = endVolume;
+    simCountCommand('R');
+    simOutput("mixer", "R %s %i %i %i %s", virtualSinkName(sink), from, endVolume,
+                                            duration, _rampCurveName(curve));
+    return true;
+}
+
+bool FakeAudioMixer::ramping(EVirtualSink sink)
+{
+    return mRampEnd[sink] > g_get_monotonic_time();
+}
+
+void FakeAudioMixer::cancelRamp(EVirtualSink sink)
+{
+    if (!IsValidVirtualSink(sink) || !ramping(sink))
+        return;
+
+    mRampEnd[sink] = 0;
+    simOutput("mixer", "x %s", virtualSinkName(sink));
+}
+
+bool FakeAudioMixer::programDestination(EVirtualSink sink, EPhysicalSink destination)
+{
+    return command('d', sink, destination);
+}
+
+bool FakeAudioMixer::programDestination(EVirtualSource source, EPhysicalSource destination)
+{
+    return command('e', source, destination);
+}
+
+bool FakeAudioMixer::programDestinations(const int * sinkDestinations,
+                                         const int * sourceDestinations)
+{
+    for (int sink = eVirtualSink_First; sink <= eVirtualSink_Last; ++sink)
+        if (sinkDestinations[sink] >= 0)
+            command('d', sink, sinkDestinations[sink]);
+    for (int source = eVirtualSource_First; source <= eVirtualSource_Last; ++source)
+        if (sourceDestinations[source] >= 0)
+            command('e', source, sourceDestinations[source]);
+    return true;
+}
+
+bool FakeAudioMixer::programFilter(int filterTable)
+{
+    return command('f', eVirtualSink_None, filterTable);
+}
+
+bool FakeAudioMixer::programLatency(int latency)
+{
+    return command('l', eVirtualSink_None, latency);
+}
+
+bool FakeAudioMixer::programBalance(int balance)
+{
+    if (mBalance == balance)
+        return true;
+    mBalance = balance;
+    return command('b', eVirtualSink_None, balance);
+}
+
+bool FakeAudioMixer::muteAll()
+{
+    for (EVirtualSink sink = eVirtualSink_First;
+         sink <= eVirtualSink_Last;
+         sink = EVirtualSink(sink + 1))
+        cancelRamp(sink);
+
+    for (EVirtualSink sink = eVirtualSink_First;
+         sink <= eVirtualSink_Last;
+         sink = EVirtualSink(sink + 1))
+    {
+        if (sink != ecallertone)
+            command('m', sink, 0);
+    }
+    return true;
+}
+
+int FakeAudioMixer::adjustVolume(int volume, int dB)
+{
+    // calculation only, Pulse's volume tables are what we want
+    return gPulseAudioMixer.adjustVolume(volume, dB);
+}
+
+int FakeAudioMixer::getStreamCount(EVirtualSink sink)
+{
+    if (!VERIFY(IsValidVirtualSink(sink)))
+        return 0;
+    return mStreamCount[sink];
+}
+
+bool FakeAudioMixer::isSinkAudible(EVirtualSink sink)
+{
+    if (!VERIFY(IsValidVirtualSink(sink)))
+        return false;
+    return mActiveStreams.contain(sink) && mVolume[sink] > 0;
+}
+
+bool FakeAudioMixer::suspendAll()
+{
+    return command('s', eVirtualSink_None, 0);
+}
+
+bool FakeAudioMixer::updateRate(int rate)
+{
+    return command('u', eVirtualSink_None, rate);
+}
+
+bool FakeAudioMixer::playSystemSound(const char * snd, EVirtualSink sink)
+{
+    simOutput("mixer", "sound %s %s", snd, virtualSinkName(sink));
+    return true;
+}
+
+void FakeAudioMixer::playDtmf(const char * snd, EVirtualSink sink)
+{
+    simOutput("mixer", "dtmf %s %s", snd, virtualSinkName(sink));
+}
+
+void FakeAudioMixer::playOneshotDtmf(const char * snd, EVirtualSink sink)
+{
+    simOutput("mixer", "dtmf1 %s %s", snd, virtualSinkName(sink));
+}
+
+void FakeAudioMixer::stopDtmf()
+{
+    simOutput("mixer", "dtmf stop");
+}
+
+bool FakeAudioMixer::programLoadRTP(const char * type, const char * ip, int port)
+{
+    simOutput("mixer", "rtp load %s %s:%i", type, ip, port);
+    return true;
+}
+
+bool FakeAudioMixer::programHeadsetRoute(int route)
+{
+    return command('o', eVirtualSink_None, route);
+}
+
+bool FakeAudioMixer::programUnloadRTP()
+{
+    simOutput("mixer", "rtp unload");
+    return true;
+}
+
+bool FakeAudioMixer::loadUSBSinkSource(char cmd, int cardno, int deviceno, int status)
+{
+    simOutput("mixer", "usb %c %i %i %i", cmd, cardno, deviceno, status);
+    return true;
+}
+
+bool FakeAudioMixer::suspendSink(int sink)
+{
+    return command('s', sink, 0);
+}
+
+void FakeAudioMixer::setNREC(bool value)
+{
+    command('Z', eVirtualSink_None, value);
+}
+
+bool FakeAudioMixer::programLoadBluetooth(const char * address, const char * profile)
+{
+    simOutput("mixer", "bluetooth load %s %s", address, profile);
+    return true;
+}
+
+bool FakeAudioMixer::programUnloadBluetooth(const char * profile)
+{
+    simOutput("mixer", "bluetooth unload %s", profile);
+    return true;
+}
+
+bool FakeAudioMixer::setRouting(const GenericScenario & scenario)
+{
+    simOutput("mixer", "routing %s", scenario.getName());
+    return true;
+}
+
+bool FakeAudioMixer::phoneEvent(EPhoneEvent event, int parameter)
+{
+    simOutput("mixer", "phone %i %i", event, parameter);
+    return true;
+}
+
+bool FakeAudioMixer::programCallVoiceOrMICVolume(char cmd, int volume)
+{
+    return command(cmd, eVirtualSink_None, volume);
+}
+
+bool FakeAudioMixer::setPhoneMuted(const ConstString & scenario, bool muted)
+{
+    simOutput("mixer", "phone muted %s %i", scenario.c_str(), muted);
+    return true;
+}
+
+bool FakeAudioMixer::setPhoneVolume(const ConstString & scenario, int volume)
+{
+    simOutput("mixer", "phone volume %s %i", scenario.c_str(), volume);
+    return true;
+}
+
+int FakeAudioMixer::loopback_set_parameters(const char * value)
+{
+    simOutput("mixer", "loopback %s", value);
+    return 0;
+}
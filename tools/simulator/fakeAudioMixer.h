@@ -0,0 +1,131 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _FAKEAUDIOMIXER_H_
+#define _FAKEAUDIOMIXER_H_
+
+#include "AudioMixer.h"
+
+/// AudioMixer that records what audiod programs instead of talking to Pulse.
+/// Like PulseAudioMixer, it only reports commands that change something,
+/// using the same command letters, so that the output reads like what
+/// Pulse would have received. Streams are opened & closed by the script,
+/// & reported as PulseAudioMixer would, held back for as long.
+class FakeAudioMixer : public AudioMixer
+{
+public:
+    FakeAudioMixer();
+
+    /// A stream of that sink was opened or closed, as Pulse would report it
+    void    openCloseSink(EVirtualSink sink, bool openNotClose);
+
+    void    init(GMainLoop * loop, LSHandle * handle,
+                 AudiodCallbacksInterface * interface);
+    bool    readyToProgram()                { return true; }
+
+    bool    programVolume(EVirtualSink sink, int volume, bool ramp = false);
+    bool    programMute(EVirtualSource source, int mute);
+    bool    rampVolume(EVirtualSink sink, int endVolume)
+                { return programVolume(sink, endVolume, true); }
+    bool    rampVolume(EVirtualSink sink, int endVolume,
+                       int duration, ERampCurve curve);
+    void    cancelRamp(EVirtualSink sink);
+
+    bool    programDestination(EVirtualSink sink, EPhysicalSink destination);
+    bool    programDestination(EVirtualSource source, EPhysicalSource destination);
+    bool    programDestinations(const int * sinkDestinations,
+                                const int * sourceDestinations);
+
+    bool    programFilter(int filterTable);
+    bool    programLatency(int latency);
+    bool    programBalance(int balance);
+    bool    muteAll();
+
+    int     adjustVolume(int volume, int dB);
+
+    VirtualSinkSet  getActiveStreams()      { return mActiveStreams; }
+    int     getStreamCount(EVirtualSink sink);
+    int     getOutputStreamOpenedCount()    { return mOutputStreamsCount; }
+    int     getInputStreamOpenedCount()     { return 0; }
+    bool    isSinkAudible(EVirtualSink sink);
+
+    bool    suspendAll();
+    bool    updateRate(int rate);
+
+    bool    playSystemSound(const char * snd, EVirtualSink sink);
+    void    preloadSystemSound(const char * snd)    {}
+    void    playDtmf(const char * snd, EVirtualSink sink);
+    void    playOneshotDtmf(const char * snd, EVirtualSink sink);
+    void    stopDtmf();
+
+    bool    programLoadRTP(const char * type, const char * ip, int port);
+    bool    programHeadsetRoute(int route);
+    bool    programUnloadRTP();
+    bool    loadUSBSinkSource(char cmd, int cardno, int deviceno, int status);
+
+#ifdef HAVE_BT_SERVICE_V1
+    void    setBTvolumeSupport(bool value)                  {}
+    void    sendBTDeviceType(bool type, bool hfpStatus)     {}
+#endif
+    bool    suspendSink(int sink);
+    void    setNREC(bool value);
+    bool    programLoadBluetooth(const char * address, const char * profile);
+    bool    programUnloadBluetooth(const char * profile);
+    bool    setRouting(const GenericScenario & scenario);
+    bool    phoneEvent(EPhoneEvent event, int parameter);
+    bool    programCallVoiceOrMICVolume(char cmd, int volume);
+    bool    getBTVolumeSupport()                { return false; }
+    void    setBTDeviceType(int type)           {}
+    bool    setPhoneMuted(const ConstString & scenario, bool muted);
+    bool    setPhoneVolume(const ConstString & scenario, int volume);
+    int     loopback_set_parameters(const char * value);
+    bool    inHfpAgRole()                       { return mHfpAgRole; }
+    void    setHfpAgRole(bool hfpAgRole)        { mHfpAgRole = hfpAgRole; }
+
+    /// Report the sink events held back now, rather than when Pulse would
+    void    flushSinkEvents();
+
+private:
+    /// Record a command, unless it changes nothing. Same letters as Pulse's.
+    bool    command(char cmd, int sink, int value);
+
+    /// Is a ramp still running? Its steps aren't simulated, only its end.
+    bool    ramping(EVirtualSink sink);
+
+    static gboolean _connected(gpointer data);
+    static gboolean _flushSinkEvents(gpointer data);
+
+    AudiodCallbacksInterface *  mCallbacks;
+    int                         mVolume[eVirtualSink_Count];
+    int                         mRoute[eVirtualSink_Count];
+    int                         mSourceRoute[eVirtualSource_Count];
+    int                         mRampTo[eVirtualSink_Count];
+    gint64                      mRampEnd[eVirtualSink_Count];   // virtual time
+    int                         mStreamCount[eVirtualSink_Count];
+    int                         mOutputStreamsCount;
+    VirtualSinkSet              mActiveStreams;
+    VirtualSinkSet              mReportedStreams;
+    bool                        mSinkEventsUrgent;
+    guint                       mSinkEventsSourceID;
+    int                         mFilter;
+    int                         mLatency;
+    int                         mBalance;
+    bool                        mHfpAgRole;
+};
+
+extern FakeAudioMixer gFakeAudioMixer;
+
+#endif // _FAKEAUDIOMIXER_H_
@@ -0,0 +1,287 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Just enough of luna-service2 & luna-prefs for audiod to run offline.
+// Methods audiod registers can be called by scripts, replies are part of
+// the output. Calls to other services go nowhere & are only listed.
+// Preferences start empty & aren't stored.
+
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <lunaservice.h>
+#include <lunaprefs.h>
+
+#include "simulator.h"
+
+struct LSHandle
+{
+    int     mUnused;
+};
+
+struct LSMessage
+{
+    std::string     mCategory;
+    std::string     mMethod;
+    std::string     mPayload;
+    int             mRefCount;
+};
+
+struct Category
+{
+    std::map<std::string, LSMethodFunction> mMethods;
+    void *                                  mData;
+};
+
+static LSHandle sHandle;
+static std::map<std::string, Category> sCategories;
+
+bool simLunaCall(const char * uri, const char * payload)
+{
+    // "/category/method", the category possibly containing slashes
+    const char * slash = strrchr(uri, '/');
+    if (!slash || slash == uri)
+        return false;
+    std::string category(uri, slash - uri);
+    std::map<std::string, Category>::iterator cat = sCategories.find(category);
+    if (cat == sCategories.end())
+        return false;
+    std::map<std::string, LSMethodFunction>::iterator method = cat->second.mMethods.find(slash + 1);
+    if (method == cat->second.mMethods.end())
+        return false;
+
+    LSMessage * message = new LSMessage();
+    message->mCategory = category;
+    message->mMethod = slash + 1;
+    message->mPayload = payload;
+    message->mRefCount = 1;
+    method->second(&sHandle, message, cat->second.mData);
+    LSMessageUnref(message);
+    return true;
+}
+
+static bool
+_registerMethods(const char * category, LSMethod * methods)
+{
+    Category & cat = sCategories[category];
+    for (int i = 0; methods && methods[i].name; ++i)
+        cat.mMethods[methods[i].name] = methods[i].function;
+    return true;
+}
+
+extern "C" {
+
+bool LSErrorInit(LSError * lserror)
+{
+    memset(lserror, 0, sizeof(*lserror));
+    return true;
+}
+
+void LSErrorFree(LSError * lserror)
+{
+}
+
+bool LSErrorIsSet(LSError * lserror)
+{
+    return lserror && lserror->error_code != 0;
+}
+
+void LSErrorPrint(LSError * lserror, FILE * out)
+{
+}
+
+bool LSRegister(const char * name, LSHandle ** sh, LSError * lserror)
+{
+    *sh = &sHandle;
+    return true;
+}
+
+bool LSGmainAttach(LSHandle * sh, GMainLoop * mainLoop, LSError * lserror)
+{
+    return true;
+}
+
+bool LSRegisterCategory(LSHandle * sh, const char * category, LSMethod * methodTable,
+                        LSSignal * signalTable, LSProperty * propertyTable,
+                        LSError * lserror)
+{
+    return _registerMethods(category, methodTable);
+}
+
+bool LSRegisterCategoryAppend(LSHandle * sh, const char * category,
+                              LSMethod * methodTable, LSSignal * signalTable,
+                              LSError * lserror)
+{
+    return _registerMethods(category, methodTable);
+}
+
+bool LSCategorySetData(LSHandle * sh, const char * category, void * user_data,
+                       LSError * lserror)
+{
+    sCategories[category].mData = user_data;
+    return true;
+}
+
+bool LSCall(LSHandle * sh, const char * uri, const char * payload,
+            LSFilterFunc callback, void * user_data,
+            LSMessageToken * ret_token, LSError * lserror)
+{
+    simOutput("call", "%s %s", uri, payload);
+    if (ret_token)
+        *ret_token = 0;
+    return true;
+}
+
+bool LSCallOneReply(LSHandle * sh, const char * uri, const char * payload,
+                    LSFilterFunc callback, void * user_data,
+                    LSMessageToken * ret_token, LSError * lserror)
+{
+    return LSCall(sh, uri, payload, callback, user_data, ret_token, lserror);
+}
+
+bool LSRegisterServerStatusEx(LSHandle * sh, const char * serviceName,
+                              LSServerStatusFunc func, void * ctxt,
+                              void ** cookie, LSError * lserror)
+{
+    if (cookie)
+        *cookie = NULL;
+    return true;
+}
+
+bool LSMessageReply(LSHandle * sh, LSMessage * lsmsg, const char * replyPayload,
+                    LSError * lserror)
+{
+    simOutput("reply", "%s/%s %s", lsmsg->mCategory.c_str(),
+                                   lsmsg->mMethod.c_str(), replyPayload);
+    return true;
+}
+
+bool LSMessageRespond(LSMessage * message, const char * reply_payload, LSError * lserror)
+{
+    return LSMessageReply(&sHandle, message, reply_payload, lserror);
+}
+
+void LSMessageRef(LSMessage * message)
+{
+    ++message->mRefCount;
+}
+
+void LSMessageUnref(LSMessage * message)
+{
+    if (--message->mRefCount == 0)
+        delete message;
+}
+
+const char * LSMessageGetPayload(LSMessage * message)
+{
+    return message->mPayload.c_str();
+}
+
+const char * LSMessageGetCategory(LSMessage * message)
+{
+    return message->mCategory.c_str();
+}
+
+const char * LSMessageGetMethod(LSMessage * message)
+{
+    return message->mMethod.c_str();
+}
+
+const char * LSMessageGetSender(LSMessage * message)
+{
+    return "sim";
+}
+
+const char * LSMessageGetSenderServiceName(LSMessage * message)
+{
+    return "com.webos.audiod-sim";
+}
+
+LSHandle * LSMessageGetConnection(LSMessage * message)
+{
+    return &sHandle;
+}
+
+bool LSMessageIsSubscription(LSMessage * message)
+{
+    return false;
+}
+
+bool LSSubscriptionProcess(LSHandle * sh, LSMessage * message, bool * subscribed,
+                           LSError * lserror)
+{
+    if (subscribed)
+        *subscribed = false;
+    return true;
+}
+
+bool LSSubscriptionAdd(LSHandle * sh, const char * key, LSMessage * message,
+                       LSError * lserror)
+{
+    return true;
+}
+
+bool LSSubscriptionReply(LSHandle * sh, const char * key, const char * payload,
+                         LSError * lserror)
+{
+    simOutput("notify", "%s %s", key, payload);
+    return true;
+}
+
+bool LSSubscriptionPost(LSHandle * sh, const char * category, const char * method,
+                        const char * payload, LSError * lserror)
+{
+    simOutput("notify", "%s/%s %s", category, method, payload);
+    return true;
+}
+
+bool LSSubscriptionSetCancelFunction(LSHandle * sh, LSCancelFunction cancelFunction,
+                                     void * ctx, LSError * lserror)
+{
+    return true;
+}
+
+LPErr LPAppGetHandle(const char * appId, LPAppHandle * handle)
+{
+    static int sPrefs;
+    *handle = (LPAppHandle) &sPrefs;
+    return LP_ERR_NONE;
+}
+
+LPErr LPAppFreeHandle(LPAppHandle handle, bool commit)
+{
+    return LP_ERR_NONE;
+}
+
+LPErr LPAppCopyKeys(LPAppHandle handle, char ** jsonArray)
+{
+    *jsonArray = g_strdup("[]");
+    return LP_ERR_NONE;
+}
+
+LPErr LPAppCopyValue(LPAppHandle handle, const char * key, char ** jsonValue)
+{
+    *jsonValue = NULL;
+    return LP_ERR_NOSUCHKEY;
+}
+
+LPErr LPAppSetValue(LPAppHandle handle, const char * key, const char * jsonValue)
+{
+    return LP_ERR_NONE;
+}
+
+}
@@ -0,0 +1,507 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// audiod-sim: replay a scripted trace of events through audiod's policy,
+// & print the mixer commands it produces, stamped with virtual time.
+//
+// Script lines are "<ms> <event> <arguments>", in time order:
+//      <ms> open <sink>                    a stream of that sink opens
+//      <ms> close <sink>                   ...& closes
+//      <ms> headset none|headset|headsetmic
+//      <ms> call <mode> <status>           mode: none|carrier|voip, status:
+//                                          nocall|connecting|incoming|dialing|
+//                                          onhold|active|disconnected
+//      <ms> activeCall 0|1 <mode>
+//      <ms> incomingCall 0|1 <mode>
+//      <ms> ringer on|off
+//      <ms> luna <uri> <json>              call one of audiod's luna methods,
+//                                          volume keys are /<module>/volumeUp...
+//      <ms> end                            run audiod's timers until then
+// Empty lines & lines starting with '#' are ignored.
+// With -c, the output is also compared with a golden output, a previous run's
+// output without -p: the run fails from the first line that differs.
+// Events at the same time are all applied before audiod's idle callbacks
+// run, like one burst from the outside world. Streams opening & closing are
+// reported as by PulseAudioMixer: one by one, unless built with a
+// SINK_EVENTS_COALESCING_DELAY, then held back as long on the virtual clock.
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+#include <lunaservice.h>
+
+#include "simulator.h"
+#include "fakeAudioMixer.h"
+#include "PulseAudioMixer.h"
+#include "state.h"
+#include "stateTransition.h"
+#include "scenario.h"
+#include "AudiodCallbacks.h"
+#include "prefsJournal.h"
+#include "duckingPolicy.h"
+#include "AudioDevice.h"
+#include "utils.h"
+#include "messageUtils.h"
+#include "log.h"
+#include "main.h"
+
+/// How long audiod's timers are run after the last event, when no end is given
+static const gint64 cSettleTime = 10 * G_USEC_PER_SEC;
+
+extern "C" gint64 __real_g_get_monotonic_time(void);
+
+static GMainLoop * sMainLoop = NULL;
+static LSHandle * sLSHandle = NULL;
+static unsigned sCommandCounts[256];
+static gchar * sJournalDir = NULL;
+static FILE * sExpected = NULL;
+static const char * sExpectedName = NULL;
+static int sOutputLines = 0;
+static bool sMismatch = false;
+
+/// Volumes journaled by a run must not leak into the next one,
+/// nor into the journal of an audiod running on the same machine.
+static std::string
+_journalPath()
+{
+    sJournalDir = g_dir_make_tmp("audiod-sim-XXXXXX", NULL);
+    return std::string(sJournalDir ? sJournalDir : "/tmp") + "/volume.journal";
+}
+
+PreferencesJournal gPreferencesJournal(_journalPath().c_str());
+
+GMainContext *
+GetMainLoopContext()
+{
+    return g_main_loop_get_context(sMainLoop);
+}
+
+LSHandle *
+GetPalmService()
+{
+    return sLSHandle;
+}
+
+/// Compare a line of output with the next one of the golden output.
+/// Only the first difference is reported: the rest usually follows from it.
+static void
+_compareOutput(const char * line)
+{
+    char expected[4096];
+    ++sOutputLines;
+    if (!fgets(expected, sizeof(expected), sExpected))
+        expected[0] = 0;
+    expected[strcspn(expected, "\n")] = 0;
+    if (!sMismatch && strcmp(line, expected) != 0)
+    {
+        fprintf(stderr, "%s:%d: output differs\n expected: %s\n      got: %s\n",
+                        sExpectedName, sOutputLines, expected, line);
+        sMismatch = true;
+    }
+}
+
+void simOutput(const char * kind, const char * format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    gchar * text = g_strdup_vprintf(format, args);
+    va_end(args);
+    gchar * line = g_strdup_printf("%10.3f %-6s %s", simTime() / 1000., kind, text);
+    puts(line);
+    // real time isn't reproducible
+    if (sExpected && strcmp(kind, "cost") != 0)
+        _compareOutput(line);
+    g_free(line);
+    g_free(text);
+}
+
+void simCountCommand(char cmd)
+{
+    ++sCommandCounts[(unsigned char) cmd];
+}
+
+static bool
+_parseCallMode(const char * name, ECallMode & mode)
+{
+    static const char * sNames[] = { "none", "carrier", "voip" };
+    for (size_t i = 0; i < G_N_ELEMENTS(sNames); ++i)
+    {
+        if (name && strcmp(name, sNames[i]) == 0)
+        {
+            mode = (ECallMode) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+_parseCallStatus(const char * name, ECallStatus & status)
+{
+    static const char * sNames[] = { "nocall", "connecting", "incoming", "dialing",
+                                     "onhold", "active", "disconnected" };
+    for (size_t i = 0; i < G_N_ELEMENTS(sNames); ++i)
+    {
+        if (name && strcmp(name, sNames[i]) == 0)
+        {
+            status = (ECallStatus) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+_parseHeadset(const char * name, EHeadsetState & state)
+{
+    static const char * sNames[] = { "none", "headset", "headsetmic" };
+    for (size_t i = 0; i < G_N_ELEMENTS(sNames); ++i)
+    {
+        if (name && strcmp(name, sNames[i]) == 0)
+        {
+            state = (EHeadsetState) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+_parseBool(const char * value, bool & result)
+{
+    if (value && (strcmp(value, "1") == 0 || strcmp(value, "on") == 0))
+        result = true;
+    else if (value && (strcmp(value, "0") == 0 || strcmp(value, "off") == 0))
+        result = false;
+    else
+        return false;
+    return true;
+}
+
+/// Apply one event of the script. Returns false if it can't be understood.
+static bool
+_applyEvent(const char * event, char * args)
+{
+    char * saveptr = NULL;
+    const char * arg1 = strtok_r(args, " \t", &saveptr);
+
+    if (strcmp(event, "open") == 0 || strcmp(event, "close") == 0)
+    {
+        EVirtualSink sink = arg1 ? getSinkByName(arg1) : eVirtualSink_None;
+        if (!IsValidVirtualSink(sink))
+            return false;
+        gFakeAudioMixer.openCloseSink(sink, event[0] == 'o');
+        return true;
+    }
+
+    if (strcmp(event, "headset") == 0)
+    {
+        EHeadsetState state;
+        if (!_parseHeadset(arg1, state))
+            return false;
+        gState.setHeadsetState(state);
+        return true;
+    }
+
+    if (strcmp(event, "ringer") == 0)
+    {
+        bool on;
+        if (!_parseBool(arg1, on))
+            return false;
+        gState.setRingerOn(on);
+        return true;
+    }
+
+    if (strcmp(event, "luna") == 0)
+    {
+        // the payload is the rest of the line, spaces included
+        const char * payload = saveptr && *saveptr ? saveptr : "{}";
+        if (!arg1 || !simLunaCall(arg1, payload))
+            return false;
+        return true;
+    }
+
+    const char * arg2 = strtok_r(NULL, " \t", &saveptr);
+    if (strcmp(event, "call") == 0)
+    {
+        ECallMode mode;
+        ECallStatus status;
+        if (!_parseCallMode(arg1, mode) || !_parseCallStatus(arg2, status))
+            return false;
+        gState.setCallMode(mode, status);
+        return true;
+    }
+
+    if (strcmp(event, "activeCall") == 0 || strcmp(event, "incomingCall") == 0)
+    {
+        bool active;
+        ECallMode mode;
+        if (!_parseBool(arg1, active) || !_parseCallMode(arg2, mode))
+            return false;
+        if (event[0] == 'a')
+            gState.setOnActiveCall(active, mode);
+        else
+            gState.setIncomingCallActive(active, mode);
+        return true;
+    }
+
+    return false;
+}
+
+/// Replay a script. Returns false on the first line that can't be used.
+static bool
+_runScript(FILE * script, const char * scriptName, bool profile)
+{
+    char line[1024];
+    int lineNumber = 0;
+    gint64 last = 0;
+    gint64 end = -1;
+
+    while (fgets(line, sizeof(line), script))
+    {
+        ++lineNumber;
+        g_strstrip(line);
+        if (line[0] == 0 || line[0] == '#')
+            continue;
+
+        char * cursor = NULL;
+        errno = 0;
+        gint64 time = g_ascii_strtoll(line, &cursor, 10) * 1000;
+        char * saveptr = NULL;
+        const char * event = strtok_r(cursor, " \t", &saveptr);
+        if (errno || cursor == line || !event || time < last)
+        {
+            fprintf(stderr, "%s:%d: bad or out of order line '%s'\n",
+                            scriptName, lineNumber, line);
+            return false;
+        }
+
+        // everything up to then happens first, then the new event
+        simAdvanceTo(time);
+        last = time;
+
+        if (strcmp(event, "end") == 0)
+        {
+            end = time;
+            break;
+        }
+
+        char * args = saveptr ? saveptr : (char *) "";
+        simOutput("event", "%s %s", event, args);
+        gint64 start = __real_g_get_monotonic_time();
+        if (!_applyEvent(event, args))
+        {
+            fprintf(stderr, "%s:%d: can't apply '%s'\n", scriptName, lineNumber, event);
+            return false;
+        }
+        if (profile)
+        {
+            // the idle callbacks the event queued are part of its cost
+            simDrain();
+            simOutput("cost", "%s %.3f ms", event,
+                      (__real_g_get_monotonic_time() - start) / 1000.);
+        }
+    }
+
+    simAdvanceTo(end >= 0 ? end : last + cSettleTime);
+    return true;
+}
+
+static void
+_printSummary()
+{
+    unsigned total = 0;
+    for (int cmd = 0; cmd < 256; ++cmd)
+    {
+        if (sCommandCounts[cmd] > 0)
+        {
+            simOutput("count", "%c %u", cmd, sCommandCounts[cmd]);
+            total += sCommandCounts[cmd];
+        }
+    }
+    simOutput("count", "total %u", total);
+}
+
+/// Rounds of name lookups timed by -b
+static const int cBenchmarkRounds = 100000;
+
+/// audiod's built-in unit tests, then those needing the initialized stack
+static bool
+_runUnitTests()
+{
+    bool ok = ConstString::UnitTest();
+    ok = PulseAudioMixer::UnitTest() && ok;
+    ok = GenericScenarioModule::UnitTest() && ok;
+    ok = AudiodCallbacks::UnitTest() && ok;
+    ok = ScenarioModule::UnitTest() && ok;
+    ok = simStackTests() && ok;
+    printf("unit tests %s (%d failed checks)\n", ok ? "passed" : "FAILED",
+                                                  unitTestFailureCount());
+    return ok;
+}
+
+/// Undo what main set up
+static void
+_cleanUp()
+{
+    oneFreeForAll();
+    g_main_loop_unref(sMainLoop);
+
+    if (sJournalDir)
+    {
+        gchar * journal = g_build_filename(sJournalDir, "volume.journal", NULL);
+        unlink(journal);
+        g_free(journal);
+        rmdir(sJournalDir);
+        g_free(sJournalDir);
+    }
+}
+
+static void
+_printUsage(const char * progname)
+{
+    printf("%s [options] [-c <golden output>] <script>\n", progname);
+    printf("%s -u|-b\n", progname);
+    printf(" -h this help screen\n"
+           " -u run audiod's unit tests, some on the initialized stack, instead of a script\n"
+           " -b benchmark the sink & source name lookups instead of a script\n"
+           " -d turn debug-level logging on and send logs to the terminal\n"
+           " -p print the real time each event took to process\n"
+           " -l print the state transition log at the end\n"
+           " -c <file> fail if the output differs from that golden output\n"
+           " -D <file> ducking policy to use\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    int opt;
+    bool profile = false;
+    bool transitions = false;
+    bool unitTests = false;
+    const char * duckingPolicy = NULL;
+
+    setProcessName(argv[0]);
+
+    while ((opt = getopt(argc, argv, "hdplD:ubc:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'u':
+            unitTests = true;
+            break;
+        case 'b':
+            return PulseAudioMixer::BenchmarkNameLookups(cBenchmarkRounds) ? 0 : 1;
+        case 'd':
+            setLogLevel(G_LOG_LEVEL_DEBUG);
+            addLogDestination(eLogDestination_Terminal);
+            break;
+        case 'p':
+            profile = true;
+            break;
+        case 'l':
+            transitions = true;
+            break;
+        case 'D':
+            duckingPolicy = optarg;
+            break;
+        case 'c':
+            sExpectedName = optarg;
+            break;
+        case 'h':
+        default:
+            _printUsage(argv[0]);
+            return 0;
+        }
+    }
+
+    if (optind != argc - (unitTests ? 0 : 1))
+    {
+        _printUsage(argv[0]);
+        return 1;
+    }
+
+    FILE * script = NULL;
+    if (!unitTests)
+        script = strcmp(argv[optind], "-") == 0 ? stdin : fopen(argv[optind], "r");
+    if (!unitTests && !script)
+    {
+        fprintf(stderr, "can't open '%s': %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    if (sExpectedName && !(sExpected = fopen(sExpectedName, "r")))
+    {
+        fprintf(stderr, "can't open '%s': %s\n", sExpectedName, strerror(errno));
+        return 1;
+    }
+
+    g_log_set_default_handler(logFilter, NULL);
+
+    // like audiod's main, minus Pulse, the umi mixer & the persistence thread:
+    // preferences are read & written synchronously, which keeps runs reproducible
+    gState.init();
+    VERIFY(gAudioDevice.pre_init());
+    sMainLoop = g_main_loop_new(NULL, FALSE);
+    LSRegister(AUDIOD_SERVICE_PATH, &sLSHandle, NULL);
+    LSGmainAttach(sLSHandle, sMainLoop, NULL);
+    if (duckingPolicy)
+        gDuckingPolicy.load(duckingPolicy);
+    oneInitForAll(sMainLoop, GetPalmService());
+    VERIFY(gAudioDevice.post_init());
+    simDrain();
+
+    if (unitTests)
+    {
+        bool ok = _runUnitTests();
+        _cleanUp();
+        return ok ? 0 : 1;
+    }
+
+    gint64 start = __real_g_get_monotonic_time();
+    bool ok = _runScript(script, argv[optind], profile);
+    gint64 elapsed = __real_g_get_monotonic_time() - start;
+    if (script != stdin)
+        fclose(script);
+
+    _printSummary();
+    if (profile)
+        simOutput("cost", "total %.3f ms", elapsed / 1000.);
+    if (sExpected)
+    {
+        char extra[4096];
+        if (!sMismatch && fgets(extra, sizeof(extra), sExpected))
+        {
+            fprintf(stderr, "%s:%d: output ends early\n", sExpectedName, sOutputLines + 1);
+            sMismatch = true;
+        }
+        fclose(sExpected);
+        ok = ok && !sMismatch;
+    }
+    if (transitions)
+    {
+        pbnjson::JValue log = pbnjson::Object();
+        stateTransitionLogToJson(log);
+        printf("%s\n", jsonToString(log).c_str());
+    }
+
+    _cleanUp();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _SIMULATOR_H_
+#define _SIMULATOR_H_
+
+#include <glib.h>
+
+/// audiod-sim runs the scenario & module stack offline, against a recording
+/// AudioMixer & stubbed luna & preferences libraries. Scripted events are
+/// replayed on a virtual clock: audiod's own timers fire in order without
+/// anyone waiting for them, so that a run is fast & its output reproducible.
+
+/// Virtual time since the start of the simulation, in us.
+/// The GLib timers & clock audiod uses are linked to it with --wrap.
+gint64  simTime();
+
+/// Run audiod's timers due until then, the virtual clock ending there
+void    simAdvanceTo(gint64 time);
+
+/// Run all that is ready on the main loop, without moving the clock
+void    simDrain();
+
+/// Time of the next audiod timer, -1 if none
+gint64  simNextTimer();
+
+/// One line of simulation output, stamped with the virtual time
+void    simOutput(const char * kind, const char * format, ...) G_GNUC_PRINTF(2, 3);
+
+/// Call one of the luna methods audiod registered, like a client would.
+/// Returns false if there is no such method.
+bool    simLunaCall(const char * uri, const char * payload);
+
+/// How many mixer commands were recorded, by command letter
+void    simCountCommand(char cmd);
+
+/// Unit tests needing the stack audiod-sim initializes, see stackTests.cpp.
+/// Returns true on success.
+bool    simStackTests();
+
+#endif // _SIMULATOR_H_
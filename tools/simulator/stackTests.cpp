@@ -0,0 +1,130 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Unit tests needing audiod's whole stack, initialized as for a script.
+// Each test leaves the stack idle, with the streams it opened closed.
+
+#include <unistd.h>
+
+#include "simulator.h"
+#include "ConstString.h"
+#include "fakeAudioMixer.h"
+#include "duckingPolicy.h"
+#include "stateTransition.h"
+#include "state.h"
+#include "media.h"
+#include "utils.h"
+
+/// Long enough for any ramp or timer a test starts to be done
+static const gint64 cSettleTime = G_USEC_PER_SEC;
+
+static void
+_settle()
+{
+    simDrain();
+    simAdvanceTo(simTime() + cSettleTime);
+}
+
+/// Replace the ducking policy with one rule, ramping its ducking
+static bool
+_loadDuckingRule(const char * rule)
+{
+    gchar * json = g_strdup_printf("{ \"duckingPolicy\": [ %s ] }", rule);
+    gchar * path = g_build_filename(g_get_tmp_dir(), "audiod-sim-ducking.json", NULL);
+    bool loaded = g_file_set_contents(path, json, -1, NULL) && gDuckingPolicy.load(path);
+    unlink(path);
+    g_free(path);
+    g_free(json);
+    return loaded;
+}
+
+/// Cached target volumes must leave media's ducking state as programming did,
+/// or the next ducking change of a sink doesn't ramp as the policy says.
+static void
+_testDuckingThroughTargetVolumesCache()
+{
+    MediaScenarioModule * media = getMediaModule();
+    UT_CHECK(_loadDuckingRule("{ \"when\": [\"notifications\"], \"duck\": [\"media\"], "
+                              "\"dB\": -12, \"rampMs\": 250, \"curve\": \"linear\" }"));
+    UT_CHECK(media->makeCurrent());
+    gFakeAudioMixer.openCloseSink(emedia, true);
+    _settle();
+    UT_CHECK(media->getDuckingDB()[emedia] == 0);
+
+    // duck & unduck twice: the second time round, volumes come from the cache
+    for (int round = 0; round < 2; ++round)
+    {
+        gFakeAudioMixer.openCloseSink(enotifications, true);
+        gFakeAudioMixer.flushSinkEvents();
+        media->programSoftwareMixer(true);
+        UT_CHECK(media->getDuckingDB()[emedia] == -12);
+        _settle();
+        gFakeAudioMixer.openCloseSink(enotifications, false);
+        gFakeAudioMixer.flushSinkEvents();
+        media->programSoftwareMixer(true);
+        UT_CHECK(media->getDuckingDB()[emedia] == 0);
+        _settle();
+    }
+
+    gFakeAudioMixer.openCloseSink(emedia, false);
+    _settle();
+}
+
+/// Nested state transitions program the current module once, as the outermost
+/// ends: what the request made inside the inner one shows only then.
+static void
+_testNestedStateTransitions()
+{
+    MediaScenarioModule * media = getMediaModule();
+    UT_CHECK(_loadDuckingRule("{ \"when\": [\"notifications\"], \"duck\": [\"media\"], "
+                              "\"dB\": -12 }"));
+    UT_CHECK(media->makeCurrent());
+    gFakeAudioMixer.openCloseSink(emedia, true);
+    _settle();
+
+    {
+        StateTransition outer(eStateEvent_Ringer, gState.getRingerOn());
+        {
+            StateTransition inner(eStateEvent_Headset, gState.getHeadsetState());
+            // modules notified now request programming too
+            gFakeAudioMixer.openCloseSink(enotifications, true);
+            gFakeAudioMixer.flushSinkEvents();
+            media->programSoftwareMixer(true);
+            UT_CHECK(media->getDuckingDB()[emedia] == 0);
+        }
+        UT_CHECK(media->getDuckingDB()[emedia] == 0);
+        media->programSoftwareMixer(false);
+        UT_CHECK(media->getDuckingDB()[emedia] == 0);
+    }
+    UT_CHECK(media->getDuckingDB()[emedia] == -12);
+    _settle();
+
+    gFakeAudioMixer.openCloseSink(enotifications, false);
+    gFakeAudioMixer.openCloseSink(emedia, false);
+    _settle();
+    UT_CHECK(media->getDuckingDB()[emedia] == 0);
+}
+
+bool
+simStackTests()
+{
+    int failures = unitTestFailureCount();
+
+    _testDuckingThroughTargetVolumesCache();
+    _testNestedStateTransitions();
+
+    return unitTestFailureCount() == failures;
+}
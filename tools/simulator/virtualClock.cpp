@@ -0,0 +1,156 @@
+// Copyright (c) 2012-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <map>
+#include <utility>
+
+#include "simulator.h"
+
+// audiod's objects are linked with --wrap for these, so that its timers &
+// clock are virtual. GLib itself, & its idle & I/O sources, are left alone.
+extern "C" {
+gboolean __real_g_source_remove(guint tag);
+
+gint64  __wrap_g_get_monotonic_time(void);
+guint   __wrap_g_timeout_add(guint interval, GSourceFunc function, gpointer data);
+guint   __wrap_g_timeout_add_full(gint priority, guint interval, GSourceFunc function,
+                                  gpointer data, GDestroyNotify notify);
+guint   __wrap_g_timeout_add_seconds_full(gint priority, guint interval,
+                                          GSourceFunc function, gpointer data,
+                                          GDestroyNotify notify);
+gboolean __wrap_g_source_remove(guint tag);
+}
+
+/// Far above the ids GLib hands out, so that both can be told apart
+static const guint cFirstTimerId = 0x40000000;
+
+/// Never 0: audiod uses a null time as "not started"
+static const gint64 cOrigin = G_GINT64_CONSTANT(1000000);
+
+struct VirtualTimer
+{
+    gint64          mInterval;  // us
+    GSourceFunc     mFunction;
+    gpointer        mData;
+    GDestroyNotify  mNotify;
+};
+
+/// Due timers, by due time then creation order
+typedef std::map<std::pair<gint64, guint>, VirtualTimer> TTimers;
+
+static TTimers sTimers;
+static guint sNextTimerId = cFirstTimerId;
+static gint64 sNow = cOrigin;
+static guint sRunningTimer = 0;         // removing it only stops it repeating
+static bool sRunningTimerRemoved = false;
+
+gint64 simTime()
+{
+    return sNow - cOrigin;
+}
+
+gint64 simNextTimer()
+{
+    return sTimers.empty() ? -1 : sTimers.begin()->first.first - cOrigin;
+}
+
+void simDrain()
+{
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+}
+
+void simAdvanceTo(gint64 time)
+{
+    time += cOrigin;
+    simDrain();
+    while (!sTimers.empty() && sTimers.begin()->first.first <= time)
+    {
+        TTimers::iterator first = sTimers.begin();
+        guint id = first->first.second;
+        VirtualTimer timer = first->second;
+        sNow = MAX(sNow, first->first.first);
+        sTimers.erase(first);
+
+        sRunningTimer = id;
+        sRunningTimerRemoved = false;
+        bool again = timer.mFunction(timer.mData);
+        sRunningTimer = 0;
+        if (again && !sRunningTimerRemoved)
+            sTimers[std::make_pair(sNow + timer.mInterval, id)] = timer;
+        else if (timer.mNotify)
+            timer.mNotify(timer.mData);
+        simDrain();
+    }
+    sNow = MAX(sNow, time);
+}
+
+static guint
+_addTimer(gint64 interval, GSourceFunc function, gpointer data, GDestroyNotify notify)
+{
+    VirtualTimer timer = { interval, function, data, notify };
+    guint id = sNextTimerId++;
+    sTimers[std::make_pair(sNow + interval, id)] = timer;
+    return id;
+}
+
+gint64 __wrap_g_get_monotonic_time(void)
+{
+    return sNow;
+}
+
+guint __wrap_g_timeout_add(guint interval, GSourceFunc function, gpointer data)
+{
+    return _addTimer((gint64) interval * 1000, function, data, NULL);
+}
+
+guint __wrap_g_timeout_add_full(gint priority, guint interval, GSourceFunc function,
+                                gpointer data, GDestroyNotify notify)
+{
+    return _addTimer((gint64) interval * 1000, function, data, notify);
+}
+
+guint __wrap_g_timeout_add_seconds_full(gint priority, guint interval,
+                                        GSourceFunc function, gpointer data,
+                                        GDestroyNotify notify)
+{
+    return _addTimer((gint64) interval * G_USEC_PER_SEC, function, data, notify);
+}
+
+gboolean __wrap_g_source_remove(guint tag)
+{
+    if (tag < cFirstTimerId)
+        return __real_g_source_remove(tag);
+
+    if (tag == sRunningTimer && !sRunningTimerRemoved)
+    {
+        sRunningTimerRemoved = true;
+        return TRUE;
+    }
+
+    for (TTimers::iterator iter = sTimers.begin(); iter != sTimers.end(); ++iter)
+    {
+        if (iter->first.second == tag)
+        {
+            VirtualTimer timer = iter->second;
+            sTimers.erase(iter);
+            if (timer.mNotify)
+                timer.mNotify(timer.mData);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
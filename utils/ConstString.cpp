@@ -18,6 +18,17 @@
 #include "log.h"
 #include <cstdio>
 
+ConstString ConstString::intern(const gchar * string)
+{
+    ConstString interned;
+    if (string)
+    {
+        interned.mString = g_intern_string(string);
+        interned.mInterned = true;
+    }
+    return interned;
+}
+
 bool ConstString::hasSuffix(const gchar * rhs) const
 {
     return g_str_has_suffix(c_str(), rhs);
@@ -32,10 +43,10 @@ bool ConstString::hasPrefix(const gchar * prefix, ConstString & suffix) const
 {
     if (!g_str_has_prefix(c_str(), prefix))
     {
-        suffix.mString = 0;        // clear returned suffix as well
+        suffix = ConstString();    // clear returned suffix as well
         return false;
     }
-    suffix.mString = mString + strlen(prefix);
+    suffix = ConstString(mString + strlen(prefix));
     return true;
 }
 
@@ -44,10 +55,10 @@ bool ConstString::find(const gchar * string, ConstString & rest) const
     const gchar * s = strstr(c_str(), string);
     if (s)
     {
-        rest.mString = s + strlen(string);
+        rest = ConstString(s + strlen(string));
         return true;
     }
-    rest.mString = 0;
+    rest = ConstString();
     return false;
 }
 
@@ -56,25 +67,29 @@ bool ConstString::rfind(const gchar * string, ConstString & rest) const
     const gchar * s = g_strrstr(c_str(), string);
     if (s)
     {
-        rest.mString = s + strlen(string);
+        rest = ConstString(s + strlen(string));
         return true;
     }
-    rest.mString = 0;
+    rest = ConstString();
     return false;
 }
 
-#define UT_CHECK(t) ((t) || (failedUnitTest(#t, __FILE__, __LINE__, __FUNCTION__), false))
-
 static int sUnitTestFailureCount = 0;
 
-static void failedUnitTest(const gchar * test, const gchar * file, int line, const gchar * function)
+void failedUnitTest(const gchar * test, const gchar * file, int line, const gchar * function)
 {
     g_critical("Failed unit test: \"%s\" is false in %s, %s:%d.", test, function, file, line);
     sUnitTestFailureCount++;
 }
 
+int unitTestFailureCount()
+{
+    return sUnitTestFailureCount;
+}
+
 bool ConstString::UnitTest()
 {
+    int failures = sUnitTestFailureCount;
     ConstString        nullstring, nullstring2;
     ConstString        one("one");
     ConstString        two("two");
@@ -124,7 +139,15 @@ bool ConstString::UnitTest()
     UT_CHECK(s.find("bc", suffix) && suffix == "bcd");
     UT_CHECK(s.rfind("bc", suffix) && suffix == "d");
 
-    return sUnitTestFailureCount == 0;
+    ConstString internedOne = ConstString::intern("one");
+    UT_CHECK(internedOne.isInterned() && !one.isInterned());
+    UT_CHECK(internedOne == one && internedOne == "one");
+    UT_CHECK(ConstString::intern(std::string("one").c_str()).c_str() == internedOne.c_str());
+    UT_CHECK(internedOne != ConstString::intern("two"));
+    UT_CHECK(internedOne.hasPrefix("o", suffix) && !suffix.isInterned());
+    UT_CHECK(!ConstString::intern(0).isInterned() && ConstString::intern(0) == nullstring);
+
+    return sUnitTestFailureCount == failures;
 }
 
 std::string string_printf(const char *format, ...)
@@ -19,9 +19,15 @@
 #include "ConstString.h"
 #include "PmLogLib.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <cerrno>
 #include <time.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <map>
 
 
@@ -46,6 +52,7 @@ static ELogDestination    sLogDestination = eLogDestination_SystemLog;
 static const char *        sProcessName = "unnamed";
 
 static PmLogContext gLogContext = 0;
+static GStaticMutex sLogTerminalMutex = G_STATIC_MUTEX_INIT;
 
 void setLogDestination(ELogDestination logDestination)
 {
@@ -67,22 +74,86 @@ GLogLevelFlags getLogLevel (void)
     return sLogLevel;
 }
 
+/// Private log file rotation, done by the log writer
+static const int cLogGenerations = 5;
+static size_t   sLogRotateSize = 2 * 1024 * 1024;
+static guint    sLogRotateAge = 24 * 60 * 60;           // s
+static size_t   sLogArchiveBudget = 8 * 1024 * 1024;
+static bool     sLogCompressArchives = true;
+static GPid     sLogCompressPid = 0;                    // gzip still running
+
 // local utility to shift file by renaming them in sequence  "basename", "basename.1", "basename.2", etc
-// optional arguments should not be used and left for the recursive implementation.
-void static sMoveLogFile(const char * baseName, int maxIndex, int index = 0, std::string * nextFileNamePtr = 0)
+// Compressed archives, "basename.N.gz", are shifted the same way. The oldest generation is removed.
+void static sMoveLogFile(const char * baseName, int maxIndex)
+{
+    for (int index = maxIndex; index > 0; --index)
+    {
+        std::string name = string_printf("%s.%d", baseName, index);
+        std::string gzName = name + ".gz";
+        if (index == maxIndex)
+        {
+            ::unlink(name.c_str());
+            ::unlink(gzName.c_str());
+            continue;
+        }
+        std::string nextName = string_printf("%s.%d", baseName, index + 1);
+        ::rename(name.c_str(), nextName.c_str());
+        ::rename(gzName.c_str(), (nextName + ".gz").c_str());
+    }
+    if (g_file_test(baseName, (GFileTest) (G_FILE_TEST_EXISTS | G_FILE_TEST_IS_REGULAR)))
+        ::rename(baseName, string_printf("%s.1", baseName).c_str());
+}
+
+// remove the oldest archives beyond the disk budget
+void static sTrimLogArchives(const char * baseName, int maxIndex, size_t budget)
 {
-    const char * name = baseName;
-    if (nextFileNamePtr)
+    size_t total = 0;
+    for (int index = 1; index <= maxIndex; ++index)
     {
-        *nextFileNamePtr = string_printf("%s.%d", baseName, index);
-        name = nextFileNamePtr->c_str();
+        std::string name = string_printf("%s.%d", baseName, index);
+        std::string gzName = name + ".gz";
+        struct stat fileStat;
+        if (::stat(name.c_str(), &fileStat) == 0)
+            total += fileStat.st_size;
+        if (::stat(gzName.c_str(), &fileStat) == 0)
+            total += fileStat.st_size;
+        if (total > budget)
+        {
+            ::unlink(name.c_str());
+            ::unlink(gzName.c_str());
+        }
     }
-    if (index < maxIndex && g_file_test(name, (GFileTest) (G_FILE_TEST_EXISTS | G_FILE_TEST_IS_REGULAR)))
+}
+
+// compress the newest archive, without waiting for it, if asked, then trim the
+// archives, once the newest one is compressed so that its real size is counted
+void static sArchiveLogFile(const char * baseName)
+{
+    if (sLogCompressArchives)
     {
-        std::string nextFileName;
-        sMoveLogFile(baseName, maxIndex, index + 1, &nextFileName);
-        ::rename(name, nextFileName.c_str());
+        std::string name = string_printf("%s.1", baseName);
+        gchar * argv[] = { (gchar *) "gzip", (gchar *) "-f", (gchar *) name.c_str(), NULL };
+        if (g_spawn_async(NULL, argv, NULL, (GSpawnFlags) (G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD |
+                          G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL),
+                          NULL, NULL, &sLogCompressPid, NULL))
+            return;
+        sLogCompressPid = 0;
     }
+    sTrimLogArchives(baseName, cLogGenerations, sLogArchiveBudget);
+}
+
+// is gzip still compressing the newest archive? Trims the archives once it's done.
+bool static sLogArchiveBusy(const char * baseName)
+{
+    if (sLogCompressPid <= 0)
+        return false;
+    int status;
+    if (::waitpid(sLogCompressPid, &status, WNOHANG) == 0)
+        return true;
+    // done, or reaped by someone else
+    sLogCompressPid = 0;
+    sTrimLogArchives(baseName, cLogGenerations, sLogArchiveBudget);
+    return false;
 }
 
 static const char * logLevelName(GLogLevelFlags logLevel)
@@ -112,7 +183,299 @@ static const char * logLevelName(GLogLevelFlags logLevel)
     return name;
 }
 
-static GStaticMutex slogFilter_mutex = G_STATIC_MUTEX_INIT;
+/// Private log file lines are staged in per-thread rings, without locks,
+/// & written in batches with writev() by a background thread.
+/// When a ring is full, lines are dropped & counted.
+static const size_t cLogRingSize = 64 * 1024;           // power of 2
+static const gulong cLogBatchDelay = 20 * 1000;         // us
+static const int cLogMaxIovecs = 64;
+
+struct LogRing
+{
+    char            mData[cLogRingSize];
+    volatile gint   mHead;      // bytes produced, by the owner thread only
+    volatile gint   mTail;      // bytes written, by the writer only
+    volatile gint   mInUse;     // owned by a thread
+    LogRing *       mNext;
+};
+
+static int                  sLogFile = 0;
+static std::string          sLogFileName;
+static size_t               sLogFileSize = 0;
+static gint64               sLogFileOpened = 0;     // monotonic, us
+static struct timespec      sLogStartSeconds = { 0 };
+static struct tm            sLogStartTime = { 0 };
+
+static volatile gpointer    sLogRings = NULL;
+static __thread LogRing *   tLogRing = NULL;
+static pthread_key_t        sLogRingKey;
+static volatile gint        sDroppedLogLines = 0;
+static gint                 sReportedDroppedLogLines = 0;
+
+static pthread_mutex_t      sLogDrainMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t      sLogWakeMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       sLogWakeCond = PTHREAD_COND_INITIALIZER;
+static bool                 sLogWakePending = false;
+
+// the rotation settings are used by the writer, with the drain mutex locked
+void setLogRotation(size_t maxSize, guint maxAge, size_t diskBudget, bool compress)
+{
+    pthread_mutex_lock(&sLogDrainMutex);
+    sLogRotateSize = maxSize;
+    sLogRotateAge = maxAge;
+    sLogArchiveBudget = diskBudget;
+    sLogCompressArchives = compress;
+    pthread_mutex_unlock(&sLogDrainMutex);
+}
+
+void getLogRotation(size_t & maxSize, guint & maxAge, size_t & diskBudget, bool & compress)
+{
+    pthread_mutex_lock(&sLogDrainMutex);
+    maxSize = sLogRotateSize;
+    maxAge = sLogRotateAge;
+    diskBudget = sLogArchiveBudget;
+    compress = sLogCompressArchives;
+    pthread_mutex_unlock(&sLogDrainMutex);
+}
+
+guint getDroppedLogLines()
+{
+    return (guint) g_atomic_int_get(&sDroppedLogLines);
+}
+
+static void releaseLogRing(void * data)
+{
+    // the thread is gone: the next new thread can reuse its ring
+    g_atomic_int_set(&((LogRing *) data)->mInUse, 0);
+}
+
+static LogRing * getLogRing()
+{
+    LogRing * ring = tLogRing;
+    if (G_LIKELY(ring))
+        return ring;
+
+    for (ring = (LogRing *) g_atomic_pointer_get(&sLogRings); ring; ring = ring->mNext)
+        if (g_atomic_int_compare_and_exchange(&ring->mInUse, 0, 1))
+            break;
+
+    if (!ring)
+    {
+        ring = (LogRing *) calloc(1, sizeof(LogRing));
+        if (!ring)
+            return NULL;
+        ring->mInUse = 1;
+        do
+            ring->mNext = (LogRing *) g_atomic_pointer_get(&sLogRings);
+        while (!g_atomic_pointer_compare_and_exchange(&sLogRings, ring->mNext, ring));
+    }
+
+    tLogRing = ring;
+    pthread_setspecific(sLogRingKey, ring);
+    return ring;
+}
+
+static void copyToLogRing(LogRing * ring, guint position, const char * data, size_t length)
+{
+    size_t offset = position & (cLogRingSize - 1);
+    size_t first = MIN(length, cLogRingSize - offset);
+    ::memcpy(ring->mData + offset, data, first);
+    if (first < length)
+        ::memcpy(ring->mData, data + first, length - first);
+}
+
+static void writeLogFile(const struct iovec * iov, int count)
+{
+    ssize_t written = ::writev(sLogFile, iov, count);
+    if (written > 0)
+        sLogFileSize += written;
+}
+
+/// Start a new private log file when the current one is too big or too old.
+/// Called with the drain mutex locked.
+static void rotateLogFile()
+{
+    // .1 is renamed & trimmed by the rotation: not while gzip works on it
+    if (sLogArchiveBusy(sLogFileName.c_str()) || sLogFileSize == 0)
+        return;
+    if (sLogFileSize < sLogRotateSize &&
+        (sLogRotateAge == 0 || g_get_monotonic_time() - sLogFileOpened < sLogRotateAge * G_GINT64_CONSTANT(1000000)))
+        return;
+
+    int logFile = ::open((sLogFileName + ".new").c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_NONBLOCK | O_CLOEXEC, 0644);
+    if (logFile < 0)
+    {
+        sLogFileOpened = g_get_monotonic_time();    // keep going with the current one, try later
+        return;
+    }
+    sMoveLogFile(sLogFileName.c_str(), cLogGenerations);
+    ::rename((sLogFileName + ".new").c_str(), sLogFileName.c_str());
+    ::dup2(logFile, sLogFile);  // same descriptor, for anyone holding it
+    ::close(logFile);
+    sLogFileSize = 0;
+    sLogFileOpened = g_get_monotonic_time();
+    sArchiveLogFile(sLogFileName.c_str());
+
+    time_t now = ::time(0);
+    struct tm nowTime;
+    char startTime[64];
+    ::localtime_r(&now, &nowTime);
+    ::asctime_r(&nowTime, startTime);
+    struct iovec iov = { startTime, ::strlen(startTime) };
+    writeLogFile(&iov, 1);
+}
+
+/// Write everything staged. Called by the writer, or directly for fatal logs.
+static void drainLogRings()
+{
+    pthread_mutex_lock(&sLogDrainMutex);
+    bool again = true;
+    while (again)
+    {
+        again = false;
+        struct iovec    iov[cLogMaxIovecs];
+        LogRing *       rings[cLogMaxIovecs];
+        guint           heads[cLogMaxIovecs];
+        int             count = 0, ringCount = 0;
+
+        for (LogRing * ring = (LogRing *) g_atomic_pointer_get(&sLogRings); ring; ring = ring->mNext)
+        {
+            guint head = (guint) g_atomic_int_get(&ring->mHead);
+            guint tail = (guint) ring->mTail;
+            if (head == tail)
+                continue;
+            if (count + 2 > cLogMaxIovecs)
+            {
+                again = true;   // next batch
+                break;
+            }
+            size_t offset = tail & (cLogRingSize - 1);
+            size_t length = head - tail;
+            size_t first = MIN(length, cLogRingSize - offset);
+            iov[count].iov_base = ring->mData + offset;
+            iov[count++].iov_len = first;
+            if (first < length)
+            {
+                iov[count].iov_base = ring->mData;
+                iov[count++].iov_len = length - first;
+            }
+            rings[ringCount] = ring;
+            heads[ringCount++] = head;
+        }
+
+        if (count > 0)
+        {
+            if (sLogFile > 0)
+            {
+                rotateLogFile();
+                writeLogFile(iov, count);
+            }
+            for (int i = 0; i < ringCount; ++i)
+                g_atomic_int_set(&rings[i]->mTail, (gint) heads[i]);
+            // lines staged while we were writing: their thread may have seen
+            // the ring as not empty & not woken us up
+            again = true;
+        }
+    }
+
+    gint dropped = g_atomic_int_get(&sDroppedLogLines);
+    if (dropped != sReportedDroppedLogLines && sLogFile > 0)
+    {
+        std::string msg = string_printf("*** %d log lines dropped ***\n",
+                                        dropped - sReportedDroppedLogLines);
+        struct iovec iov = { (void *) msg.c_str(), msg.size() };
+        writeLogFile(&iov, 1);
+        sReportedDroppedLogLines = dropped;
+    }
+    pthread_mutex_unlock(&sLogDrainMutex);
+}
+
+static void * logWriterThread(void *)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&sLogWakeMutex);
+        while (!sLogWakePending)
+            pthread_cond_wait(&sLogWakeCond, &sLogWakeMutex);
+        sLogWakePending = false;
+        pthread_mutex_unlock(&sLogWakeMutex);
+
+        g_usleep(cLogBatchDelay);   // let more lines come, to write them at once
+        drainLogRings();
+    }
+    return NULL;
+}
+
+/// Stage a line for the private log file. Lock-free, unless the writer needs waking up
+static void stageLogLine(const char * timeStamp, size_t timeStampLength,
+                         const char * indent, size_t indentLength,
+                         const char * message, size_t messageLength, bool needLF)
+{
+    LogRing * ring = getLogRing();
+    if (!ring)
+    {
+        g_atomic_int_inc(&sDroppedLogLines);
+        return;
+    }
+
+    size_t length = timeStampLength + indentLength + messageLength + (needLF ? 1 : 0);
+    guint head = (guint) ring->mHead;
+    guint tail = (guint) g_atomic_int_get(&ring->mTail);
+    if (length > cLogRingSize - (head - tail))
+    {
+        g_atomic_int_inc(&sDroppedLogLines);
+        return;
+    }
+
+    copyToLogRing(ring, head, timeStamp, timeStampLength);
+    copyToLogRing(ring, head + timeStampLength, indent, indentLength);
+    copyToLogRing(ring, head + timeStampLength + indentLength, message, messageLength);
+    if (needLF)
+        copyToLogRing(ring, head + length - 1, "\n", 1);
+    g_atomic_int_set(&ring->mHead, (gint) (head + length));
+
+    // only the first line since the last write wakes the writer up
+    if (head == (guint) g_atomic_int_get(&ring->mTail))
+    {
+        pthread_mutex_lock(&sLogWakeMutex);
+        sLogWakePending = true;
+        pthread_cond_signal(&sLogWakeCond);
+        pthread_mutex_unlock(&sLogWakeMutex);
+    }
+}
+
+static void openLogs()
+{
+    sLogFileName = string_printf("/var/log/%s.log", sProcessName);
+    sMoveLogFile(sLogFileName.c_str(), cLogGenerations);
+    if (sLogDestination & eLogDestination_PrivateLogFiles)
+        sLogFile = ::open(sLogFileName.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_NONBLOCK, 0644);
+    else
+        sLogFile = -1;    // don't log to private log file
+    time_t now = ::time(0);
+    ::clock_gettime(CLOCK_MONOTONIC, &sLogStartSeconds);
+    ::localtime_r(&now, &sLogStartTime);
+    char startTime[64];
+    ::asctime_r(&sLogStartTime, startTime);
+    if (sLogFile > 0)
+    {
+        sLogFileOpened = g_get_monotonic_time();
+        struct iovec iov = { startTime, ::strlen(startTime) };
+        writeLogFile(&iov, 1);
+        pthread_mutex_lock(&sLogDrainMutex);
+        sArchiveLogFile(sLogFileName.c_str());
+        pthread_mutex_unlock(&sLogDrainMutex);
+
+        pthread_t thread;
+        pthread_key_create(&sLogRingKey, releaseLogRing);
+        if (pthread_create(&thread, NULL, logWriterThread, NULL) == 0)
+            pthread_detach(thread);
+        // whatever is staged when exiting
+        atexit(drainLogRings);
+    }
+    if (sLogDestination & eLogDestination_Terminal)
+        ::fprintf(stdout, "%s", startTime);
+}
 
 void logFilter(const gchar *log_domain, GLogLevelFlags log_level, const gchar *message, gpointer unused_data)
 {
@@ -148,41 +511,12 @@ void logFilter(const gchar *log_domain, GLogLevelFlags log_level, const gchar *m
 
     if (sLogDestination & (eLogDestination_PrivateLogFiles | eLogDestination_Terminal))
     {
-        GStaticMutexLocker            lock(slogFilter_mutex);    // race protection only needed for terminal and file logging
-
-        static int                     sLogFile = 0;
-        static struct timespec        sLogStartSeconds = { 0 };
-        static struct tm            sLogStartTime = { 0 };
+        static gsize                sLogsOpened = 0;
         const char *                indent = LogIndent::getTotalIndent();
-        if (sLogFile == 0)
+        if (g_once_init_enter(&sLogsOpened))
         {
-            std::string    baseName = string_printf("/var/log/%s.log", sProcessName);
-            sMoveLogFile(baseName.c_str(), 5);
-            if (sLogDestination & eLogDestination_PrivateLogFiles)
-                sLogFile = ::open(baseName.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_NONBLOCK, 0644);
-            else
-                sLogFile = -1;    // don't log to private log file
-            time_t now = ::time(0);
-            ::clock_gettime(CLOCK_MONOTONIC, &sLogStartSeconds);
-            ::localtime_r(&now, &sLogStartTime);
-            char startTime[64];
-            ::asctime_r(&sLogStartTime, startTime);
-            if (sLogDestination & eLogDestination_PrivateLogFiles)
-            {
-                if (sLogFile > 0)
-                {
-                    ::write(sLogFile, startTime, ::strlen(startTime));
-                    std::string    msg;
-                    msg = string_printf("Logging to private log file '%s' at %s", baseName.c_str(), startTime);
-                }
-                else
-                {
-                    std::string    msg;
-                    msg = string_printf("Unable to log to private log file '%s' at %s", baseName.c_str(), startTime);
-                }
-            }
-             if (sLogDestination & eLogDestination_Terminal)
-                ::fprintf(stdout, "%s", startTime);
+            openLogs();
+            g_once_init_leave(&sLogsOpened, 1);
         }
         struct timespec now;
         ::clock_gettime(CLOCK_MONOTONIC, &now);
@@ -206,23 +540,19 @@ void logFilter(const gchar *log_domain, GLogLevelFlags log_level, const gchar *m
             len = G_N_ELEMENTS(timeStamp) - 1;
             timeStamp[len] = 0;
         }
+        size_t messageLength = ::strlen(message);
+        bool    needLF = (messageLength < 1 || message[messageLength - 1] != '\n');
         if (sLogFile > 0)
-            ::write(sLogFile, timeStamp, len);
-        len = ::strlen(indent);
-        if (len > 0 && sLogFile > 0)
-            ::write(sLogFile, indent, len);
-        len = ::strlen(message);
-        if (sLogFile > 0)
-            ::write(sLogFile, message, len);
-        bool    needLF = false;
-        if (len < 1 || message[len - 1] != '\n')
         {
-            needLF = true;
-            if (sLogFile > 0)
-                ::write(sLogFile, "\n", 1);
+            stageLogLine(timeStamp, len, indent, ::strlen(indent), message, messageLength, needLF);
+            // errors may be followed by an abort: don't leave them behind
+            if (log_level & (G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL))
+                drainLogRings();
         }
         if (sLogDestination & eLogDestination_Terminal)
         {
+            // each line in one piece, whatever thread logs it
+            GStaticMutexLocker      lock(sLogTerminalMutex);
 
 #define COLORESCAPE        "\033["
 